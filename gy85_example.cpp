@@ -2,6 +2,7 @@
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
 #include "gy85/gy85.hpp"
+#include "gy85/sampler.hpp"
 
 // I2C defines
 #define I2C_PORT i2c0
@@ -47,18 +48,39 @@ int main()
 
     int status = 0;
 
+    // Sample at the fastest sensor output data rate
+    uint32_t period_us;
+    if (sensor.get_odr_period_us(&period_us) != PICO_OK)
+    {
+        period_us = 10000;
+    }
+
+    gy85_sampler sampler(&sensor);
+    if (sampler.start(period_us) != PICO_OK)
+    {
+        while (true)
+        {
+            printf("Error starting the sampler\n");
+            sleep_ms(1000);
+        }
+    }
+
+    gy85_sample_t sample;
+
     while (1)
     {
-        sensor.read();
+        if (!sampler.pop(&sample))
+        {
+            tight_loop_contents();
+            continue;
+        }
 
-        printf("Accel: %f %f %f\n", sensor.get_accel().x, sensor.get_accel().y, sensor.get_accel().z);
-        printf("Gyro: %f %f %f\n", sensor.get_gyro().x, sensor.get_gyro().y, sensor.get_gyro().z);
-        printf("Mag: %f %f %f\n", sensor.get_mag().x, sensor.get_mag().y, sensor.get_mag().z);
+        printf("Accel: %f %f %f\n", sample.accel.x, sample.accel.y, sample.accel.z);
+        printf("Gyro: %f %f %f\n", sample.gyro.x, sample.gyro.y, sample.gyro.z);
+        printf("Mag: %f %f %f\n", sample.mag.x, sample.mag.y, sample.mag.z);
 
         status = !status;
         gpio_put(PICO_DEFAULT_LED_PIN, status);
-
-        sleep_ms(30);
     }
 
     return 0;
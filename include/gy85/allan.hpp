@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+
+// Allan Variance Misc
+#define GY85_ALLAN_LEVELS (20)      ///< Cluster sizes 2^0 .. 2^19 samples
+#define GY85_ALLAN_OVERLAP_LOG2 (2) ///< Clusters overlap by a factor 2^OVERLAP_LOG2 at every size
+#define GY85_ALLAN_RING ((2 << GY85_ALLAN_OVERLAP_LOG2) + 1)
+#define GY85_ALLAN_MIN_TERMS (10)   ///< Points with fewer differences are left out of the noise parameters
+
+typedef struct
+{
+    double tau_s;    ///< Cluster time
+    double adev;     ///< Allan deviation, in the unit given by the scale
+    uint32_t terms;  ///< Differences averaged, the estimate is poor below GY85_ALLAN_MIN_TERMS
+} gy85_allan_point_t;
+
+typedef struct
+{
+    double random_walk;          ///< Angle/velocity random walk, unit * sqrt(s), i.e. sigma at tau = 1s on the -1/2 slope
+    double bias_instability;     ///< Flicker floor, min adev / 0.664
+    double bias_instability_tau_s;
+} gy85_noise_params_t;
+
+/**
+ * Streaming overlapping Allan variance of one axis.
+ * The integrated signal (phase) is kept exactly in 64 bit integer counts.
+ * Each cluster size m = 2^k only keeps the last 2 * 2^s + 1 phase samples
+ * at a stride of m / 2^s, s = min(k, GY85_ALLAN_OVERLAP_LOG2), so memory is
+ * logarithmic in the run length while clusters still overlap. The update is
+ * amortised O(1): a level is only touched when its stride divides the sample index.
+ */
+class allan_variance
+{
+private:
+    int64_t phase;
+    uint32_t samples;
+
+    int64_t ring[GY85_ALLAN_LEVELS][GY85_ALLAN_RING];
+    uint8_t head[GY85_ALLAN_LEVELS];
+    uint8_t fill[GY85_ALLAN_LEVELS];
+    double sum[GY85_ALLAN_LEVELS];
+    uint32_t terms[GY85_ALLAN_LEVELS];
+
+public:
+    allan_variance();
+
+    void reset();
+    void add(int32_t sample);
+    uint32_t get_samples();
+
+    uint8_t get_curve(double sample_period_s, double scale, gy85_allan_point_t *points, uint8_t max_points);
+};
+
+int gy85_allan_noise_params(const gy85_allan_point_t *points, uint8_t count, gy85_noise_params_t *params);
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+// Binary Angles
+#define GY85_ANGLE_FULL (65536)                          ///< Units in a full turn, as int16_t -180 to 180 degrees, as uint16_t 0 to 360
+#define GY85_ANGLE_TO_DEG (360.0f / GY85_ANGLE_FULL)
+#define GY85_ANGLE_TO_RAD (6.28318531f / GY85_ANGLE_FULL)
+#define GY85_ATAN2_MAX_ERROR (1)    ///< gy85_atan2() error bound in binary angle units (0.0055 degrees), checked by tools/gy85_attitude
+#define GY85_ATTITUDE_MAX_ERROR (2) ///< gy85_attitude() error bound against libm on the same inputs, up to 89 degrees of pitch
+
+typedef struct
+{
+    int16_t roll;     ///< Right-handed about x, zero with z up
+    int16_t pitch;    ///< Right-handed about y, -90 to 90 degrees
+    uint16_t heading; ///< Of the x axis, clockwise from magnetic north
+} gy85_attitude_t;
+
+/**
+ * Angle of (x, y) in binary angle units, any scale of the inputs.
+ * Octant reduction, then a 9th order odd polynomial for atan on [0, 1]
+ * (Abramowitz & Stegun 4.4.49) evaluated in 32 bit fixed point: one
+ * division and six multiplications, no floating point.
+ * atan2(0, 0) is 0.
+ */
+int16_t gy85_atan2(int32_t y, int32_t x);
+
+/**
+ * Square root rounded to the nearest integer, bit by bit without
+ * multiplications.
+ */
+uint32_t gy85_isqrt(uint32_t value);
+
+/**
+ * Roll, pitch and tilt compensated heading straight from accel and mag
+ * vectors in the same right-handed frame, in counts or any fixed point
+ * scale (only directions matter, the two scales don't have to match).
+ * The accel vector is the measured specific force, pointing up at rest.
+ * Three gy85_atan2() and two gy85_isqrt(), no sine, cosine or asin: the
+ * heading is the angle between the x axis and north in the horizontal
+ * plane, from the east (mag x accel) and north (accel x east) vectors.
+ * Heading degrades as the x axis gets close to vertical and is undefined
+ * there. Returns -1 for a zero accel vector.
+ */
+int gy85_attitude(const int32_t accel[3], const int32_t mag[3], gy85_attitude_t *attitude);
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * I2C transfers below read_registers() / write_register().
+ * Same contract as i2c_write_blocking() / i2c_read_blocking(): bytes
+ * transferred, or a negative PICO_ERROR_xxx (PICO_ERROR_GENERIC on NACK).
+ * The Pico hardware I2C is used unless other ops are installed, e.g. the
+ * host emulators in tools/emu.
+ */
+typedef struct
+{
+    int (*write)(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop);
+    int (*read)(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop);
+    void *context;
+} gy85_bus_ops_t;
+
+/**
+ * Ops used when none are installed, provided by the platform
+ * (src/bus_pico.cpp on the device)
+ */
+const gy85_bus_ops_t *gy85_default_bus_ops();
+
+/**
+ * Installs the ops used by every gy85 object, nullptr restores the default.
+ * Not synchronised, switch before any transfer is in flight.
+ */
+void gy85_set_bus_ops(const gy85_bus_ops_t *ops);
+const gy85_bus_ops_t *gy85_get_bus_ops();
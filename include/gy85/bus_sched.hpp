@@ -0,0 +1,143 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "gy85/bus.hpp"
+#include "gy85/stats.hpp"
+
+// Bus Scheduler Misc
+#define GY85_BUS_SCHED_CHUNK_US (250)  ///< Default bus time of one piece of a split transfer
+#define GY85_BUS_SCHED_MAX_HEADER (4)  ///< Address bytes of a splittable transfer
+#define GY85_BUS_SCHED_SCRATCH (GY85_BUS_SCHED_MAX_HEADER + 64) ///< Header and payload of one written piece
+#define GY85_BUS_PENDING (1)           ///< gy85_bus_xfer_t::result while queued
+
+// Bus Priority, higher goes first
+typedef enum
+{
+    BUS_PRIORITY_BULK = 0,    ///< Logging, EEPROM pages, firmware
+    BUS_PRIORITY_CONTROL = 1, ///< Housekeeping, PMIC polling
+    BUS_PRIORITY_SENSOR = 2,  ///< Periodic sensor reads
+} gy85_bus_priority_t;
+
+// Bus Scheduling Policy
+typedef enum
+{
+    BUS_POLICY_PRIORITY = 0, ///< Priority, then earliest deadline, then submission order, long transfers split
+    BUS_POLICY_FIFO = 1,     ///< Submission order, each transfer to completion, what a bare shared bus does
+} gy85_bus_policy_t;
+
+typedef struct
+{
+    uint32_t transfers;
+    uint32_t chunks;          ///< Bus transactions, more than transfers when split
+    uint32_t errors;
+    uint32_t retries;         ///< NACKs retried later (device busy)
+    uint32_t deadline_misses;
+    uint64_t wait_us;         ///< Total queueing delay
+    gy85_latency_stats_t wait;     ///< Submission to first byte on the bus
+    gy85_latency_stats_t complete; ///< Submission to completion
+} gy85_bus_client_stats_t;
+
+class gy85_bus_sched;
+
+/**
+ * One user of the shared bus. Synchronous transfers through ops (see
+ * gy85_bus_sched::attach) get the client priority and relative deadline.
+ */
+typedef struct
+{
+    const char *name;
+    gy85_bus_priority_t priority;
+    uint32_t deadline_us; ///< Relative deadline of the transfers made through ops, 0 for none
+    gy85_bus_client_stats_t stats;
+
+    gy85_bus_ops_t ops;   ///< Filled by attach(), e.g. for gy85_set_bus_ops()
+    gy85_bus_sched *sched;
+    uint8_t pending[GY85_BUS_SCHED_MAX_HEADER]; ///< Register address of a nostop write, sent with the read
+    uint8_t pending_len;
+    uint8_t pending_addr;
+} gy85_bus_client_t;
+
+/**
+ * One transaction: tx is written, then rx is read after a repeated start.
+ * Filled by the caller and owned by it until result is no longer
+ * GY85_BUS_PENDING.
+ *
+ * A transfer whose first header_len tx bytes are a big endian memory or
+ * register address of an auto-incrementing device can be split into
+ * pieces, each one re-addressed: the payload (rx, or the tx bytes after the
+ * header) is moved in pieces of at most the scheduler chunk time that never
+ * cross a multiple of page. Writes to a paged device go a page at a time.
+ */
+typedef struct gy85_bus_xfer
+{
+    gy85_bus_client_t *client;
+    uint8_t port;
+    uint8_t addr;
+    const uint8_t *tx;
+    uint16_t tx_len;
+    uint8_t *rx;           ///< nullptr for a write only transfer
+    uint16_t rx_len;
+    uint8_t header_len;    ///< 0 if the transfer must stay in one piece
+    uint16_t page;         ///< 0 for no boundary
+    uint16_t retry_us;     ///< Try again after this long on NACK (EEPROM write cycle), 0 to fail at once
+    uint32_t timeout_us;   ///< Stop retrying after this long without progress
+    uint32_t deadline_us;  ///< Absolute, time_us_32(), 0 for none
+
+    volatile int result;   ///< GY85_BUS_PENDING, then PICO_OK or PICO_ERROR_xxx
+
+    // Scheduler state
+    struct gy85_bus_xfer *next;
+    uint32_t submit_us;
+    uint32_t not_before_us;
+    uint32_t progress_us;  ///< Submission or the last piece moved
+    uint16_t done;         ///< Payload bytes moved so far
+    bool started;
+} gy85_bus_xfer_t;
+
+/**
+ * Serialises the transfers of several clients on one bus. Nothing runs in
+ * the background: run() moves one piece of the most urgent transfer, and
+ * synchronous transfers run the queue until they are done, so a sensor
+ * read waits at most for the piece on the bus plus more urgent work.
+ * The queue and each piece on the bus are handled with interrupts off, so
+ * a client may transfer from an interrupt, e.g. a gy85 read by
+ * gy85_sampler: it gets the bus between two pieces of the thread context
+ * transfers. Interrupts stay off for one piece: up to the chunk time, a
+ * page for paged writes, a whole transfer under BUS_POLICY_FIFO or when it
+ * cannot be split. One core only.
+ */
+class gy85_bus_sched
+{
+private:
+    const gy85_bus_ops_t *bus;
+    uint32_t bus_hz;
+    gy85_bus_policy_t policy;
+    uint32_t chunk_us;
+    gy85_bus_xfer_t *head;
+    gy85_bus_xfer_t *tail;
+    uint8_t scratch[GY85_BUS_SCHED_SCRATCH];
+
+    gy85_bus_xfer_t *pick(uint32_t now_us);
+    uint16_t next_piece(const gy85_bus_xfer_t *xfer);
+    int execute(gy85_bus_xfer_t *xfer, uint16_t piece);
+    int run_piece();
+    void complete(gy85_bus_xfer_t *xfer, int result);
+
+    static int client_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop);
+    static int client_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop);
+
+public:
+    gy85_bus_sched(const gy85_bus_ops_t *bus, uint32_t bus_hz = 400000);
+
+    int set_policy(gy85_bus_policy_t policy);
+    int set_chunk_us(uint32_t chunk_us);
+
+    int attach(gy85_bus_client_t *client, const char *name, gy85_bus_priority_t priority, uint32_t deadline_us = 0);
+    int reset_stats(gy85_bus_client_t *client);
+
+    int submit(gy85_bus_xfer_t *xfer);
+    int transfer(gy85_bus_xfer_t *xfer);
+    int run();
+    bool is_idle();
+    int get_next_ready_us(uint32_t *us);
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Codec Misc
+#define GY85_CODEC_VERSION (1)
+#define GY85_CODEC_BLOCK_SIZE (512)  ///< Default encoded block size, two flash pages
+#define GY85_CODEC_CHANNELS (10)     ///< Timestamp and 9 sensor axes
+#define GY85_CODEC_ESCAPE (24)       ///< Rice quotients from here on are sent as a raw 32 bit value
+#define GY85_CODEC_HEADER_SIZE (sizeof(gy85_codec_header_t))
+#define GY85_CODEC_MAX_RECORDS (1 + (GY85_CODEC_BLOCK_SIZE - GY85_CODEC_HEADER_SIZE) * 8 / GY85_CODEC_CHANNELS) ///< Every residual takes at least one bit, bound for blocks up to GY85_CODEC_BLOCK_SIZE
+#define GY85_CODEC_RAW_RECORD_SIZE (22) ///< Unpacked record size the compression ratio is given against
+
+typedef struct
+{
+    uint32_t timestamp_us;
+    int16_t accel[3]; ///< read_adxl345_raw() counts
+    int16_t gyro[3];  ///< read_itg3205_raw() counts
+    int16_t mag[3];   ///< read_qmc5883l_raw() counts
+} gy85_raw_record_t;
+
+/**
+ * Start of every block, the first record is stored verbatim so any block
+ * decodes on its own.
+ */
+typedef struct
+{
+    uint8_t version;
+    uint8_t reserved0;
+    uint16_t count;     ///< Records in the block, including the first one
+    uint16_t bytes;     ///< Payload bytes after the header
+    uint16_t reserved1;
+    gy85_raw_record_t first;
+    uint32_t reserved2;
+} gy85_codec_header_t;
+
+/**
+ * Per channel coder state, reset at every block start.
+ */
+typedef struct
+{
+    uint32_t x1, x2;      ///< Last two values
+    uint32_t sum;         ///< Running sum of mapped residuals for the Rice parameter
+    uint32_t n;
+    uint32_t cost1, cost2; ///< Decaying residual magnitude of the delta and linear predictors
+} gy85_codec_channel_t;
+
+/**
+ * Streaming lossless encoder of raw records into fixed size blocks.
+ * Each channel is predicted from its last value (delta) or its last two
+ * (linear), whichever did better recently, and the zig-zag mapped
+ * residual is Rice coded with a parameter adapted from the running mean.
+ * The decoder makes the same choices from the decoded values, nothing
+ * about them is stored. Works in place in the caller's block buffer,
+ * no allocation.
+ */
+class gy85_encoder
+{
+private:
+    uint8_t *block;
+    uint16_t size;
+    uint16_t count;
+    uint16_t pos;   ///< Next payload byte
+    uint64_t bits;  ///< Pending bits, MSB first
+    uint8_t nbits;
+    bool overflow;
+
+    gy85_codec_channel_t channels[GY85_CODEC_CHANNELS];
+
+    void put_bits(uint32_t value, uint8_t count);
+
+public:
+    gy85_encoder();
+
+    void start(uint8_t *block, uint16_t size = GY85_CODEC_BLOCK_SIZE);
+    bool add(const gy85_raw_record_t &record);
+    uint16_t finish();
+
+    uint16_t get_count();
+};
+
+int gy85_codec_decode(const uint8_t *block, size_t len, gy85_raw_record_t *records, uint16_t max_records);
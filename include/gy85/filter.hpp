@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+
+// Filter Misc
+#define GY85_FILTER_COEF_Q (28)      ///< Fraction bits of biquad coefficients
+#define GY85_FILTER_STATE_SHIFT (8)  ///< Extra fraction bits kept in biquad state
+#define GY85_FILTER_MAX_STAGES (4)   ///< Max stages per axis in a vec3_filter
+#define GY85_CIC_MAX_ORDER (4)       ///< Max CIC integrator/comb pairs
+#define GY85_FIR_MAX_TAPS (64)       ///< Max FIR decimator taps
+#define GY85_FIR_COEF_Q (15)         ///< Fraction bits of FIR coefficients
+
+/**
+ * Streaming single axis filter stage.
+ * Works on raw sensor counts, so it can run before the unit conversion.
+ * process() returns true when a new output sample was written to out,
+ * decimating stages return false for the samples they absorb.
+ */
+class axis_filter
+{
+public:
+    virtual ~axis_filter() {}
+
+    virtual bool process(int32_t in, int32_t *out) = 0;
+    virtual void reset() = 0;
+};
+
+/**
+ * Second order low pass (RBJ cookbook) in direct form I.
+ * Coefficients are Q28, products are accumulated in 64 bits and the
+ * output state keeps GY85_FILTER_STATE_SHIFT extra fraction bits.
+ */
+class biquad_lpf : public axis_filter
+{
+private:
+    int32_t b0, b1, b2, a1, a2;
+    int32_t x1, x2;
+    int32_t y1, y2;
+    int32_t err;
+
+public:
+    biquad_lpf();
+
+    int configure(float cutoff_hz, float sample_rate_hz, float q = 0.7071f);
+    bool process(int32_t in, int32_t *out) override;
+    void reset() override;
+};
+
+/**
+ * Cascaded integrator-comb decimator.
+ * Integrators wrap on purpose, the output is exact as long as
+ * 16 + order * log2(decimation) <= 32 bits, which configure() enforces.
+ */
+class cic_decimator : public axis_filter
+{
+private:
+    uint8_t order;
+    uint8_t decimation;
+    uint8_t phase;
+    int32_t integrators[GY85_CIC_MAX_ORDER];
+    int32_t combs[GY85_CIC_MAX_ORDER];
+    int32_t gain_norm; ///< 1 / decimation^order, Q30
+
+public:
+    cic_decimator();
+
+    int configure(uint8_t order, uint8_t decimation);
+    bool process(int32_t in, int32_t *out) override;
+    void reset() override;
+};
+
+/**
+ * Polyphase FIR decimator.
+ * The delay line is written every sample but the dot product is only
+ * evaluated for the samples that are kept, so the cost is taps / decimation
+ * multiply-accumulates per input sample.
+ * Coefficients are Q15, the sum of their magnitudes must stay below 2.0
+ * so the int32 accumulator cannot overflow.
+ */
+class fir_decimator : public axis_filter
+{
+private:
+    uint8_t taps;
+    uint8_t decimation;
+    uint8_t phase;
+    uint8_t head;
+    int16_t coeffs[GY85_FIR_MAX_TAPS];
+    int16_t delay[2 * GY85_FIR_MAX_TAPS]; ///< Mirrored so the window is contiguous
+
+public:
+    fir_decimator();
+
+    int configure(const int16_t *coeffs, uint8_t taps, uint8_t decimation);
+    int design_lowpass(uint8_t taps, uint8_t decimation);
+    bool process(int32_t in, int32_t *out) override;
+    void reset() override;
+};
+
+/**
+ * Per-sensor filter: an independent chain of stages for each axis.
+ * Stages are owned by the caller, so all state is preallocated.
+ */
+class vec3_filter
+{
+private:
+    axis_filter *stages[3][GY85_FILTER_MAX_STAGES];
+    uint8_t count;
+
+public:
+    vec3_filter();
+
+    int add_stage(axis_filter *x, axis_filter *y, axis_filter *z);
+    bool process(const int16_t in[3], int32_t out[3]);
+    void reset();
+};
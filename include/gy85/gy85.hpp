@@ -1,5 +1,10 @@
 #pragma once
 #include <stdint.h>
+#include "gy85/filter.hpp"
+#include "gy85/storage.hpp"
+#include "gy85/stats.hpp"
+#include "gy85/orientation.hpp"
+#include "gy85/attitude.hpp"
 
 typedef struct
 {
@@ -8,12 +13,49 @@ typedef struct
     double z;
 } vec3f_t;
 
+// GY85 Sensors
+#define GY85_SAMPLE_ACCEL (0x01)
+#define GY85_SAMPLE_GYRO (0x02)
+#define GY85_SAMPLE_MAG (0x04)
+#define GY85_SAMPLE_ALL (GY85_SAMPLE_ACCEL | GY85_SAMPLE_GYRO | GY85_SAMPLE_MAG)
+
+// GY85 Calibration Record
+#define GY85_CALIB_MAGIC (0x35385947) ///< "GY85" in little endian
+#define GY85_CALIB_VERSION (1)
+
+/**
+ * Calibration and configuration persisted in storage.
+ * Records are appended one per page, the valid one with the highest
+ * sequence number wins, so a write torn by a power loss falls back
+ * to the previous record. The region needs at least two sectors.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length; ///< sizeof(gy85_calib_record_t) when written
+    uint32_t sequence;
+    float accel_offset[3];
+    float gyro_offset[3];
+    uint8_t adxl345_range;
+    uint8_t adxl345_data_rate;
+    uint8_t itg3205_sample_rate_div;
+    uint8_t itg3205_dlpf_fs;
+    uint8_t qmc5883l_ctrl;
+    uint8_t reserved[3];
+    uint32_t crc; ///< CRC-32 of all the previous fields
+} gy85_calib_record_t;
+
 // ADXL345 Misc
 #define ADXL345_ID (0xE5) ///< ADXL345 ID
 #define ADXL345_ADDR (0x53) ///< ADXL345 I2C Address
 #define ADXL345_SCALE_FACTOR (0.0039) ///< 4mg per lsb
 #define SENSORS_GRAVITY_EARTH (9.80665F)
 
+// GY85 Init
+#define GY85_INIT_TIMEOUT_MS (100) ///< Max wait for the first sample of every sensor
+#define GY85_INIT_POLL_MS (1)      ///< Data ready polling interval during init
+
 // ADXL345 Registers
 #define ADXL345_REG_DEVID (0x00)        ///< Device ID
 #define ADXL345_REG_THRESH_TAP (0x1D)   ///< Tap threshold
@@ -94,6 +136,7 @@ typedef enum
 #define ITG3205_REG_SMPLRT_DIV 0x15
 #define ITG3205_REG_DLPF_FS 0x16
 #define ITG3205_REG_INT_CFG 0x17
+#define ITG3205_REG_INT_STATUS 0x1A
 #define ITG3205_REG_PWR_MGM 0x3E
 #define ITG3205_REG_GYRO_XOUT_H 0x1D
 
@@ -132,6 +175,7 @@ typedef enum
 #define QMC5883L_REG_CONFIG_A (0x09)
 #define QMC5883L_REG_CONFIG_B (0x0A)
 #define QMC5883L_REG_DATA (0x00)
+#define QMC5883L_REG_STATUS (0x06)
 
 // QMC5883L Mode
 typedef enum
@@ -178,21 +222,61 @@ private:
     vec3f_t accel, accel_offset;
     vec3f_t gyro, gyro_offset;
     vec3f_t mag;
+    uint8_t new_samples; ///< GY85_SAMPLE_xxx updated by the last read()
+
+    gy85_orientation_t adxl345_orientation;
+    gy85_orientation_t itg3205_orientation;
+    gy85_orientation_t qmc5883l_orientation;
+    double adxl345_axis_scale[3]; ///< Unit scale with the orientation sign folded in
+    double itg3205_axis_scale[3];
+    double qmc5883l_axis_scale[3];
+
+    vec3_filter *adxl345_filter;
+    vec3_filter *itg3205_filter;
+    vec3_filter *qmc5883l_filter;
+
+    uint64_t init_start_us;
+    uint64_t first_sample_us;
 
     void (*sleep_fn)(uint32_t);
+
+#if GY85_STATS
+    gy85_stats_t stats;
+#endif
+
+    int bus_read(uint8_t addr, uint8_t reg, uint8_t count, uint8_t *buffer);
+    int bus_write(uint8_t addr, uint8_t reg, uint8_t value);
+    int bus_write(uint8_t addr, uint8_t reg, const uint8_t *values, uint8_t count);
+
+    int wait_first_sample(uint32_t timeout_ms);
 public:
     gy85(uint8_t i2c_port = 0, uint8_t adxl345_addr = ADXL345_ADDR, uint8_t itg3205_addr = ITG3205_ADDR, uint8_t qmc5883l_addr = QMC5883L_ADDR);
 
     int init();
+    int init(gy85_storage *storage, uint16_t samples = 20);
 
     int set_sleep_fn(void (*sleep_fn)(uint32_t));
 
+    int get_odr_period_us(uint32_t *period_us);
+
+    uint64_t get_boot_to_first_sample_us();
+    uint64_t get_init_to_first_sample_us();
+
+#if GY85_STATS
+    int get_stats(gy85_stats_t *snapshot);
+    int reset_stats();
+#endif
+
     int calibrate(uint16_t samples = 20);
+    int save_calibration(gy85_storage *storage);
+    int load_calibration(gy85_storage *storage);
     int read();
 
     const vec3f_t get_accel();
     const vec3f_t get_gyro();
     const vec3f_t get_mag();
+    uint8_t get_new_samples();
+    int get_attitude(gy85_attitude_t *attitude);
     
 
     /**
@@ -201,8 +285,14 @@ public:
 
     int init_adxl345();
     int read_adxl345(vec3f_t *accel);
+    int read_adxl345_raw(int16_t raw[3]);
+    int get_adxl345_data_ready(bool *ready);
+    int set_adxl345_filter(vec3_filter *filter);
+    int set_adxl345_orientation(const gy85_orientation_t &orientation);
     int calibrate_adxl345(uint16_t samples = 20);
+    int get_adxl345_range(adxl345_range_t *range);
     int set_adxl345_range(adxl345_range_t range);
+    int get_adxl345_data_rate(adxl345_data_rate_t *dataRate);
     int set_adxl345_data_rate(adxl345_data_rate_t dataRate);
     int set_adxl345_interrupt(bool enable);
     int set_adxl345_fifo_mode(adxl345_fifo_mode_t mode);
@@ -214,7 +304,12 @@ public:
 
     int init_itg3205();
     int read_itg3205(vec3f_t *gyro);
+    int read_itg3205_raw(int16_t raw[3]);
+    int get_itg3205_data_ready(bool *ready);
+    int set_itg3205_filter(vec3_filter *filter);
+    int set_itg3205_orientation(const gy85_orientation_t &orientation);
     int calibrate_itg3205(uint16_t samples = 20);
+    int get_itg3205_sample_rate_div(uint8_t *div);
     int set_itg3205_sample_rate_div(uint8_t div);
     int set_itg3205_dlpf_fs(uint8_t dlpf_fs);
     int get_itg3205_dlpf_fs(uint8_t *dlpf_fs);
@@ -230,6 +325,10 @@ public:
 
     int init_qmc5883l();
     int read_qmc5883l(vec3f_t *mag);
+    int read_qmc5883l_raw(int16_t raw[3]);
+    int get_qmc5883l_data_ready(bool *ready);
+    int set_qmc5883l_filter(vec3_filter *filter);
+    int set_qmc5883l_orientation(const gy85_orientation_t &orientation);
     int get_qmc5883l_ctrl(uint8_t *ctrl);
     int set_qmc5883l_ctrl(uint8_t ctrl);
     int set_qmc5883l_mode(qmc5883l_mode_t mode);
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include "gy85/gy85.hpp"
+
+// Motion Estimator Misc
+#define GY85_MOTION_WINDOW (32) ///< Samples of the still detection window, a power of two
+
+typedef struct
+{
+    float gravity;             ///< Local gravity, m/s^2
+    float accel_std_threshold; ///< Still below this standard deviation of |accel| over the window, m/s^2
+    float accel_mag_threshold; ///< ... and this mean ||accel| - gravity|, m/s^2
+    float gyro_threshold;      ///< ... and this RMS rate (bias removed) over the window, rad/s
+    float tilt_gain;           ///< Pull of the gravity direction towards accel while still, rad/s per unit of error
+    float bias_gain;           ///< Gyro and accel bias learning rate while still, 1/s
+} gy85_motion_config_t;
+
+typedef struct
+{
+    float linear_accel[3];     ///< Gravity and accel bias removed, body frame, m/s^2
+    float linear_accel_nav[3]; ///< Same in the navigation frame (z up, heading follows the gyro), m/s^2
+    float velocity[3];         ///< Navigation frame, m/s, zero while still
+    float up[3];               ///< Gravity direction (up) in the body frame, unit
+    bool still;
+} gy85_motion_t;
+
+/**
+ * Default thresholds for the ADXL345 and ITG3205 noise at 100Hz.
+ */
+constexpr gy85_motion_config_t gy85_motion_default_config()
+{
+    return {9.80665f, 0.06f, 0.5f, 0.02f, 2.0f, 1.0f};
+}
+
+/**
+ * Linear acceleration and short horizon velocity from the gyro (rad/s) and
+ * accel (m/s^2) stream (e.g. gy85_sampler samples), with zero velocity
+ * updates.
+ * The attitude is propagated with the gyro, so gravity comes out of the
+ * accel under rotation and the velocity is integrated in a fixed frame.
+ * Still (stance) phases are detected over a GY85_MOTION_WINDOW sample
+ * window from the spread of |accel| and the gyro rate. While still the
+ * velocity is held at zero, the gravity direction is pulled towards the
+ * accel and the gyro and accel biases are learnt, so the velocity error
+ * is bounded by what builds up during one motion phase. The corrections
+ * use the sample in the middle of the window, so the slow start and end of
+ * the moves either side do not leak into the biases and the attitude.
+ * Fixed memory and single precision only, checked on the host by
+ * tools/gy85_motion.
+ */
+class gy85_motion
+{
+private:
+    gy85_motion_config_t config;
+    float sample_period_s;
+
+    float attitude[4];    ///< Body to navigation quaternion, w x y z
+    float gyro_bias[3];
+    float accel_bias[3];  ///< Body frame
+    float velocity[3];
+    bool aligned;
+
+    // Still detection window
+    float window_accel[GY85_MOTION_WINDOW];    ///< |accel| - gravity
+    float window_gyro[GY85_MOTION_WINDOW];     ///< |gyro|^2, bias removed
+    float window_rate[GY85_MOTION_WINDOW][3];  ///< Measured gyro
+    float window_force[GY85_MOTION_WINDOW][3]; ///< Measured accel
+    float sum_accel;
+    float sum_accel2;
+    float sum_gyro;
+    uint16_t window_count;
+    uint16_t window_index;
+
+    bool update_window(const float accel[3], float accel_norm, const float measured[3], float gyro_norm2);
+
+public:
+    gy85_motion();
+
+    int configure(float sample_rate_hz, const gy85_motion_config_t &config = gy85_motion_default_config());
+    void reset();
+
+    void add(const vec3f_t &gyro, const vec3f_t &accel, gy85_motion_t *out);
+    int get_gyro_bias(float bias[3]);
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include "gy85/gy85.hpp"
+#include "gy85/allan.hpp"
+
+// Noise Characterisation Misc
+#define GY85_NOISE_SETTLE_SAMPLES (16) ///< Samples discarded after a setting change
+#define GY85_NOISE_TIMEOUT_PERIODS (10) ///< Missed sample periods before a run gives up
+
+typedef struct
+{
+    gy85_sensor_t sensor;
+    uint8_t setting;         ///< adxl345_data_rate_t, itg3205_dlpf_t or qmc5883l_over_sample_t in use
+    double sample_period_s;
+    uint32_t samples;
+    gy85_noise_params_t axes[3];
+    gy85_allan_point_t curve[3][GY85_ALLAN_LEVELS];
+    uint8_t curve_points[3];
+} gy85_noise_report_t;
+
+typedef void (*gy85_noise_report_fn)(const gy85_noise_report_t *report, void *user_data);
+
+/**
+ * Records a still-sensor run of one sensor at its current setting, paced by
+ * its data ready flag, and fills the report with the Allan deviation of each
+ * raw axis in m/s^2, rad/s or counts.
+ * The three accumulators are supplied by the caller (~1.7KB each).
+ */
+int gy85_noise_run(gy85 *sensor, gy85_sensor_t which, uint32_t samples, allan_variance axes[3], gy85_noise_report_t *report);
+
+/**
+ * Runs gy85_noise_run() for every setting of the sensor's noise related enum
+ * (ADXL345 12.5..800Hz data rate, ITG3205 DLPF, QMC5883L over sampling),
+ * calls report_fn after each one and restores the original configuration.
+ */
+int gy85_noise_sweep(gy85 *sensor, gy85_sensor_t which, uint32_t samples, allan_variance axes[3], gy85_noise_report_t *report,
+                     gy85_noise_report_fn report_fn, void *user_data);
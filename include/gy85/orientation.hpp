@@ -0,0 +1,175 @@
+#pragma once
+#include <stdint.h>
+
+// Signed sensor axes
+typedef enum
+{
+    AXIS_PX = 0x00, ///< +X
+    AXIS_PY = 0x01, ///< +Y
+    AXIS_PZ = 0x02, ///< +Z
+    AXIS_NX = 0x80, ///< -X
+    AXIS_NY = 0x81, ///< -Y
+    AXIS_NZ = 0x82, ///< -Z
+} gy85_axis_t;
+
+/**
+ * Mounting orientation of a sensor: output = R * sensor.
+ * Axis aligned orientations (signed permutations) are applied as an index
+ * and a sign folded into the unit scale, so they cost nothing over the
+ * plain conversion. Anything else falls back to the 3x3 matrix.
+ * R must be a proper rotation: duplicate axes, mirrors (determinant -1)
+ * and non orthonormal matrices are a compile error in a constexpr
+ * declaration and are rejected by the setters at run time.
+ */
+typedef struct
+{
+    bool valid;
+    bool aligned;
+    uint8_t axis[3];    ///< Sensor axis feeding output x, y, z
+    int8_t sign[3];
+    float matrix[3][3]; ///< Row i gives output axis i, only used when not aligned
+} gy85_orientation_t;
+
+/**
+ * Not constexpr, so reaching it while evaluating a constexpr orientation
+ * fails the compilation. At run time it gives an orientation the setters
+ * reject.
+ */
+inline gy85_orientation_t gy85_orientation_invalid()
+{
+    return gy85_orientation_t{};
+}
+
+/**
+ * True when the signed axes are a proper rotation: each sensor axis used
+ * once and an even number of sign flips and swaps.
+ */
+constexpr bool gy85_orientation_axes_valid(gy85_axis_t x, gy85_axis_t y, gy85_axis_t z)
+{
+    const gy85_axis_t axes[3] = {x, y, z};
+    int det = 1;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if ((axes[i] & 0x7F) > 2)
+        {
+            return false;
+        }
+        det *= axes[i] & 0x80 ? -1 : 1;
+    }
+
+    int a = x & 0x03, b = y & 0x03, c = z & 0x03;
+    if (a == b || b == c || a == c)
+    {
+        return false;
+    }
+
+    // Cyclic permutations are even, the others swap two axes
+    bool even = (b == (a + 1) % 3) && (c == (b + 1) % 3);
+
+    return (even ? det : -det) == 1;
+}
+
+/**
+ * Output x, y, z taken from the given signed sensor axes,
+ * e.g. gy85_orientation_axes(AXIS_NY, AXIS_PX, AXIS_PZ) rotates 90 degrees around z.
+ */
+constexpr gy85_orientation_t gy85_orientation_axes(gy85_axis_t x, gy85_axis_t y, gy85_axis_t z)
+{
+    if (!gy85_orientation_axes_valid(x, y, z))
+    {
+        return gy85_orientation_invalid();
+    }
+
+    gy85_orientation_t orientation{};
+    const gy85_axis_t axes[3] = {x, y, z};
+
+    orientation.valid = true;
+    orientation.aligned = true;
+    for (int i = 0; i < 3; i++)
+    {
+        orientation.axis[i] = axes[i] & 0x03;
+        orientation.sign[i] = axes[i] & 0x80 ? -1 : 1;
+        orientation.matrix[i][axes[i] & 0x03] = orientation.sign[i];
+    }
+
+    return orientation;
+}
+
+/**
+ * True when R R^T is the identity and det R is +1, within 1e-4 so
+ * rounded entries such as 0.7071f still pass.
+ */
+constexpr bool gy85_orientation_matrix_valid(const float (&matrix)[3][3])
+{
+    const float tolerance = 1e-4f;
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            float dot = matrix[i][0] * matrix[j][0] + matrix[i][1] * matrix[j][1] + matrix[i][2] * matrix[j][2];
+            float error = dot - (i == j ? 1 : 0);
+            if (error > tolerance || error < -tolerance)
+            {
+                return false;
+            }
+        }
+    }
+
+    // Orthonormal leaves +1 or -1, -1 is a mirror
+    float det = matrix[0][0] * (matrix[1][1] * matrix[2][2] - matrix[1][2] * matrix[2][1]) -
+                matrix[0][1] * (matrix[1][0] * matrix[2][2] - matrix[1][2] * matrix[2][0]) +
+                matrix[0][2] * (matrix[1][0] * matrix[2][1] - matrix[1][1] * matrix[2][0]);
+
+    return det > 0;
+}
+
+/**
+ * Arbitrary rotation matrix, detected as axis aligned at compile time when
+ * every row holds a single +/-1.
+ */
+constexpr gy85_orientation_t gy85_orientation_matrix(const float (&matrix)[3][3])
+{
+    if (!gy85_orientation_matrix_valid(matrix))
+    {
+        return gy85_orientation_invalid();
+    }
+
+    gy85_orientation_t orientation{};
+    const float tolerance = 1e-6f;
+
+    orientation.valid = true;
+    orientation.aligned = true;
+    for (int i = 0; i < 3; i++)
+    {
+        int nonzero = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            float value = matrix[i][j];
+            float magnitude = value < 0 ? -value : value;
+
+            orientation.matrix[i][j] = value;
+
+            if (magnitude > tolerance)
+            {
+                nonzero++;
+                orientation.axis[i] = j;
+                orientation.sign[i] = value < 0 ? -1 : 1;
+                if (magnitude < 1 - tolerance || magnitude > 1 + tolerance)
+                {
+                    orientation.aligned = false;
+                }
+            }
+        }
+
+        if (nonzero != 1)
+        {
+            orientation.aligned = false;
+        }
+    }
+
+    return orientation;
+}
+
+constexpr gy85_orientation_t GY85_ORIENTATION_IDENTITY = gy85_orientation_axes(AXIS_PX, AXIS_PY, AXIS_PZ);
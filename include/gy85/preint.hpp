@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include "gy85/gy85.hpp"
+
+typedef struct
+{
+    float dtheta[3]; ///< Rotation vector of the interval, rad, coning compensated
+    float dvel[3];   ///< Velocity change in the body frame at the start of the interval, m/s, rotation and sculling compensated
+    float dt;        ///< Interval length, s
+    uint16_t count;  ///< Input samples integrated
+} gy85_preint_t;
+
+/**
+ * Integrates gyro and accel samples into delta angle / delta velocity
+ * increments, emitted once every `decimation` samples.
+ * Each sample is taken as the mean rate over its period (the DLPF makes
+ * that a good approximation), the increments are corrected with Savage's
+ * recursive coning and sculling terms using the previous sample, so the
+ * attitude and velocity drift at the output rate stays close to what
+ * integrating every input sample would give.
+ * Single precision only, checked on the host by tools/gy85_preint.
+ */
+class gy85_preint
+{
+private:
+    float sample_period_s;
+    uint16_t decimation;
+    uint16_t count;
+
+    float alpha[3];      ///< Sum of the angle increments of the interval
+    float velocity[3];   ///< Sum of the velocity increments of the interval
+    float coning[3];
+    float sculling[3];
+    float prev_dalpha[3];
+    float prev_dvel[3];
+
+public:
+    gy85_preint();
+
+    int configure(float sample_rate_hz, uint16_t decimation);
+    void reset();
+
+    bool add(const vec3f_t &gyro, const vec3f_t &accel, gy85_preint_t *out);
+};
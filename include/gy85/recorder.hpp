@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+#include "gy85/storage.hpp"
+#include "gy85/codec.hpp"
+
+// Recorder Misc
+#define GY85_RECORDER_SECTOR_MAGIC (0x52385947) ///< "GY8R" in little endian
+#define GY85_RECORDER_BLOCK_MAGIC (0x42385947)  ///< "GY8B" in little endian
+#define GY85_RECORDER_SLOT_SIZE (510)           ///< 8 slots fill a 4KB sector after its header
+#define GY85_RECORDER_PAYLOAD_SIZE (GY85_RECORDER_SLOT_SIZE - sizeof(gy85_recorder_block_header_t))
+
+/**
+ * First bytes of every sector, programmed right after the erase
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t erase_count;
+    uint32_t reserved;
+    uint32_t crc;
+} gy85_recorder_sector_header_t;
+
+/**
+ * Start of every slot
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;  ///< Block number since the store was first used, consecutive within a sector
+    uint16_t length;    ///< Payload bytes
+    uint16_t header_crc; ///< Low half of the CRC-32 of the fields above
+    uint32_t crc;       ///< CRC-32 of the payload
+} gy85_recorder_block_header_t;
+
+typedef struct
+{
+    uint32_t sector;
+    uint32_t slot;
+    uint32_t from_sequence;
+    bool done;
+} gy85_recorder_cursor_t;
+
+/**
+ * Circular log of blocks on a gy85_storage region.
+ * Sectors are filled with fixed size slots in order and recycled round
+ * robin, so every sector sees the same number of erases, the oldest
+ * sector is dropped when the log wraps. Each sector carries its erase
+ * count, each block a sequence number and CRCs.
+ * recover() only reads the first 32 bytes of every sector plus a binary
+ * search of the slot headers in the newest one, and checks that the slot
+ * it resumes at is fully erased, a dirty one is retired. A block torn by
+ * a power loss costs that slot and is skipped on export.
+ * recover(true) writes nothing, for exporting a dump: dirty slots are left
+ * as they are and append() fails.
+ * Slots do not have to be page aligned, the pages around them are
+ * programmed with 0xFF which leaves NOR flash unchanged.
+ * Methods return 0 on success and -1 on failure, storage calls are
+ * expected to return 0 (PICO_OK) on success.
+ */
+class gy85_recorder
+{
+private:
+    gy85_storage *storage;
+    uint32_t sectors;
+    uint32_t slots_per_sector;
+
+    uint32_t head_sector;   ///< Sector being written
+    uint32_t head_slot;     ///< Next slot in it
+    uint32_t sequence;      ///< Next block sequence
+    uint32_t max_erase_count;
+    bool read_only;
+
+    gy85_encoder encoder;
+    uint8_t block[GY85_RECORDER_PAYLOAD_SIZE];
+
+    uint32_t slot_offset(uint32_t sector, uint32_t slot);
+    int program_bytes(uint32_t offset, const uint8_t *data, uint32_t len);
+    int read_sector_start(uint32_t sector, gy85_recorder_sector_header_t *sector_header, gy85_recorder_block_header_t *block_header);
+    int slot_erased(uint32_t sector, uint32_t slot, bool *erased);
+    int open_next_sector();
+
+public:
+    gy85_recorder(gy85_storage *storage);
+
+    int recover(bool read_only = false);
+
+    int append(const uint8_t *data, uint16_t len);
+    int add(const gy85_raw_record_t &record);
+    int flush();
+
+    void begin_export(gy85_recorder_cursor_t *cursor, uint32_t from_sequence = 0);
+    int read_next(gy85_recorder_cursor_t *cursor, uint8_t *data, uint16_t *len, uint32_t *sequence);
+
+    uint32_t get_sequence();
+    int get_wear(uint32_t *min_erases, uint32_t *max_erases);
+};
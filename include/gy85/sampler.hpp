@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include "gy85/gy85.hpp"
+
+// Sampler Misc
+#define GY85_SAMPLER_QUEUE (16)          ///< Samples buffered between the alarm and the application, power of two
+#define GY85_SAMPLER_JITTER_BINS (128)   ///< Period error histogram bins, the last one is open
+#define GY85_SAMPLER_JITTER_BIN_US (4)   ///< Period error histogram resolution
+
+typedef struct
+{
+    uint64_t timestamp_us; ///< Time the acquisition started
+    uint32_t sequence;     ///< Period index since start, gaps are missed periods
+    uint8_t sensors;       ///< GY85_SAMPLE_xxx with a new sample, the other vectors are not valid
+    vec3f_t accel;
+    vec3f_t gyro;
+    vec3f_t mag;
+} gy85_sample_t;
+
+typedef struct
+{
+    uint32_t periods;     ///< Periods that fired
+    uint32_t missed;      ///< Periods skipped because the previous one overran
+    uint32_t dropped;     ///< Samples lost because the queue was full
+    uint32_t errors;      ///< Periods where a sensor read failed
+    int32_t period_error_min_us; ///< Actual period minus nominal period
+    int32_t period_error_max_us;
+    uint32_t period_error_p99_us; ///< 99th percentile of the absolute period error, bin upper edge
+    uint32_t latency_max_us;      ///< Max delay between the target time and the alarm firing
+} gy85_sampler_stats_t;
+
+/**
+ * Drift-free periodic schedule, tools/gy85_schedule drives it with a
+ * simulated clock.
+ * Targets are start + n * period, a late period never shifts later ones.
+ */
+class gy85_schedule
+{
+private:
+    uint64_t period_us;
+    uint64_t target_us;
+    uint64_t last_fire_us;
+    uint32_t index;
+    uint32_t last_index;
+    bool fired;
+
+    gy85_sampler_stats_t stats;
+    uint32_t jitter_bins[GY85_SAMPLER_JITTER_BINS];
+
+public:
+    gy85_schedule();
+
+    void start(uint64_t now_us, uint32_t period_us);
+    uint64_t get_target_us();
+    uint32_t get_index();
+    uint64_t fire(uint64_t now_us);
+
+    void record_dropped();
+    void record_error();
+    void get_stats(gy85_sampler_stats_t *stats);
+    void reset_stats();
+};
+
+/**
+ * Reads the sensors from a hardware alarm at a fixed rate and queues the
+ * samples for the application.
+ * The reads run in the alarm interrupt, the gy85 object must not be used
+ * from elsewhere while the sampler is running.
+ * They are blocking I2C transfers: the three sensors keep the interrupt
+ * busy for about 640us at 400kHz (four times that at 100kHz), other
+ * alarms of the default pool and lower priority interrupts wait for them.
+ * The default bus ops have no timeout, a stuck bus hangs the interrupt,
+ * install bus ops with a timeout (gy85_set_bus_ops()) where that matters.
+ * On a bus shared through gy85_bus_sched, install the ops of a client
+ * attached with BUS_PRIORITY_SENSOR: the alarm then waits for the piece of
+ * a thread context transfer on the bus (see gy85_bus_sched), and the
+ * reads go ahead of the queued ones. Any other bus ops used from thread
+ * context on the same bus would collide with the interrupt.
+ */
+class gy85_sampler
+{
+private:
+    gy85 *sensor;
+    uint8_t sensors;
+    int32_t alarm_id;
+    volatile bool running;
+
+    gy85_schedule schedule;
+
+    gy85_sample_t queue[GY85_SAMPLER_QUEUE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+
+    static int64_t alarm_callback(int32_t id, void *user_data);
+    int64_t on_alarm();
+
+public:
+    gy85_sampler(gy85 *sensor, uint8_t sensors = GY85_SAMPLE_ALL);
+
+    int start(uint32_t period_us);
+    int stop();
+
+    bool pop(gy85_sample_t *sample);
+    uint32_t available();
+
+    int get_stats(gy85_sampler_stats_t *stats);
+    int reset_stats();
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Instrumentation is compiled out unless GY85_STATS is set to 1
+#ifndef GY85_STATS
+#define GY85_STATS 0
+#endif
+
+// Stats Misc
+#define GY85_STATS_MAGIC (0x53385947) ///< "GY8S" in little endian
+#define GY85_STATS_VERSION (1)
+#define GY85_STATS_BUCKETS (16) ///< Bucket i counts latencies in [2^(i-1), 2^i) us, the last one is open
+
+// Sensors
+typedef enum
+{
+    SENSOR_ADXL345 = 0,
+    SENSOR_ITG3205 = 1,
+    SENSOR_QMC5883L = 2,
+    SENSOR_COUNT = 3,
+} gy85_sensor_t;
+
+// Bus Error Causes
+typedef enum
+{
+    BUS_ERROR_NACK = 0,    ///< Address or data not acknowledged
+    BUS_ERROR_TIMEOUT = 1, ///< Transfer timed out
+    BUS_ERROR_SHORT = 2,   ///< Fewer bytes than requested were transferred
+    BUS_ERROR_INVALID = 3, ///< Transfer rejected before reaching the bus
+    BUS_ERROR_OTHER = 4,
+    BUS_ERROR_COUNT = 5,
+} gy85_bus_error_t;
+
+// Instrumented Operations
+typedef enum
+{
+    OP_READ = 0,
+    OP_READ_ADXL345,
+    OP_READ_ITG3205,
+    OP_READ_QMC5883L,
+    OP_SET_ADXL345_RANGE,
+    OP_SET_ADXL345_DATA_RATE,
+    OP_SET_ADXL345_INTERRUPT,
+    OP_SET_ADXL345_FIFO_MODE,
+    OP_SET_ADXL345_SLEEP,
+    OP_SET_ITG3205_SAMPLE_RATE_DIV,
+    OP_SET_ITG3205_DLPF_FS,
+    OP_SET_ITG3205_FS,
+    OP_SET_ITG3205_DLPF,
+    OP_SET_ITG3205_INTERRUPT,
+    OP_SET_ITG3205_SLEEP,
+    OP_SET_QMC5883L_CTRL,
+    OP_SET_QMC5883L_MODE,
+    OP_SET_QMC5883L_SCALE,
+    OP_SET_QMC5883L_OUTPUT_RATE,
+    OP_SET_QMC5883L_OVER_SAMPLE,
+    OP_SET_QMC5883L_INTERRUPT,
+    OP_SET_QMC5883L_SLEEP,
+    OP_COUNT,
+} gy85_op_t;
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t errors[BUS_ERROR_COUNT];
+} gy85_bus_stats_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[GY85_STATS_BUCKETS];
+} gy85_latency_stats_t;
+
+/**
+ * Driver counters, all uint32_t so the binary dump is the struct itself
+ * (little endian on the RP2040), self described by its header fields.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sensor_count;
+    uint32_t bus_error_count;
+    uint32_t op_count;
+    uint32_t bucket_count;
+    gy85_bus_stats_t bus[SENSOR_COUNT];
+    gy85_latency_stats_t ops[OP_COUNT];
+} gy85_stats_t;
+
+void gy85_stats_reset(gy85_stats_t *stats);
+void gy85_stats_record_transfer(gy85_stats_t *stats, gy85_sensor_t sensor, uint32_t bytes_read, uint32_t bytes_written, int result);
+void gy85_stats_record_latency(gy85_stats_t *stats, gy85_op_t op, uint32_t us);
+void gy85_latency_record(gy85_latency_stats_t *latency, uint32_t us);
+
+int gy85_stats_format(const gy85_stats_t *stats, char *buffer, size_t len);
+int gy85_stats_serialize(const gy85_stats_t *stats, uint8_t *buffer, size_t len);
+
+/**
+ * Records the duration of the enclosing scope, covers every return path.
+ */
+class gy85_stats_scope
+{
+private:
+    gy85_stats_t *stats;
+    gy85_op_t op;
+    uint32_t start_us;
+
+public:
+    gy85_stats_scope(gy85_stats_t *stats, gy85_op_t op);
+    ~gy85_stats_scope();
+};
+
+#if GY85_STATS
+#define GY85_STATS_OP(op) gy85_stats_scope stats_scope(&this->stats, op)
+#else
+#define GY85_STATS_OP(op)
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Storage Misc
+#define GY85_FLASH_SECTOR_SIZE (4096) ///< RP2040 flash erase granularity
+#define GY85_FLASH_PAGE_SIZE (256)    ///< RP2040 flash program granularity
+#define GY85_FLASH_LOCKOUT_TIMEOUT_MS (100) ///< Max wait for core 1 to stop running from flash
+
+/**
+ * Abstract non volatile storage region with NOR flash semantics:
+ * erase sets a whole sector to 0xFF, program can only clear bits and
+ * works on whole pages. Offsets are relative to the start of the region.
+ */
+class gy85_storage
+{
+public:
+    virtual ~gy85_storage() {}
+
+    virtual uint32_t size() = 0;
+    virtual uint32_t sector_size() = 0;
+    virtual uint32_t page_size() = 0;
+
+    virtual int read(uint32_t offset, uint8_t *buffer, uint32_t len) = 0;
+    virtual int erase(uint32_t offset) = 0;
+    virtual int program(uint32_t offset, const uint8_t *data, uint32_t len) = 0;
+};
+
+/**
+ * Region of the RP2040 program flash.
+ * flash_offset is relative to the start of flash and must be sector aligned,
+ * e.g. PICO_FLASH_SIZE_BYTES - 2 * FLASH_SECTOR_SIZE for the last two sectors.
+ * The region must not overlap the program image.
+ * Erase and program go through flash_safe_execute(): when core 1 runs it
+ * must have called flash_safe_execute_core_init(), otherwise they fail
+ * with PICO_ERROR_NOT_PERMITTED instead of crashing it.
+ */
+class gy85_flash_storage : public gy85_storage
+{
+private:
+    uint32_t flash_offset;
+    uint32_t region_size;
+
+public:
+    gy85_flash_storage(uint32_t flash_offset, uint32_t region_size = 2 * GY85_FLASH_SECTOR_SIZE);
+
+    uint32_t size() override;
+    uint32_t sector_size() override;
+    uint32_t page_size() override;
+
+    int read(uint32_t offset, uint8_t *buffer, uint32_t len) override;
+    int erase(uint32_t offset) override;
+    int program(uint32_t offset, const uint8_t *data, uint32_t len) override;
+};
+
+uint32_t gy85_crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
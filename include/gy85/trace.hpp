@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Trace Misc
+#define GY85_TRACE_MAGIC (0x54385947) ///< "GY8T" in little endian
+#define GY85_TRACE_VERSION (2)
+#define GY85_TRACE_ENTRIES (64) ///< Must be a power of two
+
+// Trace Entry Flags
+#define GY85_TRACE_WRITE (0x01) ///< Register write, otherwise register read
+#define GY85_TRACE_BOOT (0x80)  ///< Marker inserted when the ring survived a reset
+
+typedef struct
+{
+    uint32_t timestamp_us; ///< Start of the transaction, timer time since boot
+    uint16_t duration_us;  ///< Saturates at 65535
+    uint8_t addr;
+    uint8_t reg;
+    uint8_t len;
+    uint8_t flags;
+    int8_t result;         ///< PICO_OK or the bus error
+    uint8_t reserved;      ///< Always 0
+} gy85_trace_entry_t;
+
+/**
+ * Ring of the last GY85_TRACE_ENTRIES I2C transactions of every gy85
+ * instance. Lives in uninitialised RAM so it survives a watchdog reset; the
+ * dump format is this struct as is (little endian).
+ * Recording is safe from thread context and interrupts of one core, only
+ * one core may record.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count; ///< GY85_TRACE_ENTRIES
+    uint32_t head;        ///< Total entries recorded, wraps
+    uint32_t first;       ///< Sequence of the oldest valid entry, head - first <= entry_count modulo 2^32
+    gy85_trace_entry_t entries[GY85_TRACE_ENTRIES];
+    uint32_t magic_check; ///< ~magic, guards against random RAM contents
+} gy85_trace_t;
+
+/**
+ * Device side
+ */
+
+void gy85_trace_init();
+void gy85_trace_record(uint8_t addr, uint8_t reg, uint8_t len, uint8_t flags, int result, uint32_t start_us);
+int gy85_trace_dump(uint8_t *buffer, size_t len);
+
+/**
+ * Decoding, has no SDK dependency so it builds on the host
+ */
+
+int gy85_trace_decode(const uint8_t *dump, size_t len, gy85_trace_entry_t *entries, size_t max_entries, uint32_t *first_sequence);
@@ -0,0 +1,140 @@
+#include "gy85/allan.hpp"
+#include <math.h>
+#include <string.h>
+
+allan_variance::allan_variance()
+{
+    this->reset();
+}
+
+void allan_variance::reset()
+{
+    this->phase = 0;
+    this->samples = 0;
+
+    memset(this->ring, 0, sizeof(this->ring));
+    memset(this->sum, 0, sizeof(this->sum));
+    memset(this->terms, 0, sizeof(this->terms));
+
+    // x(0) = 0 belongs to every level
+    for (uint8_t k = 0; k < GY85_ALLAN_LEVELS; k++)
+    {
+        this->head[k] = 1;
+        this->fill[k] = 1;
+    }
+}
+
+void allan_variance::add(int32_t sample)
+{
+    this->phase += sample;
+    this->samples++;
+
+    for (uint8_t k = 0; k < GY85_ALLAN_LEVELS; k++)
+    {
+        uint8_t s = k < GY85_ALLAN_OVERLAP_LOG2 ? k : GY85_ALLAN_OVERLAP_LOG2;
+        uint32_t stride = (uint32_t)1 << (k - s);
+
+        // Strides only grow with k, the remaining levels are not due either
+        if (this->samples & (stride - 1))
+        {
+            break;
+        }
+
+        uint8_t h = this->head[k];
+        this->ring[k][h] = this->phase;
+        this->head[k] = h + 1 == GY85_ALLAN_RING ? 0 : h + 1;
+
+        uint8_t span = 1 << s;
+        if (this->fill[k] < 2 * span + 1)
+        {
+            this->fill[k]++;
+        }
+        if (this->fill[k] < 2 * span + 1)
+        {
+            continue;
+        }
+
+        // x(n) - 2 x(n - m) + x(n - 2m), exact in integer counts
+        int64_t x1 = this->ring[k][(h + GY85_ALLAN_RING - span) % GY85_ALLAN_RING];
+        int64_t x2 = this->ring[k][(h + GY85_ALLAN_RING - 2 * span) % GY85_ALLAN_RING];
+        double d = (double)(this->phase - 2 * x1 + x2);
+
+        this->sum[k] += d * d;
+        this->terms[k]++;
+    }
+}
+
+uint32_t allan_variance::get_samples()
+{
+    return this->samples;
+}
+
+uint8_t allan_variance::get_curve(double sample_period_s, double scale, gy85_allan_point_t *points, uint8_t max_points)
+{
+    uint8_t count = 0;
+
+    for (uint8_t k = 0; k < GY85_ALLAN_LEVELS && count < max_points; k++)
+    {
+        if (this->terms[k] == 0)
+        {
+            break;
+        }
+
+        // AVAR = <(x(n) - 2 x(n - m) + x(n - 2m))^2> / (2 m^2), in counts^2
+        double m = (double)((uint32_t)1 << k);
+        double avar = this->sum[k] / (2.0 * m * m * this->terms[k]);
+
+        points[count].tau_s = m * sample_period_s;
+        points[count].adev = sqrt(avar) * scale;
+        points[count].terms = this->terms[k];
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Reads the noise terms off an Allan deviation curve.
+ * Random walk: average of adev * sqrt(tau) where the log-log slope is close to -1/2,
+ * before the minimum so that the noisy tail cannot pass for it.
+ * Bias instability: minimum of the curve divided by sqrt(2 ln 2 / pi) = 0.664.
+ */
+int gy85_allan_noise_params(const gy85_allan_point_t *points, uint8_t count, gy85_noise_params_t *params)
+{
+    // The tail of the curve is averaged over too few clusters to be trusted
+    while (count > 0 && points[count - 1].terms < GY85_ALLAN_MIN_TERMS)
+    {
+        count--;
+    }
+
+    if (count == 0)
+    {
+        return -1;
+    }
+
+    uint8_t min_index = 0;
+    for (uint8_t i = 1; i < count; i++)
+    {
+        if (points[i].adev < points[min_index].adev)
+        {
+            min_index = i;
+        }
+    }
+    params->bias_instability = points[min_index].adev / 0.664;
+    params->bias_instability_tau_s = points[min_index].tau_s;
+
+    double walk_sum = 0;
+    uint8_t walk_count = 0;
+    for (uint8_t i = 0; i < min_index; i++)
+    {
+        double slope = log(points[i + 1].adev / points[i].adev) / log(points[i + 1].tau_s / points[i].tau_s);
+        if (slope > -0.75 && slope < -0.25)
+        {
+            walk_sum += points[i].adev * sqrt(points[i].tau_s);
+            walk_count++;
+        }
+    }
+    params->random_walk = walk_count > 0 ? walk_sum / walk_count : points[0].adev * sqrt(points[0].tau_s);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "gy85/attitude.hpp"
+
+// A&S 4.4.49 coefficients in binary angle units * 8
+#define ATAN_C1 (83432)
+#define ATAN_C3 (-27561)
+#define ATAN_C5 (15032)
+#define ATAN_C7 (-7104)
+#define ATAN_C9 (1739)
+
+#define ANGLE_QUARTER (GY85_ANGLE_FULL / 4)
+#define ANGLE_HALF (GY85_ANGLE_FULL / 2)
+
+#define ACCEL_BITS (22) ///< Normalized accel, squares and their sums stay exact in 64 bits
+#define MAG_BITS (15)   ///< Normalized mag, products with the accel terms fit 64 bits
+
+static inline uint8_t bit_length(uint32_t value)
+{
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+static inline uint32_t abs_u32(int32_t value)
+{
+    return value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+}
+
+int16_t gy85_atan2(int32_t y, int32_t x)
+{
+    uint32_t ux = abs_u32(x);
+    uint32_t uy = abs_u32(y);
+    uint32_t hi = ux > uy ? ux : uy;
+    uint32_t lo = ux > uy ? uy : ux;
+    if (hi == 0)
+    {
+        return 0;
+    }
+
+    // Keep hi to 16 bits so the ratio fits 32 bits
+    uint8_t bits = bit_length(hi);
+    if (bits > 16)
+    {
+        uint8_t shift = bits - 16;
+        hi = (hi + (1u << (shift - 1))) >> shift;
+        lo = (lo + (1u << (shift - 1))) >> shift;
+    }
+
+    // z = lo / hi and t = z^2 in Q15
+    uint32_t z = ((lo << 15) + hi / 2) / hi;
+    int32_t t = (int32_t)((z * z + (1u << 14)) >> 15);
+
+    int32_t p = ATAN_C9;
+    p = ATAN_C7 + ((p * t + (1 << 14)) >> 15);
+    p = ATAN_C5 + ((p * t + (1 << 14)) >> 15);
+    p = ATAN_C3 + ((p * t + (1 << 14)) >> 15);
+    p = ATAN_C1 + ((p * t + (1 << 14)) >> 15);
+    int32_t angle = (int32_t)((z * (uint32_t)p + (1u << 17)) >> 18);
+
+    if (uy > ux)
+    {
+        angle = ANGLE_QUARTER - angle;
+    }
+    if (x < 0)
+    {
+        angle = ANGLE_HALF - angle;
+    }
+    if (y < 0)
+    {
+        angle = -angle;
+    }
+
+    // Half a turn wraps to -32768, the same direction
+    return (int16_t)(uint16_t)angle;
+}
+
+uint32_t gy85_isqrt(uint32_t value)
+{
+    if (value == 0)
+    {
+        return 0;
+    }
+
+    // Highest power of four not above value
+    uint32_t root = 0;
+    uint32_t bit = 1u << ((bit_length(value) - 1) & ~1);
+
+    // Branch free, the data dependent branch costs more than the masking
+    while (bit != 0)
+    {
+        uint32_t trial = root + bit;
+        uint32_t take = 0u - (uint32_t)(value >= trial);
+        value -= trial & take;
+        root = (root >> 1) + (bit & take);
+        bit >>= 2;
+    }
+
+    // value is now the remainder, round up past root + 0.5
+    if (value > root)
+    {
+        root++;
+    }
+
+    return root;
+}
+
+/**
+ * Scales the vector by a power of two so the largest component has the
+ * given number of bits, small inputs are scaled up so the square roots
+ * keep their relative precision.
+ */
+static bool normalize(const int32_t in[3], uint8_t bits, int32_t out[3])
+{
+    uint32_t hi = abs_u32(in[0]) | abs_u32(in[1]) | abs_u32(in[2]);
+    if (hi == 0)
+    {
+        return false;
+    }
+
+    int8_t shift = (int8_t)bit_length(hi) - bits;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        if (shift > 0)
+        {
+            out[i] = (int32_t)(((int64_t)in[i] + (1 << (shift - 1))) >> shift);
+        }
+        else
+        {
+            out[i] = in[i] * (1 << -shift);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Square root of a sum of squares of ACCEL_BITS values, to 16 bits.
+ */
+static int32_t root_64(uint64_t value)
+{
+    return (int32_t)gy85_isqrt((uint32_t)((value + (1u << 13)) >> 14)) << 7;
+}
+
+static int16_t atan2_64(int64_t y, int64_t x)
+{
+    // Down to 30 bits for gy85_atan2()
+    uint64_t hi = (uint64_t)(y < 0 ? -y : y) | (uint64_t)(x < 0 ? -x : x);
+    uint8_t bits = hi >> 32 ? 32 + bit_length((uint32_t)(hi >> 32)) : bit_length((uint32_t)hi);
+    uint8_t shift = bits > 30 ? bits - 30 : 0;
+
+    return gy85_atan2((int32_t)(y >> shift), (int32_t)(x >> shift));
+}
+
+int gy85_attitude(const int32_t accel[3], const int32_t mag[3], gy85_attitude_t *attitude)
+{
+    int32_t g[3], m[3];
+    if (!normalize(accel, ACCEL_BITS, g))
+    {
+        return -1;
+    }
+
+    if (!normalize(mag, MAG_BITS, m))
+    {
+        m[0] = m[1] = m[2] = 0;
+    }
+
+    int64_t yz2 = (int64_t)g[1] * g[1] + (int64_t)g[2] * g[2];
+    int64_t norm2 = yz2 + (int64_t)g[0] * g[0];
+
+    // Straight from the input, it keeps its precision close to vertical
+    attitude->roll = gy85_atan2(accel[1], accel[2]);
+    attitude->pitch = gy85_atan2(-g[0], root_64(yz2));
+
+    // x components of east = m x g scaled by |g|, and of north = g x east,
+    // both are |g|^2 |m horizontal| times the sine and cosine of the heading
+    int64_t east = ((int64_t)m[1] * g[2] - (int64_t)m[2] * g[1]) * root_64(norm2);
+    int64_t north = m[0] * yz2 - g[0] * ((int64_t)m[1] * g[1] + (int64_t)m[2] * g[2]);
+    attitude->heading = (uint16_t)atan2_64(east, north);
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include "gy85/bus.hpp"
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+
+static int pico_i2c_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    return i2c_write_blocking(port == 0 ? i2c0 : i2c1, addr, data, len, nostop);
+}
+
+static int pico_i2c_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    return i2c_read_blocking(port == 0 ? i2c0 : i2c1, addr, data, len, nostop);
+}
+
+static const gy85_bus_ops_t pico_bus_ops = {pico_i2c_write, pico_i2c_read, nullptr};
+
+const gy85_bus_ops_t *gy85_default_bus_ops()
+{
+    return &pico_bus_ops;
+}
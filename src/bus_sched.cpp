@@ -0,0 +1,460 @@
+#include "gy85/bus_sched.hpp"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+static uint32_t read_address(const uint8_t *header, uint8_t len)
+{
+    uint32_t address = 0;
+    for (uint8_t i = 0; i < len; i++)
+    {
+        address = address << 8 | header[i];
+    }
+    return address;
+}
+
+static void write_address(uint8_t *header, uint8_t len, uint32_t address)
+{
+    for (uint8_t i = len; i > 0; i--)
+    {
+        header[i - 1] = address & 0xFF;
+        address >>= 8;
+    }
+}
+
+static uint16_t payload_len(const gy85_bus_xfer_t *xfer)
+{
+    return xfer->rx != nullptr ? xfer->rx_len : xfer->tx_len - xfer->header_len;
+}
+
+gy85_bus_sched::gy85_bus_sched(const gy85_bus_ops_t *bus, uint32_t bus_hz)
+{
+    // The physical bus, never the ops of one of our clients
+    this->bus = bus != nullptr ? bus : gy85_default_bus_ops();
+    this->bus_hz = bus_hz;
+    this->policy = BUS_POLICY_PRIORITY;
+    this->chunk_us = GY85_BUS_SCHED_CHUNK_US;
+    this->head = nullptr;
+    this->tail = nullptr;
+}
+
+int gy85_bus_sched::set_policy(gy85_bus_policy_t policy)
+{
+    this->policy = policy;
+    return PICO_OK;
+}
+
+int gy85_bus_sched::set_chunk_us(uint32_t chunk_us)
+{
+    if (chunk_us == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    this->chunk_us = chunk_us;
+    return PICO_OK;
+}
+
+int gy85_bus_sched::attach(gy85_bus_client_t *client, const char *name, gy85_bus_priority_t priority, uint32_t deadline_us)
+{
+    client->name = name;
+    client->priority = priority;
+    client->deadline_us = deadline_us;
+    client->sched = this;
+    client->pending_len = 0;
+    client->pending_addr = 0;
+
+    client->ops.write = client_write;
+    client->ops.read = client_read;
+    client->ops.context = client;
+
+    return reset_stats(client);
+}
+
+int gy85_bus_sched::reset_stats(gy85_bus_client_t *client)
+{
+    memset(&client->stats, 0, sizeof(client->stats));
+    return PICO_OK;
+}
+
+int gy85_bus_sched::submit(gy85_bus_xfer_t *xfer)
+{
+    if (xfer->client == nullptr || xfer->header_len > GY85_BUS_SCHED_MAX_HEADER || xfer->tx_len < xfer->header_len)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    xfer->result = GY85_BUS_PENDING;
+    xfer->next = nullptr;
+    xfer->submit_us = time_us_32();
+    xfer->not_before_us = xfer->submit_us;
+    xfer->progress_us = xfer->submit_us;
+    xfer->done = 0;
+    xfer->started = false;
+
+    uint32_t ints = save_and_disable_interrupts();
+    if (this->tail == nullptr)
+    {
+        this->head = xfer;
+    }
+    else
+    {
+        this->tail->next = xfer;
+    }
+    this->tail = xfer;
+    restore_interrupts(ints);
+
+    return PICO_OK;
+}
+
+int gy85_bus_sched::transfer(gy85_bus_xfer_t *xfer)
+{
+    int res = submit(xfer);
+    if (res != PICO_OK)
+    {
+        return res;
+    }
+
+    // Runs whatever is more urgent first, then ours
+    while (xfer->result == GY85_BUS_PENDING)
+    {
+        if (run() == PICO_ERROR_NO_DATA)
+        {
+            uint32_t wait_us;
+            if (get_next_ready_us(&wait_us) == PICO_OK)
+            {
+                sleep_us(wait_us);
+            }
+        }
+    }
+
+    return xfer->result;
+}
+
+bool gy85_bus_sched::is_idle()
+{
+    return this->head == nullptr;
+}
+
+int gy85_bus_sched::get_next_ready_us(uint32_t *us)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    if (this->head == nullptr)
+    {
+        restore_interrupts(ints);
+        return PICO_ERROR_NO_DATA;
+    }
+
+    uint32_t now = time_us_32();
+    int32_t earliest = INT32_MAX;
+    for (gy85_bus_xfer_t *xfer = this->head; xfer != nullptr; xfer = xfer->next)
+    {
+        int32_t wait = (int32_t)(xfer->not_before_us - now);
+        if (wait < earliest)
+        {
+            earliest = wait;
+        }
+
+        // Nothing overtakes the head
+        if (this->policy == BUS_POLICY_FIFO)
+        {
+            break;
+        }
+    }
+
+    restore_interrupts(ints);
+
+    *us = earliest > 0 ? earliest : 0;
+    return PICO_OK;
+}
+
+gy85_bus_xfer_t *gy85_bus_sched::pick(uint32_t now_us)
+{
+    if (this->policy == BUS_POLICY_FIFO)
+    {
+        if (this->head != nullptr && (int32_t)(now_us - this->head->not_before_us) >= 0)
+        {
+            return this->head;
+        }
+        return nullptr;
+    }
+
+    // Ties keep submission order, the list is in that order
+    gy85_bus_xfer_t *best = nullptr;
+    for (gy85_bus_xfer_t *xfer = this->head; xfer != nullptr; xfer = xfer->next)
+    {
+        if ((int32_t)(now_us - xfer->not_before_us) < 0)
+        {
+            continue;
+        }
+
+        if (best == nullptr || xfer->client->priority > best->client->priority)
+        {
+            best = xfer;
+            continue;
+        }
+        if (xfer->client->priority < best->client->priority || xfer->deadline_us == 0)
+        {
+            continue;
+        }
+        if (best->deadline_us == 0 || (int32_t)(xfer->deadline_us - best->deadline_us) < 0)
+        {
+            best = xfer;
+        }
+    }
+
+    return best;
+}
+
+uint16_t gy85_bus_sched::next_piece(const gy85_bus_xfer_t *xfer)
+{
+    uint16_t remaining = payload_len(xfer) - xfer->done;
+    if (xfer->header_len == 0)
+    {
+        return remaining;
+    }
+
+    // Written pieces of a paged device stay whole pages, each one costs a
+    // write cycle
+    uint32_t piece = remaining;
+    if (this->policy == BUS_POLICY_PRIORITY && (xfer->rx != nullptr || xfer->page == 0))
+    {
+        // Bytes on the bus within the chunk time, 9 clocks each, less the
+        // address byte(s) and the header
+        uint32_t bytes = (uint64_t)this->chunk_us * this->bus_hz / 1000000 / 9;
+        uint32_t overhead = xfer->header_len + (xfer->rx != nullptr ? 2 : 1);
+        uint32_t limit = bytes > overhead ? bytes - overhead : 1;
+        piece = piece < limit ? piece : limit;
+    }
+
+    // Devices need this one whatever the policy
+    if (xfer->page != 0)
+    {
+        uint32_t address = read_address(xfer->tx, xfer->header_len) + xfer->done;
+        uint32_t to_boundary = xfer->page - address % xfer->page;
+        piece = piece < to_boundary ? piece : to_boundary;
+    }
+
+    // Written pieces go through the scratch buffer
+    uint32_t room = GY85_BUS_SCHED_SCRATCH - xfer->header_len;
+    if (xfer->rx == nullptr && piece != payload_len(xfer) && piece > room)
+    {
+        piece = room;
+    }
+
+    return piece;
+}
+
+int gy85_bus_sched::execute(gy85_bus_xfer_t *xfer, uint16_t piece)
+{
+    const gy85_bus_ops_t *bus = this->bus;
+    const uint8_t *tx = xfer->tx;
+    uint16_t tx_len = xfer->tx_len;
+    uint8_t *rx = xfer->rx;
+
+    // A piece other than the whole transfer is re-addressed
+    if (piece != payload_len(xfer))
+    {
+        uint8_t header = xfer->header_len;
+        write_address(this->scratch, header, read_address(xfer->tx, header) + xfer->done);
+
+        tx = this->scratch;
+        tx_len = header;
+        if (rx != nullptr)
+        {
+            rx += xfer->done;
+        }
+        else
+        {
+            memcpy(this->scratch + header, xfer->tx + header + xfer->done, piece);
+            tx_len += piece;
+        }
+    }
+
+    if (rx == nullptr)
+    {
+        int res = bus->write(bus->context, xfer->port, xfer->addr, tx, tx_len, false);
+        if (res < 0)
+        {
+            return res;
+        }
+        return res < tx_len ? PICO_ERROR_IO : PICO_OK;
+    }
+
+    if (tx_len > 0)
+    {
+        int res = bus->write(bus->context, xfer->port, xfer->addr, tx, tx_len, true);
+        if (res < 0)
+        {
+            return res;
+        }
+        if (res < tx_len)
+        {
+            return PICO_ERROR_IO;
+        }
+    }
+
+    int res = bus->read(bus->context, xfer->port, xfer->addr, rx, piece, false);
+    if (res < 0)
+    {
+        return res;
+    }
+    return res < piece ? PICO_ERROR_IO : PICO_OK;
+}
+
+void gy85_bus_sched::complete(gy85_bus_xfer_t *xfer, int result)
+{
+    gy85_bus_xfer_t *previous = nullptr;
+    for (gy85_bus_xfer_t *it = this->head; it != xfer; it = it->next)
+    {
+        previous = it;
+    }
+
+    if (previous == nullptr)
+    {
+        this->head = xfer->next;
+    }
+    else
+    {
+        previous->next = xfer->next;
+    }
+    if (this->tail == xfer)
+    {
+        this->tail = previous;
+    }
+
+    gy85_bus_client_stats_t *stats = &xfer->client->stats;
+    uint32_t now = time_us_32();
+    stats->transfers++;
+    if (result < 0)
+    {
+        stats->errors++;
+    }
+    if (xfer->deadline_us != 0 && (int32_t)(now - xfer->deadline_us) > 0)
+    {
+        stats->deadline_misses++;
+    }
+    gy85_latency_record(&stats->complete, now - xfer->submit_us);
+
+    xfer->result = result;
+}
+
+int gy85_bus_sched::run()
+{
+    // A transfer from an interrupt only gets the bus between two pieces
+    uint32_t ints = save_and_disable_interrupts();
+    int res = run_piece();
+    restore_interrupts(ints);
+
+    return res;
+}
+
+int gy85_bus_sched::run_piece()
+{
+    uint32_t now = time_us_32();
+    gy85_bus_xfer_t *xfer = pick(now);
+    if (xfer == nullptr)
+    {
+        return PICO_ERROR_NO_DATA;
+    }
+
+    gy85_bus_client_stats_t *stats = &xfer->client->stats;
+    if (!xfer->started)
+    {
+        xfer->started = true;
+        stats->wait_us += now - xfer->submit_us;
+        gy85_latency_record(&stats->wait, now - xfer->submit_us);
+    }
+
+    uint16_t piece = next_piece(xfer);
+    int res = execute(xfer, piece);
+    stats->chunks++;
+
+    if (res != PICO_OK)
+    {
+        // A busy device NACKs, the bus is free for others meanwhile
+        if (res == PICO_ERROR_GENERIC && xfer->retry_us != 0 && now - xfer->progress_us < xfer->timeout_us)
+        {
+            xfer->not_before_us = now + xfer->retry_us;
+            stats->retries++;
+            return PICO_OK;
+        }
+
+        complete(xfer, res);
+        return PICO_OK;
+    }
+
+    xfer->done += piece;
+    xfer->progress_us = time_us_32();
+    if (xfer->done >= payload_len(xfer))
+    {
+        complete(xfer, PICO_OK);
+    }
+
+    return PICO_OK;
+}
+
+int gy85_bus_sched::client_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    gy85_bus_client_t *client = (gy85_bus_client_t *)context;
+
+    // Register address of a read, kept so that both go out as one transaction
+    if (nostop)
+    {
+        if (len > GY85_BUS_SCHED_MAX_HEADER)
+        {
+            return PICO_ERROR_INVALID_ARG;
+        }
+        memcpy(client->pending, data, len);
+        client->pending_len = len;
+        client->pending_addr = addr;
+        return len;
+    }
+
+    if (len > UINT16_MAX)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    gy85_bus_xfer_t xfer = {};
+    xfer.client = client;
+    xfer.port = port;
+    xfer.addr = addr;
+    xfer.tx = data;
+    xfer.tx_len = len;
+    // Odd, so that a deadline is never the 0 of none
+    xfer.deadline_us = client->deadline_us != 0 ? (time_us_32() + client->deadline_us) | 1 : 0;
+
+    int res = client->sched->transfer(&xfer);
+    return res == PICO_OK ? (int)len : res;
+}
+
+int gy85_bus_sched::client_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    gy85_bus_client_t *client = (gy85_bus_client_t *)context;
+
+    // Every transfer ends with a stop, another client may take the bus
+    // before the next one, so a read cannot keep it
+    if (nostop || len > UINT16_MAX)
+    {
+        client->pending_len = 0;
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    gy85_bus_xfer_t xfer = {};
+    xfer.client = client;
+    xfer.port = port;
+    xfer.addr = addr;
+    if (client->pending_len > 0 && client->pending_addr == addr)
+    {
+        xfer.tx = client->pending;
+        xfer.tx_len = client->pending_len;
+    }
+    xfer.rx = data;
+    xfer.rx_len = len;
+    xfer.deadline_us = client->deadline_us != 0 ? (time_us_32() + client->deadline_us) | 1 : 0;
+    client->pending_len = 0;
+
+    int res = client->sched->transfer(&xfer);
+    return res == PICO_OK ? (int)len : res;
+}
@@ -0,0 +1,345 @@
+#include "gy85/codec.hpp"
+#include <string.h>
+
+#define RICE_MAX_K (24)
+#define RICE_HALVE_N (32)              ///< Running sums are halved every RICE_HALVE_N residuals
+#define PREDICTOR_DECAY_SHIFT (4)
+#define MAX_RECORD_BITS (GY85_CODEC_CHANNELS * (GY85_CODEC_ESCAPE + 32))
+
+static inline void record_to_channels(const gy85_raw_record_t &record, uint32_t values[GY85_CODEC_CHANNELS])
+{
+    values[0] = record.timestamp_us;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        values[1 + i] = (uint32_t)(int32_t)record.accel[i];
+        values[4 + i] = (uint32_t)(int32_t)record.gyro[i];
+        values[7 + i] = (uint32_t)(int32_t)record.mag[i];
+    }
+}
+
+static inline void channels_to_record(const uint32_t values[GY85_CODEC_CHANNELS], gy85_raw_record_t *record)
+{
+    record->timestamp_us = values[0];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        record->accel[i] = (int16_t)values[1 + i];
+        record->gyro[i] = (int16_t)values[4 + i];
+        record->mag[i] = (int16_t)values[7 + i];
+    }
+}
+
+static void channels_reset(gy85_codec_channel_t channels[GY85_CODEC_CHANNELS], const uint32_t values[GY85_CODEC_CHANNELS])
+{
+    for (uint8_t i = 0; i < GY85_CODEC_CHANNELS; i++)
+    {
+        channels[i].x1 = values[i];
+        channels[i].x2 = values[i];
+        channels[i].sum = 2;
+        channels[i].n = 1;
+        // Delta until the linear predictor has a real history
+        channels[i].cost1 = 0;
+        channels[i].cost2 = 1;
+    }
+}
+
+static inline uint32_t predict(const gy85_codec_channel_t *channel)
+{
+    // Modulo 2^32, so the timestamp wraps cleanly
+    return channel->cost2 < channel->cost1 ? 2 * channel->x1 - channel->x2 : channel->x1;
+}
+
+static inline uint8_t rice_parameter(const gy85_codec_channel_t *channel)
+{
+    uint8_t k = 0;
+    while (k < RICE_MAX_K && (channel->n << k) < channel->sum)
+    {
+        k++;
+    }
+    return k;
+}
+
+static inline void channel_update(gy85_codec_channel_t *channel, uint32_t value, uint32_t mapped)
+{
+    int32_t e1 = (int32_t)(value - channel->x1);
+    int32_t e2 = (int32_t)(value - (2 * channel->x1 - channel->x2));
+
+    channel->cost1 += (uint32_t)(e1 < 0 ? -e1 : e1) - (channel->cost1 >> PREDICTOR_DECAY_SHIFT);
+    channel->cost2 += (uint32_t)(e2 < 0 ? -e2 : e2) - (channel->cost2 >> PREDICTOR_DECAY_SHIFT);
+
+    channel->sum += mapped;
+    if (++channel->n == RICE_HALVE_N)
+    {
+        channel->sum >>= 1;
+        channel->n >>= 1;
+    }
+
+    channel->x2 = channel->x1;
+    channel->x1 = value;
+}
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+gy85_encoder::gy85_encoder()
+{
+    this->block = nullptr;
+    this->size = 0;
+    this->count = 0;
+}
+
+void gy85_encoder::put_bits(uint32_t value, uint8_t count)
+{
+    if (this->overflow)
+    {
+        return;
+    }
+
+    this->bits = (this->bits << count) | (count < 32 ? value & ((1u << count) - 1) : value);
+    this->nbits += count;
+
+    while (this->nbits >= 8)
+    {
+        if (this->pos >= this->size)
+        {
+            this->overflow = true;
+            return;
+        }
+
+        this->nbits -= 8;
+        this->block[this->pos++] = (uint8_t)(this->bits >> this->nbits);
+    }
+}
+
+void gy85_encoder::start(uint8_t *block, uint16_t size)
+{
+    // Blocks larger than the default would overrun GY85_CODEC_MAX_RECORDS on decode
+    this->block = block;
+    this->size = size < GY85_CODEC_BLOCK_SIZE ? size : GY85_CODEC_BLOCK_SIZE;
+    this->count = 0;
+    this->pos = GY85_CODEC_HEADER_SIZE;
+    this->bits = 0;
+    this->nbits = 0;
+    this->overflow = false;
+}
+
+/**
+ * Returns false when the record does not fit, the block is left as it was
+ * so it can be finished and the record added to the next one.
+ */
+bool gy85_encoder::add(const gy85_raw_record_t &record)
+{
+    uint32_t values[GY85_CODEC_CHANNELS];
+    record_to_channels(record, values);
+
+    if (this->count == 0)
+    {
+        gy85_codec_header_t header;
+        memset(&header, 0, sizeof(header));
+        header.first = record;
+        memcpy(this->block, &header, sizeof(header));
+
+        channels_reset(this->channels, values);
+        this->count = 1;
+        return true;
+    }
+
+    if (this->count == UINT16_MAX)
+    {
+        return false;
+    }
+
+    // Rolling back is only needed close to the end of the block
+    gy85_codec_channel_t saved_channels[GY85_CODEC_CHANNELS];
+    uint16_t saved_pos = this->pos;
+    uint64_t saved_bits = this->bits;
+    uint8_t saved_nbits = this->nbits;
+    bool near_end = (this->size - this->pos) * 8 < MAX_RECORD_BITS;
+    if (near_end)
+    {
+        memcpy(saved_channels, this->channels, sizeof(saved_channels));
+    }
+
+    for (uint8_t i = 0; i < GY85_CODEC_CHANNELS; i++)
+    {
+        gy85_codec_channel_t *channel = &this->channels[i];
+        uint32_t mapped = zigzag((int32_t)(values[i] - predict(channel)));
+        uint8_t k = rice_parameter(channel);
+        uint32_t quotient = mapped >> k;
+
+        if (quotient < GY85_CODEC_ESCAPE)
+        {
+            // quotient ones, a zero, then the k low bits
+            put_bits(((1u << quotient) - 1) << 1, quotient + 1);
+            if (k > 0)
+            {
+                put_bits(mapped, k);
+            }
+        }
+        else
+        {
+            put_bits((1u << GY85_CODEC_ESCAPE) - 1, GY85_CODEC_ESCAPE);
+            put_bits(mapped, 32);
+        }
+
+        channel_update(channel, values[i], mapped);
+    }
+
+    // The last partial byte has to fit as well
+    if (this->overflow || (this->nbits > 0 && this->pos >= this->size))
+    {
+        if (near_end)
+        {
+            memcpy(this->channels, saved_channels, sizeof(saved_channels));
+        }
+        this->pos = saved_pos;
+        this->bits = saved_bits;
+        this->nbits = saved_nbits;
+        this->overflow = false;
+        return false;
+    }
+
+    this->count++;
+    return true;
+}
+
+/**
+ * Flushes the pending bits and writes the header.
+ * Returns the bytes used, the rest of the block is zeroed.
+ */
+uint16_t gy85_encoder::finish()
+{
+    if (this->count == 0)
+    {
+        return 0;
+    }
+
+    if (this->nbits > 0)
+    {
+        this->block[this->pos++] = (uint8_t)(this->bits << (8 - this->nbits));
+        this->nbits = 0;
+    }
+
+    // The block buffer may not be aligned for the header
+    gy85_codec_header_t header;
+    memcpy(&header, this->block, sizeof(header));
+    header.version = GY85_CODEC_VERSION;
+    header.count = this->count;
+    header.bytes = this->pos - GY85_CODEC_HEADER_SIZE;
+    memcpy(this->block, &header, sizeof(header));
+
+    memset(this->block + this->pos, 0, this->size - this->pos);
+
+    return this->pos;
+}
+
+uint16_t gy85_encoder::get_count()
+{
+    return this->count;
+}
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t len;
+    uint32_t pos;
+    uint64_t bits;
+    uint8_t nbits;
+} bit_reader_t;
+
+static inline bool get_bits(bit_reader_t *reader, uint8_t count, uint32_t *value)
+{
+    while (reader->nbits < count)
+    {
+        if (reader->pos >= reader->len)
+        {
+            return false;
+        }
+        reader->bits = (reader->bits << 8) | reader->data[reader->pos++];
+        reader->nbits += 8;
+    }
+
+    reader->nbits -= count;
+    *value = (uint32_t)(reader->bits >> reader->nbits) & (count < 32 ? (1u << count) - 1 : 0xFFFFFFFFu);
+
+    return true;
+}
+
+/**
+ * Decodes one block.
+ * Returns the number of records, or -1 if the block is malformed or holds
+ * more than max_records.
+ */
+int gy85_codec_decode(const uint8_t *block, size_t len, gy85_raw_record_t *records, uint16_t max_records)
+{
+    gy85_codec_header_t header;
+    if (len < sizeof(header))
+    {
+        return -1;
+    }
+    memcpy(&header, block, sizeof(header));
+
+    if (header.version != GY85_CODEC_VERSION || header.count == 0 || header.count > max_records ||
+        sizeof(header) + header.bytes > len)
+    {
+        return -1;
+    }
+
+    bit_reader_t reader = {block + sizeof(header), header.bytes, 0, 0, 0};
+
+    uint32_t values[GY85_CODEC_CHANNELS];
+    gy85_codec_channel_t channels[GY85_CODEC_CHANNELS];
+    record_to_channels(header.first, values);
+    channels_reset(channels, values);
+    records[0] = header.first;
+
+    for (uint16_t n = 1; n < header.count; n++)
+    {
+        for (uint8_t i = 0; i < GY85_CODEC_CHANNELS; i++)
+        {
+            gy85_codec_channel_t *channel = &channels[i];
+            uint8_t k = rice_parameter(channel);
+
+            uint32_t quotient = 0;
+            uint32_t bit;
+            do
+            {
+                if (!get_bits(&reader, 1, &bit))
+                {
+                    return -1;
+                }
+            } while (bit && ++quotient < GY85_CODEC_ESCAPE);
+
+            uint32_t mapped;
+            if (quotient == GY85_CODEC_ESCAPE)
+            {
+                if (!get_bits(&reader, 32, &mapped))
+                {
+                    return -1;
+                }
+            }
+            else
+            {
+                uint32_t low = 0;
+                if (k > 0 && !get_bits(&reader, k, &low))
+                {
+                    return -1;
+                }
+                mapped = (quotient << k) | low;
+            }
+
+            values[i] = predict(channel) + (uint32_t)unzigzag(mapped);
+            channel_update(channel, values[i], mapped);
+        }
+
+        channels_to_record(values, &records[n]);
+    }
+
+    return header.count;
+}
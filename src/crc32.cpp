@@ -0,0 +1,16 @@
+#include "gy85/storage.hpp"
+
+uint32_t gy85_crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+    // CRC-32 (IEEE 802.3), bitwise to stay table free
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,350 @@
+#include "gy85/filter.hpp"
+#include <math.h>
+#include "pico/stdlib.h"
+
+static inline int32_t round_shift(int64_t value, uint8_t shift)
+{
+    return (int32_t)((value + ((int64_t)1 << (shift - 1))) >> shift);
+}
+
+static inline int16_t saturate_int16(int32_t value)
+{
+    if (value > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN)
+    {
+        return INT16_MIN;
+    }
+    return (int16_t)value;
+}
+
+/**
+ * Biquad Low Pass
+ */
+
+biquad_lpf::biquad_lpf()
+{
+    // Pass-through until configured
+    this->b0 = (int32_t)1 << GY85_FILTER_COEF_Q;
+    this->b1 = 0;
+    this->b2 = 0;
+    this->a1 = 0;
+    this->a2 = 0;
+
+    this->reset();
+}
+
+int biquad_lpf::configure(float cutoff_hz, float sample_rate_hz, float q)
+{
+    if (sample_rate_hz <= 0 || cutoff_hz <= 0 || cutoff_hz >= sample_rate_hz / 2 || q <= 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Designed in double, 1 - cos(w0) cancels badly in float at low cutoffs
+    double w0 = 2.0 * M_PI * cutoff_hz / sample_rate_hz;
+    double alpha = sin(w0) / (2.0 * q);
+    double scale = (double)((int32_t)1 << GY85_FILTER_COEF_Q) / (1.0 + alpha);
+
+    this->a1 = lround(-2.0 * cos(w0) * scale);
+    this->a2 = lround((1.0 - alpha) * scale);
+
+    // Numerator taken from the quantised denominator for exact unity DC gain
+    int32_t b_sum = ((int32_t)1 << GY85_FILTER_COEF_Q) + this->a1 + this->a2;
+    this->b0 = b_sum / 4;
+    this->b1 = b_sum - 2 * this->b0;
+    this->b2 = this->b0;
+
+    this->reset();
+
+    return PICO_OK;
+}
+
+bool biquad_lpf::process(int32_t in, int32_t *out)
+{
+    // Feed-forward terms are on plain counts, feedback terms on the
+    // extended precision state, both end up in Q(COEF_Q + STATE_SHIFT)
+    int64_t acc = ((int64_t)this->b0 * in + (int64_t)this->b1 * this->x1 + (int64_t)this->b2 * this->x2)
+                  << GY85_FILTER_STATE_SHIFT;
+    acc -= (int64_t)this->a1 * this->y1 + (int64_t)this->a2 * this->y2;
+
+    // Error feedback, the truncation residue is carried into the next sample,
+    // otherwise it is amplified by the poles into a DC offset at low cutoffs
+    acc += this->err;
+    int32_t y = (int32_t)(acc >> GY85_FILTER_COEF_Q);
+    this->err = (int32_t)(acc - ((int64_t)y << GY85_FILTER_COEF_Q));
+
+    this->x2 = this->x1;
+    this->x1 = in;
+    this->y2 = this->y1;
+    this->y1 = y;
+
+    *out = round_shift(y, GY85_FILTER_STATE_SHIFT);
+
+    return true;
+}
+
+void biquad_lpf::reset()
+{
+    this->x1 = 0;
+    this->x2 = 0;
+    this->y1 = 0;
+    this->y2 = 0;
+    this->err = 0;
+}
+
+/**
+ * CIC Decimator
+ */
+
+cic_decimator::cic_decimator()
+{
+    this->order = 1;
+    this->decimation = 1;
+    this->gain_norm = (int32_t)1 << 30;
+
+    this->reset();
+}
+
+int cic_decimator::configure(uint8_t order, uint8_t decimation)
+{
+    if (order == 0 || order > GY85_CIC_MAX_ORDER || decimation == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Register growth must fit in the 32 bit integrators
+    uint32_t gain = 1;
+    for (uint8_t i = 0; i < order; i++)
+    {
+        gain *= decimation;
+        if (gain > 1 << 16)
+        {
+            return PICO_ERROR_INVALID_ARG;
+        }
+    }
+
+    this->order = order;
+    this->decimation = decimation;
+    this->gain_norm = (int32_t)((((int64_t)1 << 30) + gain / 2) / gain);
+
+    this->reset();
+
+    return PICO_OK;
+}
+
+bool cic_decimator::process(int32_t in, int32_t *out)
+{
+    // Modular arithmetic, wraps are cancelled by the combs
+    uint32_t value = (uint32_t)in;
+    for (uint8_t i = 0; i < this->order; i++)
+    {
+        this->integrators[i] = (int32_t)((uint32_t)this->integrators[i] + value);
+        value = (uint32_t)this->integrators[i];
+    }
+
+    if (++this->phase < this->decimation)
+    {
+        return false;
+    }
+    this->phase = 0;
+
+    for (uint8_t i = 0; i < this->order; i++)
+    {
+        uint32_t delayed = (uint32_t)this->combs[i];
+        this->combs[i] = (int32_t)value;
+        value -= delayed;
+    }
+
+    *out = round_shift((int64_t)(int32_t)value * this->gain_norm, 30);
+
+    return true;
+}
+
+void cic_decimator::reset()
+{
+    this->phase = 0;
+    for (uint8_t i = 0; i < GY85_CIC_MAX_ORDER; i++)
+    {
+        this->integrators[i] = 0;
+        this->combs[i] = 0;
+    }
+}
+
+/**
+ * FIR Decimator
+ */
+
+fir_decimator::fir_decimator()
+{
+    // Pass-through until configured
+    this->taps = 1;
+    this->decimation = 1;
+    this->coeffs[0] = INT16_MAX;
+
+    this->reset();
+}
+
+int fir_decimator::configure(const int16_t *coeffs, uint8_t taps, uint8_t decimation)
+{
+    if (coeffs == nullptr || taps == 0 || taps > GY85_FIR_MAX_TAPS || decimation == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    int32_t abs_sum = 0;
+    for (uint8_t i = 0; i < taps; i++)
+    {
+        abs_sum += coeffs[i] < 0 ? -coeffs[i] : coeffs[i];
+    }
+
+    if (abs_sum >= 2 << GY85_FIR_COEF_Q)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    for (uint8_t i = 0; i < taps; i++)
+    {
+        this->coeffs[i] = coeffs[i];
+    }
+    this->taps = taps;
+    this->decimation = decimation;
+
+    this->reset();
+
+    return PICO_OK;
+}
+
+int fir_decimator::design_lowpass(uint8_t taps, uint8_t decimation)
+{
+    if (taps == 0 || taps > GY85_FIR_MAX_TAPS || decimation == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Hamming windowed sinc, cutoff at 80% of the output Nyquist
+    float cutoff = 0.4f / decimation;
+    float center = (taps - 1) / 2.0f;
+    float h[GY85_FIR_MAX_TAPS];
+    float sum = 0;
+
+    for (uint8_t i = 0; i < taps; i++)
+    {
+        float t = i - center;
+        float sinc = t == 0 ? 2.0f * cutoff : sinf(2.0f * (float)M_PI * cutoff * t) / ((float)M_PI * t);
+        float window = taps > 1 ? 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (taps - 1)) : 1.0f;
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+
+    // Quantise with unity DC gain, the rounding residue goes to the center tap
+    int16_t coeffs[GY85_FIR_MAX_TAPS];
+    int32_t quantised_sum = 0;
+    for (uint8_t i = 0; i < taps; i++)
+    {
+        coeffs[i] = saturate_int16(lroundf(h[i] / sum * (1 << GY85_FIR_COEF_Q)));
+        quantised_sum += coeffs[i];
+    }
+    coeffs[taps / 2] = saturate_int16(coeffs[taps / 2] + (1 << GY85_FIR_COEF_Q) - quantised_sum);
+
+    return this->configure(coeffs, taps, decimation);
+}
+
+bool fir_decimator::process(int32_t in, int32_t *out)
+{
+    this->head = this->head == 0 ? this->taps - 1 : this->head - 1;
+
+    int16_t sample = saturate_int16(in);
+    this->delay[this->head] = sample;
+    this->delay[this->head + this->taps] = sample;
+
+    if (++this->phase < this->decimation)
+    {
+        return false;
+    }
+    this->phase = 0;
+
+    const int16_t *window = &this->delay[this->head];
+    int32_t acc = 0;
+    for (uint8_t i = 0; i < this->taps; i++)
+    {
+        acc += (int32_t)this->coeffs[i] * window[i];
+    }
+
+    *out = round_shift(acc, GY85_FIR_COEF_Q);
+
+    return true;
+}
+
+void fir_decimator::reset()
+{
+    this->phase = 0;
+    this->head = 0;
+    for (uint8_t i = 0; i < 2 * GY85_FIR_MAX_TAPS; i++)
+    {
+        this->delay[i] = 0;
+    }
+}
+
+/**
+ * Vec3 Filter
+ */
+
+vec3_filter::vec3_filter()
+{
+    this->count = 0;
+}
+
+int vec3_filter::add_stage(axis_filter *x, axis_filter *y, axis_filter *z)
+{
+    if (x == nullptr || y == nullptr || z == nullptr)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    if (this->count >= GY85_FILTER_MAX_STAGES)
+    {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    this->stages[0][this->count] = x;
+    this->stages[1][this->count] = y;
+    this->stages[2][this->count] = z;
+    this->count++;
+
+    return PICO_OK;
+}
+
+bool vec3_filter::process(const int16_t in[3], int32_t out[3])
+{
+    bool ready = true;
+
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        int32_t value = in[axis];
+        for (uint8_t i = 0; i < this->count; i++)
+        {
+            if (!this->stages[axis][i]->process(value, &value))
+            {
+                ready = false;
+                break;
+            }
+        }
+        out[axis] = value;
+    }
+
+    return ready;
+}
+
+void vec3_filter::reset()
+{
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        for (uint8_t i = 0; i < this->count; i++)
+        {
+            this->stages[axis][i]->reset();
+        }
+    }
+}
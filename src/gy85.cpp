@@ -1,39 +1,146 @@
 #include "gy85/gy85.hpp"
+#include "gy85/trace.hpp"
+#include "gy85/bus.hpp"
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <math.h>
 #include "pico/stdlib.h"
-#include "hardware/i2c.h"
 
 #define DEG_TO_RAD (M_PI / 180.0)
+#define GY85_MAX_BURST_WRITE (8)
 
-int8_t write_register(uint8_t port, uint8_t addr, uint8_t reg, uint8_t value)
+static const gy85_bus_ops_t *bus_ops = nullptr;
+
+void gy85_set_bus_ops(const gy85_bus_ops_t *ops)
 {
-    uint8_t buff[] = {reg, value};
+    bus_ops = ops;
+}
 
+const gy85_bus_ops_t *gy85_get_bus_ops()
+{
+    if (bus_ops == nullptr)
+    {
+        bus_ops = gy85_default_bus_ops();
+    }
+    return bus_ops;
+}
+
+static int8_t i2c_write(uint8_t port, uint8_t addr, const uint8_t *buff, uint8_t len)
+{
+    const gy85_bus_ops_t *ops = gy85_get_bus_ops();
     int write;
-    write = i2c_write_blocking(port == 0 ? i2c0 : i2c1, addr, buff, 2, false);
+    write = ops->write(ops->context, port, addr, buff, len, false);
 
-    if (write == PICO_ERROR_GENERIC)
+    // Bus errors are passed through, a short transfer is PICO_ERROR_IO
+    if (write < 0)
     {
-        return PICO_ERROR_GENERIC;
+        return write;
+    }
+    if (write < len)
+    {
+        return PICO_ERROR_IO;
     }
     return PICO_OK;
 }
 
-int8_t read_registers(uint8_t port, uint8_t addr, uint8_t reg, uint8_t count, uint8_t *buffer)
+static int8_t i2c_read(uint8_t port, uint8_t addr, uint8_t reg, uint8_t count, uint8_t *buffer)
 {
-    int read;
-    i2c_write_blocking(port == 0 ? i2c0 : i2c1, addr, &reg, 1, true);
-    read = i2c_read_blocking(port == 0 ? i2c0 : i2c1, addr, buffer, count, false);
+    const gy85_bus_ops_t *ops = gy85_get_bus_ops();
+    int write, read;
+    write = ops->write(ops->context, port, addr, &reg, 1, true);
+    if (write < 0)
+    {
+        return write;
+    }
+
+    read = ops->read(ops->context, port, addr, buffer, count, false);
+    if (read < 0)
+    {
+        return read;
+    }
     if (read < count)
     {
-        return PICO_ERROR_GENERIC;
+        return PICO_ERROR_IO;
     }
     return PICO_OK;
 }
 
+int8_t write_register(uint8_t port, uint8_t addr, uint8_t reg, uint8_t value)
+{
+    uint8_t buff[] = {reg, value};
+
+    uint32_t start = time_us_32();
+    int8_t res = i2c_write(port, addr, buff, 2);
+    gy85_trace_record(addr, reg, 1, GY85_TRACE_WRITE, res, start);
+
+    return res;
+}
+
+int8_t write_registers(uint8_t port, uint8_t addr, uint8_t reg, const uint8_t *values, uint8_t count)
+{
+    // Burst write to consecutive registers, the chip auto-increments the address
+    uint8_t buff[GY85_MAX_BURST_WRITE + 1];
+
+    if (count > GY85_MAX_BURST_WRITE)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    buff[0] = reg;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        buff[i + 1] = values[i];
+    }
+
+    uint32_t start = time_us_32();
+    int8_t res = i2c_write(port, addr, buff, count + 1);
+    gy85_trace_record(addr, reg, count, GY85_TRACE_WRITE, res, start);
+
+    return res;
+}
+
+int8_t read_registers(uint8_t port, uint8_t addr, uint8_t reg, uint8_t count, uint8_t *buffer)
+{
+    uint32_t start = time_us_32();
+    int8_t res = i2c_read(port, addr, reg, count, buffer);
+    gy85_trace_record(addr, reg, count, 0, res, start);
+
+    return res;
+}
+
+static void update_axis_scale(const gy85_orientation_t *orientation, double unit, double scale[3])
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        scale[i] = orientation->aligned ? orientation->sign[i] * unit : unit;
+    }
+}
+
+static void convert_counts(const gy85_orientation_t *orientation, const double scale[3], const int32_t counts[3], vec3f_t *out)
+{
+    // Axis aligned: permutation and sign cost the same as the plain conversion
+    if (orientation->aligned)
+    {
+        out->x = counts[orientation->axis[0]] * scale[0];
+        out->y = counts[orientation->axis[1]] * scale[1];
+        out->z = counts[orientation->axis[2]] * scale[2];
+        return;
+    }
+
+    double x = counts[0] * scale[0];
+    double y = counts[1] * scale[1];
+    double z = counts[2] * scale[2];
+
+    out->x = orientation->matrix[0][0] * x + orientation->matrix[0][1] * y + orientation->matrix[0][2] * z;
+    out->y = orientation->matrix[1][0] * x + orientation->matrix[1][1] * y + orientation->matrix[1][2] * z;
+    out->z = orientation->matrix[2][0] * x + orientation->matrix[2][1] * y + orientation->matrix[2][2] * z;
+}
+
 gy85::gy85(uint8_t i2c_port, uint8_t adxl345_addr, uint8_t itg3205_addr, uint8_t qmc5883l_addr)
 {
+    gy85_trace_init();
+
     this->i2c_port = i2c_port;
     this->adxl345_addr = adxl345_addr;
     this->itg3205_addr = itg3205_addr;
@@ -60,12 +167,79 @@ gy85::gy85(uint8_t i2c_port, uint8_t adxl345_addr, uint8_t itg3205_addr, uint8_t
     this->mag.x = 0;
     this->mag.y = 0;
     this->mag.z = 0;
+    this->new_samples = 0;
+
+    this->adxl345_filter = nullptr;
+    this->itg3205_filter = nullptr;
+    this->qmc5883l_filter = nullptr;
+
+    this->adxl345_orientation = GY85_ORIENTATION_IDENTITY;
+    this->itg3205_orientation = GY85_ORIENTATION_IDENTITY;
+    this->qmc5883l_orientation = GY85_ORIENTATION_IDENTITY;
+    update_axis_scale(&this->adxl345_orientation, this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH, this->adxl345_axis_scale);
+    update_axis_scale(&this->itg3205_orientation, DEG_TO_RAD / ITG3205_DIGIT_TO_DEG, this->itg3205_axis_scale);
+    update_axis_scale(&this->qmc5883l_orientation, 1.0, this->qmc5883l_axis_scale);
+
+    this->init_start_us = 0;
+    this->first_sample_us = 0;
+
+#if GY85_STATS
+    gy85_stats_reset(&this->stats);
+#endif
     
     this->sleep_fn = sleep_ms;
 }
 
+int gy85::bus_read(uint8_t addr, uint8_t reg, uint8_t count, uint8_t *buffer)
+{
+    int res = read_registers(this->i2c_port, addr, reg, count, buffer);
+
+#if GY85_STATS
+    gy85_sensor_t sensor = addr == this->adxl345_addr ? SENSOR_ADXL345 : addr == this->itg3205_addr ? SENSOR_ITG3205 : SENSOR_QMC5883L;
+    gy85_stats_record_transfer(&this->stats, sensor, count, 1, res);
+#endif
+
+    return res;
+}
+
+int gy85::bus_write(uint8_t addr, uint8_t reg, uint8_t value)
+{
+    return bus_write(addr, reg, &value, 1);
+}
+
+int gy85::bus_write(uint8_t addr, uint8_t reg, const uint8_t *values, uint8_t count)
+{
+    int res = count == 1 ? write_register(this->i2c_port, addr, reg, values[0]) : write_registers(this->i2c_port, addr, reg, values, count);
+
+#if GY85_STATS
+    gy85_sensor_t sensor = addr == this->adxl345_addr ? SENSOR_ADXL345 : addr == this->itg3205_addr ? SENSOR_ITG3205 : SENSOR_QMC5883L;
+    gy85_stats_record_transfer(&this->stats, sensor, 0, count + 1, res);
+#endif
+
+    return res;
+}
+
+#if GY85_STATS
+int gy85::get_stats(gy85_stats_t *snapshot)
+{
+    // Not atomic, take the snapshot from the context that reads the sensors
+    *snapshot = this->stats;
+    return PICO_OK;
+}
+
+int gy85::reset_stats()
+{
+    gy85_stats_reset(&this->stats);
+    return PICO_OK;
+}
+#endif
+
 int gy85::init()
 {
+    this->init_start_us = time_us_64();
+    this->first_sample_us = 0;
+
+    // Configure all the sensors first so their start-up times overlap
     if (init_adxl345() != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
@@ -81,29 +255,163 @@ int gy85::init()
         return PICO_ERROR_GENERIC;
     }
 
+    if (wait_first_sample(GY85_INIT_TIMEOUT_MS) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
     return PICO_OK;
 }
 
-int gy85::read()
+int gy85::wait_first_sample(uint32_t timeout_ms)
 {
-    if (read_adxl345(&this->accel) != PICO_OK)
+    bool adxl345_ready = false;
+    bool itg3205_ready = false;
+    bool qmc5883l_ready = false;
+
+    // Only the sensors that are not ready yet are polled, the timeout is on
+    // elapsed time as every poll also takes bus time
+    uint64_t start_us = time_us_64();
+    while (true)
+    {
+        if (!adxl345_ready && get_adxl345_data_ready(&adxl345_ready) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        if (!itg3205_ready && get_itg3205_data_ready(&itg3205_ready) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        if (!qmc5883l_ready && get_qmc5883l_data_ready(&qmc5883l_ready) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        if (adxl345_ready && itg3205_ready && qmc5883l_ready)
+        {
+            this->first_sample_us = time_us_64();
+            return PICO_OK;
+        }
+
+        if (time_us_64() - start_us > (uint64_t)timeout_ms * 1000)
+        {
+            return PICO_ERROR_TIMEOUT;
+        }
+
+        this->sleep_fn(GY85_INIT_POLL_MS);
+    }
+}
+
+int gy85::get_odr_period_us(uint32_t *period_us)
+{
+    // Period of the fastest configured output data rate
+    uint8_t reg;
+    uint32_t period;
+
+    // ADXL345: 3200Hz >> (15 - rate code)
+    adxl345_data_rate_t data_rate;
+    if (get_adxl345_data_rate(&data_rate) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
+    *period_us = (3125u << (15 - data_rate)) / 10;
 
-    if (read_itg3205(&this->gyro) != PICO_OK)
+    // ITG3205: 8kHz internal rate without DLPF, 1kHz otherwise, divided by SMPLRT_DIV + 1
+    uint8_t dlpf_fs;
+    if (get_itg3205_dlpf_fs(&dlpf_fs) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+    if (get_itg3205_sample_rate_div(&reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
+    period = (reg + 1) * ((dlpf_fs & 0x07) == 0 ? 125 : 1000);
+    if (period < *period_us)
+    {
+        *period_us = period;
+    }
 
-    if (read_qmc5883l(&this->mag) != PICO_OK)
+    // QMC5883L: only in continuous mode
+    if (get_qmc5883l_ctrl(&reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
+    if ((reg & 0x03) == qmc5883l_mode_t::CONTINUOUS)
+    {
+        static const uint32_t qmc5883l_periods[] = {100000, 20000, 10000, 5000};
+        period = qmc5883l_periods[(reg >> 2) & 0x03];
+        if (period < *period_us)
+        {
+            *period_us = period;
+        }
+    }
 
     return PICO_OK;
 }
 
+uint64_t gy85::get_boot_to_first_sample_us()
+{
+    // The timer starts counting at boot
+    return this->first_sample_us;
+}
+
+uint64_t gy85::get_init_to_first_sample_us()
+{
+    if (this->first_sample_us == 0)
+    {
+        return 0;
+    }
+
+    return this->first_sample_us - this->init_start_us;
+}
+
+/**
+ * Reads the three sensors into get_accel(), get_gyro() and get_mag().
+ * Returns PICO_ERROR_NO_DATA when decimating filters absorbed every sample.
+ */
+int gy85::read()
+{
+    GY85_STATS_OP(OP_READ);
+
+    // PICO_ERROR_NO_DATA means the sample was absorbed by a decimating
+    // filter, the previous value is kept and not reported as new
+    this->new_samples = 0;
+    int res = read_adxl345(&this->accel);
+    if (res == PICO_OK)
+    {
+        this->new_samples |= GY85_SAMPLE_ACCEL;
+    }
+    else if (res != PICO_ERROR_NO_DATA)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    res = read_itg3205(&this->gyro);
+    if (res == PICO_OK)
+    {
+        this->new_samples |= GY85_SAMPLE_GYRO;
+    }
+    else if (res != PICO_ERROR_NO_DATA)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    res = read_qmc5883l(&this->mag);
+    if (res == PICO_OK)
+    {
+        this->new_samples |= GY85_SAMPLE_MAG;
+    }
+    else if (res != PICO_ERROR_NO_DATA)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return this->new_samples != 0 ? PICO_OK : PICO_ERROR_NO_DATA;
+}
+
 int gy85::set_sleep_fn(void (*sleep_fn)(uint32_t))
 {
     this->sleep_fn = sleep_fn;
@@ -125,6 +433,258 @@ int gy85::calibrate(uint16_t samples)
     return PICO_OK;
 }
 
+static bool calib_record_valid(const gy85_calib_record_t *record)
+{
+    return record->magic == GY85_CALIB_MAGIC &&
+           record->version == GY85_CALIB_VERSION &&
+           record->length == sizeof(gy85_calib_record_t) &&
+           record->crc == gy85_crc32((const uint8_t *)record, offsetof(gy85_calib_record_t, crc));
+}
+
+static bool calib_slot_blank(const gy85_calib_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    for (size_t i = 0; i < sizeof(gy85_calib_record_t); i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int find_calib_record(gy85_storage *storage, gy85_calib_record_t *latest, uint32_t *latest_slot)
+{
+    uint32_t slot_size = storage->page_size();
+    uint32_t slots = storage->size() / slot_size;
+    bool found = false;
+    gy85_calib_record_t record;
+
+    if (slot_size < sizeof(gy85_calib_record_t) || slot_size > GY85_FLASH_PAGE_SIZE || slots == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Entering a sector erases it, the latest record must be in another one
+    if (storage->size() / storage->sector_size() < 2)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    for (uint32_t i = 0; i < slots; i++)
+    {
+        if (storage->read(i * slot_size, (uint8_t *)&record, sizeof(record)) != PICO_OK)
+        {
+            return PICO_ERROR_IO;
+        }
+
+        if (!calib_record_valid(&record))
+        {
+            continue;
+        }
+
+        if (!found || (int32_t)(record.sequence - latest->sequence) > 0)
+        {
+            *latest = record;
+            *latest_slot = i;
+            found = true;
+        }
+    }
+
+    return found ? PICO_OK : PICO_ERROR_NO_DATA;
+}
+
+int gy85::init(gy85_storage *storage, uint16_t samples)
+{
+    if (init() != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    // Skip the calibration when a valid record exists
+    int res = load_calibration(storage);
+    if (res == PICO_OK)
+    {
+        return PICO_OK;
+    }
+
+    if (res != PICO_ERROR_NO_DATA)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (calibrate(samples) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (save_calibration(storage) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return PICO_OK;
+}
+
+int gy85::save_calibration(gy85_storage *storage)
+{
+    gy85_calib_record_t record;
+    uint32_t slot = 0;
+    uint32_t sequence = 0;
+
+    int res = find_calib_record(storage, &record, &slot);
+    if (res == PICO_OK)
+    {
+        sequence = record.sequence + 1;
+        slot++;
+    }
+    else if (res != PICO_ERROR_NO_DATA)
+    {
+        return res;
+    }
+
+    // Look for the next writable slot, a sector is erased when the write
+    // pointer enters it so the latest record in the previous sector survives
+    uint32_t slot_size = storage->page_size();
+    uint32_t slots = storage->size() / slot_size;
+    uint32_t n;
+    for (n = 0; n < slots; n++, slot++)
+    {
+        slot %= slots;
+        uint32_t offset = slot * slot_size;
+
+        if (offset % storage->sector_size() == 0)
+        {
+            if (storage->erase(offset) != PICO_OK)
+            {
+                return PICO_ERROR_IO;
+            }
+            break;
+        }
+
+        // Skip slots left dirty by a torn write
+        if (storage->read(offset, (uint8_t *)&record, sizeof(record)) != PICO_OK)
+        {
+            return PICO_ERROR_IO;
+        }
+
+        if (calib_slot_blank(&record))
+        {
+            break;
+        }
+    }
+
+    if (n == slots)
+    {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    record.magic = GY85_CALIB_MAGIC;
+    record.version = GY85_CALIB_VERSION;
+    record.length = sizeof(gy85_calib_record_t);
+    record.sequence = sequence;
+
+    record.accel_offset[0] = this->accel_offset.x;
+    record.accel_offset[1] = this->accel_offset.y;
+    record.accel_offset[2] = this->accel_offset.z;
+    record.gyro_offset[0] = this->gyro_offset.x;
+    record.gyro_offset[1] = this->gyro_offset.y;
+    record.gyro_offset[2] = this->gyro_offset.z;
+
+    // The configuration is read back from the sensors
+    adxl345_range_t range;
+    if (get_adxl345_range(&range) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+    record.adxl345_range = range;
+
+    adxl345_data_rate_t data_rate;
+    if (get_adxl345_data_rate(&data_rate) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+    record.adxl345_data_rate = data_rate;
+
+    if (get_itg3205_sample_rate_div(&record.itg3205_sample_rate_div) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (get_itg3205_dlpf_fs(&record.itg3205_dlpf_fs) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (get_qmc5883l_ctrl(&record.qmc5883l_ctrl) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    record.reserved[0] = 0;
+    record.reserved[1] = 0;
+    record.reserved[2] = 0;
+    record.crc = gy85_crc32((const uint8_t *)&record, offsetof(gy85_calib_record_t, crc));
+
+    uint8_t page[GY85_FLASH_PAGE_SIZE];
+    memset(page, 0xFF, slot_size);
+    memcpy(page, &record, sizeof(record));
+
+    if (storage->program(slot * slot_size, page, slot_size) != PICO_OK)
+    {
+        return PICO_ERROR_IO;
+    }
+
+    return PICO_OK;
+}
+
+int gy85::load_calibration(gy85_storage *storage)
+{
+    gy85_calib_record_t record;
+    uint32_t slot;
+
+    int res = find_calib_record(storage, &record, &slot);
+    if (res != PICO_OK)
+    {
+        return res;
+    }
+
+    if (set_adxl345_range((adxl345_range_t)record.adxl345_range) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (set_adxl345_data_rate((adxl345_data_rate_t)record.adxl345_data_rate) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (set_itg3205_sample_rate_div(record.itg3205_sample_rate_div) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (set_itg3205_dlpf_fs(record.itg3205_dlpf_fs) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    if (set_qmc5883l_ctrl(record.qmc5883l_ctrl) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    this->accel_offset.x = record.accel_offset[0];
+    this->accel_offset.y = record.accel_offset[1];
+    this->accel_offset.z = record.accel_offset[2];
+    this->gyro_offset.x = record.gyro_offset[0];
+    this->gyro_offset.y = record.gyro_offset[1];
+    this->gyro_offset.z = record.gyro_offset[2];
+
+    return PICO_OK;
+}
+
 const vec3f_t gy85::get_accel()
 {
     return this->accel;
@@ -140,6 +700,33 @@ const vec3f_t gy85::get_mag()
     return this->mag;
 }
 
+/**
+ * GY85_SAMPLE_xxx of the sensors the last read() got a new sample from,
+ * the others were absorbed by a decimating filter and kept their value
+ */
+uint8_t gy85::get_new_samples()
+{
+    return this->new_samples;
+}
+
+/**
+ * Roll, pitch and tilt compensated heading of the last read() in the
+ * mounting frame, computed in fixed point (see gy85_attitude()).
+ */
+int gy85::get_attitude(gy85_attitude_t *attitude)
+{
+    // Only the directions matter, the scales just keep the fractions
+    int32_t accel[3] = {(int32_t)(this->accel.x * 4096), (int32_t)(this->accel.y * 4096), (int32_t)(this->accel.z * 4096)};
+    int32_t mag[3] = {(int32_t)(this->mag.x * 16), (int32_t)(this->mag.y * 16), (int32_t)(this->mag.z * 16)};
+
+    if (gy85_attitude(accel, mag, attitude) != 0)
+    {
+        return PICO_ERROR_NO_DATA;
+    }
+
+    return PICO_OK;
+}
+
 /**
  * ADXL345 Functions
  */
@@ -147,7 +734,7 @@ const vec3f_t gy85::get_mag()
 int gy85::init_adxl345()
 {
     uint8_t id;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_DEVID, 1, &id) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_DEVID, 1, &id) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -157,32 +744,43 @@ int gy85::init_adxl345()
         return PICO_ERROR_GENERIC;
     }
 
-    // Power up the ADXL345
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_POWER_CTL, 0x08) != PICO_OK)
+    // Set range to +/- 2g
+    // Read-modify-write, SELF_TEST, SPI and INT_INVERT survive a warm reboot
+    if (set_adxl345_range(adxl345_range_t::RANGE_2_G) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    // Set range to +/- 2g
-    if (set_adxl345_range(adxl345_range_t::RANGE_2_G) != PICO_OK)
+    // Set data rate to 100Hz and power up the ADXL345
+    // BW_RATE and POWER_CTL are consecutive, measurement starts last
+    uint8_t bw_rate_power_ctl[] = {adxl345_data_rate_t::DATARATE_100_HZ, 0x08};
+    if (bus_write(this->adxl345_addr, ADXL345_REG_BW_RATE, bw_rate_power_ctl, 2) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    // Set data rate to 100Hz
-    if (set_adxl345_data_rate(adxl345_data_rate_t::DATARATE_100_HZ) != PICO_OK)
+    return PICO_OK;
+}
+
+int gy85::get_adxl345_range(adxl345_range_t *range)
+{
+    uint8_t reg;
+    if (bus_read(this->adxl345_addr, ADXL345_REG_DATA_FORMAT, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
+    *range = (adxl345_range_t)(reg & 0x03);
 
     return PICO_OK;
 }
 
 int gy85::set_adxl345_range(adxl345_range_t range)
 {
+    GY85_STATS_OP(OP_SET_ADXL345_RANGE);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_DATA_FORMAT, 1, &reg) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_DATA_FORMAT, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -190,7 +788,7 @@ int gy85::set_adxl345_range(adxl345_range_t range)
     reg &= ~0x0F;
     reg |= range;
 
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_DATA_FORMAT, reg) != PICO_OK)
+    if (bus_write(this->adxl345_addr, ADXL345_REG_DATA_FORMAT, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -214,13 +812,30 @@ int gy85::set_adxl345_range(adxl345_range_t range)
         break;
     }
 
+    update_axis_scale(&this->adxl345_orientation, this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH, this->adxl345_axis_scale);
+
+    return PICO_OK;
+}
+
+int gy85::get_adxl345_data_rate(adxl345_data_rate_t *dataRate)
+{
+    uint8_t reg;
+    if (bus_read(this->adxl345_addr, ADXL345_REG_BW_RATE, 1, &reg) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    *dataRate = (adxl345_data_rate_t)(reg & 0x0F);
+
     return PICO_OK;
 }
 
 int gy85::set_adxl345_data_rate(adxl345_data_rate_t dataRate)
 {
+    GY85_STATS_OP(OP_SET_ADXL345_DATA_RATE);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_BW_RATE, 1, &reg) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_BW_RATE, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -228,7 +843,7 @@ int gy85::set_adxl345_data_rate(adxl345_data_rate_t dataRate)
     reg &= ~0x0F;
     reg |= dataRate;
 
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_BW_RATE, reg) != PICO_OK)
+    if (bus_write(this->adxl345_addr, ADXL345_REG_BW_RATE, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -238,16 +853,18 @@ int gy85::set_adxl345_data_rate(adxl345_data_rate_t dataRate)
 
 int gy85::set_adxl345_fifo_mode(adxl345_fifo_mode_t mode)
 {
+    GY85_STATS_OP(OP_SET_ADXL345_FIFO_MODE);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_FIFO_CTL, 1, &reg) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_FIFO_CTL, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
     reg &= ~0b11000000;
-    reg |= mode;
+    reg |= mode << 6;
 
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_FIFO_CTL, reg) != PICO_OK)
+    if (bus_write(this->adxl345_addr, ADXL345_REG_FIFO_CTL, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -257,8 +874,10 @@ int gy85::set_adxl345_fifo_mode(adxl345_fifo_mode_t mode)
 
 int gy85::set_adxl345_interrupt(bool enable)
 {
+    GY85_STATS_OP(OP_SET_ADXL345_INTERRUPT);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_INT_ENABLE, 1, &reg) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_INT_ENABLE, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -266,7 +885,7 @@ int gy85::set_adxl345_interrupt(bool enable)
     reg &= ~0x80;
     reg |= enable << 7;
 
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_INT_ENABLE, reg) != PICO_OK)
+    if (bus_write(this->adxl345_addr, ADXL345_REG_INT_ENABLE, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -276,8 +895,10 @@ int gy85::set_adxl345_interrupt(bool enable)
 
 int gy85::set_adxl345_sleep(bool sleep)
 {
+    GY85_STATS_OP(OP_SET_ADXL345_SLEEP);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_POWER_CTL, 1, &reg) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_POWER_CTL, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -285,7 +906,7 @@ int gy85::set_adxl345_sleep(bool sleep)
     reg &= 0b11111011;
     reg |= sleep << 2;
 
-    if (write_register(this->i2c_port, this->adxl345_addr, ADXL345_REG_POWER_CTL, reg) != PICO_OK)
+    if (bus_write(this->adxl345_addr, ADXL345_REG_POWER_CTL, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -298,10 +919,15 @@ int gy85::calibrate_adxl345(uint16_t samples)
     vec3f_t accel;
     vec3f_t accel_sum = {0, 0, 0};
 
+    // Calibrate on unfiltered samples
+    vec3_filter *filter = this->adxl345_filter;
+    this->adxl345_filter = nullptr;
+
     for (uint16_t i = 0; i < samples; i++)
     {
         if (read_adxl345(&accel) != PICO_OK)
         {
+            this->adxl345_filter = filter;
             return PICO_ERROR_GENERIC;
         }
 
@@ -311,6 +937,8 @@ int gy85::calibrate_adxl345(uint16_t samples)
         this->sleep_fn(10);
     }
 
+    this->adxl345_filter = filter;
+
     this->accel_offset.x = accel_sum.x / samples;
     this->accel_offset.y = accel_sum.y / samples;
     this->accel_offset.z = 0;
@@ -318,21 +946,78 @@ int gy85::calibrate_adxl345(uint16_t samples)
     return PICO_OK;
 }
 
-int gy85::read_adxl345(vec3f_t *accel)
+int gy85::read_adxl345_raw(int16_t raw[3])
 {
     uint8_t buffer[6];
-    if (read_registers(this->i2c_port, this->adxl345_addr, ADXL345_REG_DATAX0, 6, buffer) != PICO_OK)
+    if (bus_read(this->adxl345_addr, ADXL345_REG_DATAX0, 6, buffer) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    raw[0] = uint16_t(buffer[1]) << 8 | uint16_t(buffer[0]);
+    raw[1] = uint16_t(buffer[3]) << 8 | uint16_t(buffer[2]);
+    raw[2] = uint16_t(buffer[5]) << 8 | uint16_t(buffer[4]);
+
+    return PICO_OK;
+}
+
+int gy85::get_adxl345_data_ready(bool *ready)
+{
+    // DATA_READY
+    uint8_t status;
+    if (bus_read(this->adxl345_addr, ADXL345_REG_INT_SOURCE, 1, &status) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    int16_t x = uint16_t(buffer[1]) << 8 | uint16_t(buffer[0]);
-    int16_t y = uint16_t(buffer[3]) << 8 | uint16_t(buffer[2]);
-    int16_t z = uint16_t(buffer[5]) << 8 | uint16_t(buffer[4]);
+    *ready = status & 0x80;
 
-    accel->x = x * this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH;
-    accel->y = y * this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH;
-    accel->z = z * this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH;
+    return PICO_OK;
+}
+
+int gy85::set_adxl345_filter(vec3_filter *filter)
+{
+    this->adxl345_filter = filter;
+
+    if (filter != nullptr)
+    {
+        filter->reset();
+    }
+
+    return PICO_OK;
+}
+
+int gy85::set_adxl345_orientation(const gy85_orientation_t &orientation)
+{
+    if (!orientation.valid)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Offsets are in the output frame, calibrate after changing this
+    this->adxl345_orientation = orientation;
+    update_axis_scale(&this->adxl345_orientation, this->adxl345_scale_factor * SENSORS_GRAVITY_EARTH, this->adxl345_axis_scale);
+
+    return PICO_OK;
+}
+
+int gy85::read_adxl345(vec3f_t *accel)
+{
+    GY85_STATS_OP(OP_READ_ADXL345);
+
+    int16_t raw[3];
+    if (read_adxl345_raw(raw) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    int32_t counts[3] = {raw[0], raw[1], raw[2]};
+    if (this->adxl345_filter != nullptr && !this->adxl345_filter->process(raw, counts))
+    {
+        return PICO_ERROR_NO_DATA;
+    }
+
+    convert_counts(&this->adxl345_orientation, this->adxl345_axis_scale, counts, accel);
 
     accel->x -= this->accel_offset.x;
     accel->y -= this->accel_offset.y;
@@ -350,23 +1035,31 @@ int gy85::init_itg3205()
 
     // Power up the ITG3205
     // Set clock source to internal oscillator
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_PWR_MGM, 0x00) != PICO_OK)
+    if (bus_write(this->itg3205_addr, ITG3205_REG_PWR_MGM, 0x00) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    // Set sample rate divider
+    // SMPLRT_DIV, DLPF_FS and INT_CFG are consecutive, written in one burst
     // Sample rate = 1kHz / (divider + 1)
     // 1kHz / 8 = 125Hz
-    if (set_itg3205_sample_rate_div(0x07) != PICO_OK)
+    // FS_SEL = 3 -> +/- 2000 deg/s
+    // DLPF_CFG = 3 -> 42Hz low pass filter
+    // RAW_RDY_EN: RAW_DATA_RDY in INT_STATUS is only set with it enabled,
+    // data ready polling depends on it. It also pulses the INT pin (50us,
+    // active high) every sample, see set_itg3205_interrupt()
+    uint8_t config[] = {0x07, 0x1E, 0x01};
+    if (bus_write(this->itg3205_addr, ITG3205_REG_SMPLRT_DIV, config, 3) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    // Set digital low pass filter and full scale range
-    // FS_SEL = 3 -> +/- 2000 deg/s
-    // DLPF_CFG = 3 -> 42Hz low pass filter
-    if (set_itg3205_dlpf_fs(0x1E) != PICO_OK)
+    return PICO_OK;
+}
+
+int gy85::get_itg3205_sample_rate_div(uint8_t *div)
+{
+    if (bus_read(this->itg3205_addr, ITG3205_REG_SMPLRT_DIV, 1, div) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -376,7 +1069,9 @@ int gy85::init_itg3205()
 
 int gy85::set_itg3205_sample_rate_div(uint8_t div)
 {
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_SMPLRT_DIV, div) != PICO_OK)
+    GY85_STATS_OP(OP_SET_ITG3205_SAMPLE_RATE_DIV);
+
+    if (bus_write(this->itg3205_addr, ITG3205_REG_SMPLRT_DIV, div) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -387,7 +1082,7 @@ int gy85::set_itg3205_sample_rate_div(uint8_t div)
 int gy85::get_itg3205_dlpf_fs(uint8_t *dlpf_fs)
 {
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->itg3205_addr, ITG3205_REG_DLPF_FS, 1, &reg) != PICO_OK)
+    if (bus_read(this->itg3205_addr, ITG3205_REG_DLPF_FS, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -399,7 +1094,9 @@ int gy85::get_itg3205_dlpf_fs(uint8_t *dlpf_fs)
 
 int gy85::set_itg3205_dlpf_fs(uint8_t dlpf_fs)
 {
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_DLPF_FS, dlpf_fs) != PICO_OK)
+    GY85_STATS_OP(OP_SET_ITG3205_DLPF_FS);
+
+    if (bus_write(this->itg3205_addr, ITG3205_REG_DLPF_FS, dlpf_fs) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -409,6 +1106,8 @@ int gy85::set_itg3205_dlpf_fs(uint8_t dlpf_fs)
 
 int gy85::set_itg3205_fs(itg3205_fs_t fs)
 {
+    GY85_STATS_OP(OP_SET_ITG3205_FS);
+
     uint8_t curr_dlpf_fs;
 
     if (get_itg3205_dlpf_fs(&curr_dlpf_fs) != PICO_OK)
@@ -429,6 +1128,8 @@ int gy85::set_itg3205_fs(itg3205_fs_t fs)
 
 int gy85::set_itg3205_dlpf(itg3205_dlpf_t dlpf)
 {
+    GY85_STATS_OP(OP_SET_ITG3205_DLPF);
+
     uint8_t curr_dlpf_fs;
 
     if (get_itg3205_dlpf_fs(&curr_dlpf_fs) != PICO_OK)
@@ -449,9 +1150,13 @@ int gy85::set_itg3205_dlpf(itg3205_dlpf_t dlpf)
 
 int gy85::set_itg3205_interrupt(bool enable)
 {
+    GY85_STATS_OP(OP_SET_ITG3205_INTERRUPT);
+
     // Enable interrupt on data ready
     // Interupt clear on any read operation
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_INT_CFG, enable | 0b00010000) != PICO_OK)
+    // Disabled, RAW_DATA_RDY is not set either and get_itg3205_data_ready()
+    // never reports ready
+    if (bus_write(this->itg3205_addr, ITG3205_REG_INT_CFG, enable | 0b00010000) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -461,7 +1166,7 @@ int gy85::set_itg3205_interrupt(bool enable)
 
 int gy85::reset_itg3205()
 {
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_PWR_MGM, 0x80) != PICO_OK)
+    if (bus_write(this->itg3205_addr, ITG3205_REG_PWR_MGM, 0x80) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -476,8 +1181,10 @@ int gy85::reset_itg3205()
 
 int gy85::set_itg3205_sleep(bool sleep)
 {
+    GY85_STATS_OP(OP_SET_ITG3205_SLEEP);
+
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->itg3205_addr, ITG3205_REG_PWR_MGM, 1, &reg) != PICO_OK)
+    if (bus_read(this->itg3205_addr, ITG3205_REG_PWR_MGM, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -485,7 +1192,7 @@ int gy85::set_itg3205_sleep(bool sleep)
     reg &= ~0b01000000;
     reg |= sleep;
 
-    if (write_register(this->i2c_port, this->itg3205_addr, ITG3205_REG_PWR_MGM, reg) != PICO_OK)
+    if (bus_write(this->itg3205_addr, ITG3205_REG_PWR_MGM, reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -498,10 +1205,15 @@ int gy85::calibrate_itg3205(uint16_t samples)
     vec3f_t gyro;
     vec3f_t gyro_sum = {0, 0, 0};
 
+    // Calibrate on unfiltered samples
+    vec3_filter *filter = this->itg3205_filter;
+    this->itg3205_filter = nullptr;
+
     for (uint16_t i = 0; i < samples; i++)
     {
         if (read_itg3205(&gyro) != PICO_OK)
         {
+            this->itg3205_filter = filter;
             return PICO_ERROR_GENERIC;
         }
 
@@ -512,6 +1224,8 @@ int gy85::calibrate_itg3205(uint16_t samples)
         this->sleep_fn(10);
     }
 
+    this->itg3205_filter = filter;
+
     this->gyro_offset.x = gyro_sum.x / samples;
     this->gyro_offset.y = gyro_sum.y / samples;
     this->gyro_offset.z = gyro_sum.z / samples;
@@ -519,21 +1233,78 @@ int gy85::calibrate_itg3205(uint16_t samples)
     return PICO_OK;
 }
 
-int gy85::read_itg3205(vec3f_t *gyro)
+int gy85::read_itg3205_raw(int16_t raw[3])
 {
     uint8_t buffer[6];
-    if (read_registers(this->i2c_port, this->itg3205_addr, ITG3205_REG_GYRO_XOUT_H, 6, buffer) != PICO_OK)
+    if (bus_read(this->itg3205_addr, ITG3205_REG_GYRO_XOUT_H, 6, buffer) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    int16_t x = uint16_t(buffer[0]) << 8 | uint16_t(buffer[1]);
-    int16_t y = uint16_t(buffer[2]) << 8 | uint16_t(buffer[3]);
-    int16_t z = uint16_t(buffer[4]) << 8 | uint16_t(buffer[5]);
+    raw[0] = uint16_t(buffer[0]) << 8 | uint16_t(buffer[1]);
+    raw[1] = uint16_t(buffer[2]) << 8 | uint16_t(buffer[3]);
+    raw[2] = uint16_t(buffer[4]) << 8 | uint16_t(buffer[5]);
+
+    return PICO_OK;
+}
 
-    gyro->x = x * (DEG_TO_RAD / ITG3205_DIGIT_TO_DEG);
-    gyro->y = y * (DEG_TO_RAD / ITG3205_DIGIT_TO_DEG);
-    gyro->z = z * (DEG_TO_RAD / ITG3205_DIGIT_TO_DEG);
+int gy85::get_itg3205_data_ready(bool *ready)
+{
+    // RAW_DATA_RDY, needs RAW_RDY_EN
+    uint8_t status;
+    if (bus_read(this->itg3205_addr, ITG3205_REG_INT_STATUS, 1, &status) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    *ready = status & 0x01;
+
+    return PICO_OK;
+}
+
+int gy85::set_itg3205_filter(vec3_filter *filter)
+{
+    this->itg3205_filter = filter;
+
+    if (filter != nullptr)
+    {
+        filter->reset();
+    }
+
+    return PICO_OK;
+}
+
+int gy85::set_itg3205_orientation(const gy85_orientation_t &orientation)
+{
+    if (!orientation.valid)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Offsets are in the output frame, calibrate after changing this
+    this->itg3205_orientation = orientation;
+    update_axis_scale(&this->itg3205_orientation, DEG_TO_RAD / ITG3205_DIGIT_TO_DEG, this->itg3205_axis_scale);
+
+    return PICO_OK;
+}
+
+int gy85::read_itg3205(vec3f_t *gyro)
+{
+    GY85_STATS_OP(OP_READ_ITG3205);
+
+    int16_t raw[3];
+    if (read_itg3205_raw(raw) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    int32_t counts[3] = {raw[0], raw[1], raw[2]};
+    if (this->itg3205_filter != nullptr && !this->itg3205_filter->process(raw, counts))
+    {
+        return PICO_ERROR_NO_DATA;
+    }
+
+    convert_counts(&this->itg3205_orientation, this->itg3205_axis_scale, counts, gyro);
 
     gyro->x -= this->gyro_offset.x;
     gyro->y -= this->gyro_offset.y;
@@ -548,20 +1319,22 @@ int gy85::read_itg3205(vec3f_t *gyro)
 
 int gy85::init_qmc5883l()
 {
+    // The QMC5883L only documents single byte writes, no burst here
+
     // Set reset
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x80) != PICO_OK)
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x80) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
     
     // Set period
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_PERIOD, 0x01) != PICO_OK)
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_PERIOD, 0x01) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
     // Set roll over pointer
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x40) != PICO_OK)
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x40) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -575,21 +1348,78 @@ int gy85::init_qmc5883l()
     return PICO_OK;
 }
 
-int gy85::read_qmc5883l(vec3f_t *mag)
+int gy85::read_qmc5883l_raw(int16_t raw[3])
 {
     uint8_t buffer[6];
-    if (read_registers(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_DATA, 6, buffer) != PICO_OK)
+    if (bus_read(this->qmc5883l_addr, QMC5883L_REG_DATA, 6, buffer) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    raw[0] = (buffer[1]) << 8 | (buffer[0]);
+    raw[1] = (buffer[3]) << 8 | (buffer[2]);
+    raw[2] = (buffer[5]) << 8 | (buffer[4]);
+
+    return PICO_OK;
+}
+
+int gy85::get_qmc5883l_data_ready(bool *ready)
+{
+    // DRDY
+    uint8_t status;
+    if (bus_read(this->qmc5883l_addr, QMC5883L_REG_STATUS, 1, &status) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    *ready = status & 0x01;
+
+    return PICO_OK;
+}
+
+int gy85::set_qmc5883l_filter(vec3_filter *filter)
+{
+    this->qmc5883l_filter = filter;
+
+    if (filter != nullptr)
+    {
+        filter->reset();
+    }
+
+    return PICO_OK;
+}
+
+int gy85::set_qmc5883l_orientation(const gy85_orientation_t &orientation)
+{
+    if (!orientation.valid)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Offsets are in the output frame, calibrate after changing this
+    this->qmc5883l_orientation = orientation;
+    update_axis_scale(&this->qmc5883l_orientation, 1.0, this->qmc5883l_axis_scale);
+
+    return PICO_OK;
+}
+
+int gy85::read_qmc5883l(vec3f_t *mag)
+{
+    GY85_STATS_OP(OP_READ_QMC5883L);
+
+    int16_t raw[3];
+    if (read_qmc5883l_raw(raw) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
 
-    int16_t x = (buffer[1]) << 8 | (buffer[0]);
-    int16_t y = (buffer[3]) << 8 | (buffer[2]);
-    int16_t z = (buffer[5]) << 8 | (buffer[4]);
+    int32_t counts[3] = {raw[0], raw[1], raw[2]};
+    if (this->qmc5883l_filter != nullptr && !this->qmc5883l_filter->process(raw, counts))
+    {
+        return PICO_ERROR_NO_DATA;
+    }
 
-    mag->x = x;
-    mag->y = y;
-    mag->z = z;
+    convert_counts(&this->qmc5883l_orientation, this->qmc5883l_axis_scale, counts, mag);
 
     return PICO_OK;
 }
@@ -597,7 +1427,7 @@ int gy85::read_qmc5883l(vec3f_t *mag)
 int gy85::get_qmc5883l_ctrl(uint8_t *ctrl)
 {
     uint8_t reg;
-    if (read_registers(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_A, 1, &reg) != PICO_OK)
+    if (bus_read(this->qmc5883l_addr, QMC5883L_REG_CONFIG_A, 1, &reg) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -609,7 +1439,9 @@ int gy85::get_qmc5883l_ctrl(uint8_t *ctrl)
 
 int gy85::set_qmc5883l_ctrl(uint8_t ctrl)
 {
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_A, ctrl) != PICO_OK)
+    GY85_STATS_OP(OP_SET_QMC5883L_CTRL);
+
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_CONFIG_A, ctrl) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -619,6 +1451,8 @@ int gy85::set_qmc5883l_ctrl(uint8_t ctrl)
 
 int gy85::set_qmc5883l_mode(qmc5883l_mode_t mode)
 {
+    GY85_STATS_OP(OP_SET_QMC5883L_MODE);
+
     uint8_t curr_ctrl;
     if (get_qmc5883l_ctrl(&curr_ctrl) != PICO_OK)
     {
@@ -638,6 +1472,8 @@ int gy85::set_qmc5883l_mode(qmc5883l_mode_t mode)
 
 int gy85::set_qmc5883l_scale(qmc5883l_scale_t scale)
 {
+    GY85_STATS_OP(OP_SET_QMC5883L_SCALE);
+
     uint8_t curr_ctrl;
     if (get_qmc5883l_ctrl(&curr_ctrl) != PICO_OK)
     {
@@ -657,6 +1493,8 @@ int gy85::set_qmc5883l_scale(qmc5883l_scale_t scale)
 
 int gy85::set_qmc5883l_output_rate(qmc5883l_output_rate_t output_rate)
 {
+    GY85_STATS_OP(OP_SET_QMC5883L_OUTPUT_RATE);
+
     uint8_t curr_ctrl;
     if (get_qmc5883l_ctrl(&curr_ctrl) != PICO_OK)
     {
@@ -676,6 +1514,8 @@ int gy85::set_qmc5883l_output_rate(qmc5883l_output_rate_t output_rate)
 
 int gy85::set_qmc5883l_over_sample(qmc5883l_over_sample_t over_sample)
 {
+    GY85_STATS_OP(OP_SET_QMC5883L_OVER_SAMPLE);
+
     uint8_t curr_ctrl;
     if (get_qmc5883l_ctrl(&curr_ctrl) != PICO_OK)
     {
@@ -695,7 +1535,9 @@ int gy85::set_qmc5883l_over_sample(qmc5883l_over_sample_t over_sample)
 
 int gy85::set_qmc5883l_interrupt(bool enable)
 {
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, !enable) != PICO_OK)
+    GY85_STATS_OP(OP_SET_QMC5883L_INTERRUPT);
+
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, !enable) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -705,7 +1547,7 @@ int gy85::set_qmc5883l_interrupt(bool enable)
 
 int gy85::reset_qmc5883l()
 {
-    if (write_register(this->i2c_port, this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x80) != PICO_OK)
+    if (bus_write(this->qmc5883l_addr, QMC5883L_REG_CONFIG_B, 0x80) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
     }
@@ -715,6 +1557,8 @@ int gy85::reset_qmc5883l()
 
 int gy85::set_qmc5883l_sleep(bool sleep)
 {
+    GY85_STATS_OP(OP_SET_QMC5883L_SLEEP);
+
     if (this->set_qmc5883l_mode(sleep ? qmc5883l_mode_t::STANDBY : qmc5883l_mode_t::CONTINUOUS) != PICO_OK)
     {
         return PICO_ERROR_GENERIC;
@@ -0,0 +1,243 @@
+#include "gy85/motion.hpp"
+#include <math.h>
+#include <string.h>
+
+static inline void cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/**
+ * v rotated by q (conjugate false, body to navigation) or by its inverse.
+ */
+static void rotate(const float q[4], bool conjugate, const float v[3], float out[3])
+{
+    const float u[3] = {conjugate ? -q[1] : q[1], conjugate ? -q[2] : q[2], conjugate ? -q[3] : q[3]};
+    float t[3], ut[3];
+
+    // v + 2w (u x v) + 2u x (u x v)
+    cross(u, v, t);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        t[i] *= 2;
+    }
+    cross(u, t, ut);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        out[i] = v[i] + q[0] * t[i] + ut[i];
+    }
+}
+
+static void normalize_quat(float q[4])
+{
+    float scale = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        q[i] *= scale;
+    }
+}
+
+gy85_motion::gy85_motion()
+{
+    this->config = gy85_motion_default_config();
+    this->sample_period_s = 0;
+    this->reset();
+}
+
+int gy85_motion::configure(float sample_rate_hz, const gy85_motion_config_t &config)
+{
+    if (sample_rate_hz <= 0 || config.gravity <= 0 || config.tilt_gain < 0 || config.bias_gain < 0)
+    {
+        return -1;
+    }
+
+    this->config = config;
+    this->sample_period_s = 1.0f / sample_rate_hz;
+    this->reset();
+
+    return 0;
+}
+
+/**
+ * Forgets the attitude, biases and velocity, the next sample aligns the
+ * gravity direction again.
+ */
+void gy85_motion::reset()
+{
+    this->attitude[0] = 1;
+    this->attitude[1] = this->attitude[2] = this->attitude[3] = 0;
+    memset(this->gyro_bias, 0, sizeof(this->gyro_bias));
+    memset(this->accel_bias, 0, sizeof(this->accel_bias));
+    memset(this->velocity, 0, sizeof(this->velocity));
+    this->aligned = false;
+
+    this->sum_accel = 0;
+    this->sum_accel2 = 0;
+    this->sum_gyro = 0;
+    this->window_count = 0;
+    this->window_index = 0;
+}
+
+int gy85_motion::get_gyro_bias(float bias[3])
+{
+    memcpy(bias, this->gyro_bias, sizeof(this->gyro_bias));
+    return 0;
+}
+
+/**
+ * Adds the sample to the window, true when the whole window is still.
+ */
+bool gy85_motion::update_window(const float accel[3], float accel_norm, const float measured[3], float gyro_norm2)
+{
+    float deviation = accel_norm - this->config.gravity;
+
+    if (this->window_count == GY85_MOTION_WINDOW)
+    {
+        float old = this->window_accel[this->window_index];
+        this->sum_accel -= old;
+        this->sum_accel2 -= old * old;
+        this->sum_gyro -= this->window_gyro[this->window_index];
+    }
+    else
+    {
+        this->window_count++;
+    }
+
+    this->window_accel[this->window_index] = deviation;
+    this->window_gyro[this->window_index] = gyro_norm2;
+    memcpy(this->window_rate[this->window_index], measured, sizeof(this->window_rate[0]));
+    memcpy(this->window_force[this->window_index], accel, sizeof(this->window_force[0]));
+    this->sum_accel += deviation;
+    this->sum_accel2 += deviation * deviation;
+    this->sum_gyro += gyro_norm2;
+    this->window_index = (this->window_index + 1) & (GY85_MOTION_WINDOW - 1);
+
+    // Start over from the stored values once per turn, the running sums
+    // would otherwise pick up single precision rounding for good
+    if (this->window_index == 0)
+    {
+        this->sum_accel = this->sum_accel2 = this->sum_gyro = 0;
+        for (uint16_t i = 0; i < this->window_count; i++)
+        {
+            this->sum_accel += this->window_accel[i];
+            this->sum_accel2 += this->window_accel[i] * this->window_accel[i];
+            this->sum_gyro += this->window_gyro[i];
+        }
+    }
+
+    if (this->window_count < GY85_MOTION_WINDOW)
+    {
+        return false;
+    }
+
+    const float n = GY85_MOTION_WINDOW;
+    float mean = this->sum_accel / n;
+    float variance = this->sum_accel2 / n - mean * mean;
+
+    return variance < this->config.accel_std_threshold * this->config.accel_std_threshold &&
+           fabsf(mean) < this->config.accel_mag_threshold &&
+           this->sum_gyro / n < this->config.gyro_threshold * this->config.gyro_threshold;
+}
+
+void gy85_motion::add(const vec3f_t &gyro, const vec3f_t &accel, gy85_motion_t *out)
+{
+    const float t = this->sample_period_s;
+    const float measured[3] = {(float)gyro.x, (float)gyro.y, (float)gyro.z};
+    const float a[3] = {(float)accel.x, (float)accel.y, (float)accel.z};
+    const float z[3] = {0, 0, 1};
+
+    float accel_norm = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+
+    // First sample: the shortest rotation taking the accel direction to up
+    if (!this->aligned && accel_norm > 0)
+    {
+        float axis[3];
+        cross(a, z, axis);
+        this->attitude[0] = accel_norm + a[2];
+        this->attitude[1] = axis[0];
+        this->attitude[2] = axis[1];
+        this->attitude[3] = axis[2];
+        if (this->attitude[0] < 1e-6f * accel_norm)
+        {
+            // Upside down, half a turn around x
+            this->attitude[0] = 0;
+            this->attitude[1] = 1;
+        }
+        normalize_quat(this->attitude);
+        this->aligned = true;
+    }
+
+    float rate[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        rate[i] = measured[i] - this->gyro_bias[i];
+    }
+
+    bool still = update_window(a, accel_norm, measured, rate[0] * rate[0] + rate[1] * rate[1] + rate[2] * rate[2]);
+
+    if (still)
+    {
+        // The corrections come from the middle of the window, away from the
+        // slow start and end of the moves either side. Nothing turns while
+        // still, so its accel holds for the current attitude.
+        uint16_t middle = (this->window_index + GY85_MOTION_WINDOW / 2) & (GY85_MOTION_WINDOW - 1);
+        const float *force = this->window_force[middle];
+        float up[3], unit[3], error[3];
+        float norm = sqrtf(force[0] * force[0] + force[1] * force[1] + force[2] * force[2]);
+
+        rotate(this->attitude, true, z, up);
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            unit[i] = force[i] / norm;
+            this->gyro_bias[i] += this->config.bias_gain * t * (this->window_rate[middle][i] - this->gyro_bias[i]);
+            this->accel_bias[i] += this->config.bias_gain * t * (force[i] - this->config.gravity * up[i] - this->accel_bias[i]);
+        }
+
+        // Mahony style proportional term, rotates the estimated up towards
+        // the measured one
+        cross(unit, up, error);
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            rate[i] += this->config.tilt_gain * error[i];
+        }
+
+        memset(this->velocity, 0, sizeof(this->velocity));
+    }
+
+    // First order quaternion update, renormalised every sample
+    const float h = 0.5f * t;
+    const float *q = this->attitude;
+    float next[4] = {
+        q[0] - h * (q[1] * rate[0] + q[2] * rate[1] + q[3] * rate[2]),
+        q[1] + h * (q[0] * rate[0] + q[2] * rate[2] - q[3] * rate[1]),
+        q[2] + h * (q[0] * rate[1] - q[1] * rate[2] + q[3] * rate[0]),
+        q[3] + h * (q[0] * rate[2] + q[1] * rate[1] - q[2] * rate[0]),
+    };
+    memcpy(this->attitude, next, sizeof(next));
+    normalize_quat(this->attitude);
+
+    // Gravity removal, the accel bias rides with the body
+    float up[3], linear[3], linear_nav[3];
+    rotate(this->attitude, true, z, up);
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        linear[i] = a[i] - this->config.gravity * up[i] - this->accel_bias[i];
+    }
+    rotate(this->attitude, false, linear, linear_nav);
+
+    if (!still)
+    {
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            this->velocity[i] += linear_nav[i] * t;
+        }
+    }
+
+    memcpy(out->linear_accel, linear, sizeof(linear));
+    memcpy(out->linear_accel_nav, linear_nav, sizeof(linear_nav));
+    memcpy(out->velocity, this->velocity, sizeof(this->velocity));
+    memcpy(out->up, up, sizeof(up));
+    out->still = still;
+}
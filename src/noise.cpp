@@ -0,0 +1,274 @@
+#include "gy85/noise.hpp"
+#include "pico/stdlib.h"
+#include <math.h>
+#include <string.h>
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/**
+ * Output period and raw count to unit scale of one sensor at its current configuration
+ */
+static int get_sensor_period(gy85 *sensor, gy85_sensor_t which, double *period_s, double *scale, uint8_t *setting)
+{
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+    {
+        adxl345_range_t range;
+        adxl345_data_rate_t data_rate;
+        if (sensor->get_adxl345_range(&range) != PICO_OK || sensor->get_adxl345_data_rate(&data_rate) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        // 3200Hz >> (15 - rate code), full resolution is off so the lsb doubles with the range
+        *period_s = (double)(1 << (15 - data_rate)) / 3200.0;
+        *scale = ADXL345_SCALE_FACTOR * (1 << range) * SENSORS_GRAVITY_EARTH;
+        *setting = data_rate;
+        return PICO_OK;
+    }
+
+    case SENSOR_ITG3205:
+    {
+        uint8_t dlpf_fs;
+        uint8_t div;
+        if (sensor->get_itg3205_dlpf_fs(&dlpf_fs) != PICO_OK || sensor->get_itg3205_sample_rate_div(&div) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        // 8kHz internal rate with the 256Hz filter, 1kHz otherwise
+        *period_s = (div + 1) / ((dlpf_fs & 0x07) == DLPF_256_8 ? 8000.0 : 1000.0);
+        *scale = DEG_TO_RAD / ITG3205_DIGIT_TO_DEG;
+        *setting = dlpf_fs & 0x07;
+        return PICO_OK;
+    }
+
+    case SENSOR_QMC5883L:
+    {
+        static const double qmc5883l_periods[] = {0.1, 0.02, 0.01, 0.005};
+
+        uint8_t ctrl;
+        if (sensor->get_qmc5883l_ctrl(&ctrl) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        // Single measurements are not paced by the data rate
+        if ((ctrl & 0x03) != qmc5883l_mode_t::CONTINUOUS)
+        {
+            return PICO_ERROR_NOT_PERMITTED;
+        }
+
+        *period_s = qmc5883l_periods[(ctrl >> 2) & 0x03];
+        *scale = 1.0;
+        *setting = (ctrl >> 6) & 0x03;
+        return PICO_OK;
+    }
+
+    default:
+        return PICO_ERROR_INVALID_ARG;
+    }
+}
+
+static int read_sensor_sample(gy85 *sensor, gy85_sensor_t which, bool *ready, int16_t raw[3])
+{
+    int res;
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+        res = sensor->get_adxl345_data_ready(ready);
+        break;
+    case SENSOR_ITG3205:
+        res = sensor->get_itg3205_data_ready(ready);
+        break;
+    default:
+        res = sensor->get_qmc5883l_data_ready(ready);
+        break;
+    }
+
+    if (res != PICO_OK || !*ready)
+    {
+        return res;
+    }
+
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+        return sensor->read_adxl345_raw(raw);
+    case SENSOR_ITG3205:
+        return sensor->read_itg3205_raw(raw);
+    default:
+        return sensor->read_qmc5883l_raw(raw);
+    }
+}
+
+int gy85_noise_run(gy85 *sensor, gy85_sensor_t which, uint32_t samples, allan_variance axes[3], gy85_noise_report_t *report)
+{
+    double period_s;
+    double scale;
+    uint8_t setting;
+
+    int res = get_sensor_period(sensor, which, &period_s, &scale, &setting);
+    if (res != PICO_OK)
+    {
+        return res;
+    }
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        axes[i].reset();
+    }
+
+    // Raw counts are accumulated exactly, the scale is only applied to the result
+    uint64_t timeout_us = (uint64_t)(period_s * 1e6) * GY85_NOISE_TIMEOUT_PERIODS;
+    uint64_t last_sample_us = time_us_64();
+    uint32_t count = 0;
+
+    while (count < samples + GY85_NOISE_SETTLE_SAMPLES)
+    {
+        bool ready;
+        int16_t raw[3];
+        if (read_sensor_sample(sensor, which, &ready, raw) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+
+        uint64_t now_us = time_us_64();
+        if (!ready)
+        {
+            if (now_us - last_sample_us > timeout_us)
+            {
+                return PICO_ERROR_TIMEOUT;
+            }
+            continue;
+        }
+        last_sample_us = now_us;
+
+        if (count++ < GY85_NOISE_SETTLE_SAMPLES)
+        {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            axes[i].add(raw[i]);
+        }
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->sensor = which;
+    report->setting = setting;
+    report->sample_period_s = period_s;
+    report->samples = samples;
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        report->curve_points[i] = axes[i].get_curve(period_s, scale, report->curve[i], GY85_ALLAN_LEVELS);
+        if (gy85_allan_noise_params(report->curve[i], report->curve_points[i], &report->axes[i]) != 0)
+        {
+            return PICO_ERROR_NO_DATA;
+        }
+    }
+
+    return PICO_OK;
+}
+
+static int set_sensor_setting(gy85 *sensor, gy85_sensor_t which, uint8_t setting)
+{
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+        return sensor->set_adxl345_data_rate((adxl345_data_rate_t)setting);
+    case SENSOR_ITG3205:
+        return sensor->set_itg3205_dlpf((itg3205_dlpf_t)setting);
+    default:
+        return sensor->set_qmc5883l_over_sample((qmc5883l_over_sample_t)setting);
+    }
+}
+
+int gy85_noise_sweep(gy85 *sensor, gy85_sensor_t which, uint32_t samples, allan_variance axes[3], gy85_noise_report_t *report,
+                     gy85_noise_report_fn report_fn, void *user_data)
+{
+    // Data rates above 800Hz outrun a 400kHz bus polling one sensor
+    static const uint8_t adxl345_settings[] = {DATARATE_12_5_HZ, DATARATE_25_HZ, DATARATE_50_HZ, DATARATE_100_HZ,
+                                               DATARATE_200_HZ, DATARATE_400_HZ, DATARATE_800_HZ};
+    static const uint8_t itg3205_settings[] = {DLPF_256_8, DLPF_188_1, DLPF_98_1, DLPF_42_1, DLPF_20_1, DLPF_10_1, DLPF_5_1};
+    static const uint8_t qmc5883l_settings[] = {OVER_SAMPLE_512, OVER_SAMPLE_256, OVER_SAMPLE_128, OVER_SAMPLE_64};
+
+    const uint8_t *settings;
+    uint8_t count;
+    uint8_t original;
+
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+    {
+        adxl345_data_rate_t data_rate;
+        if (sensor->get_adxl345_data_rate(&data_rate) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+        settings = adxl345_settings;
+        count = sizeof(adxl345_settings);
+        original = data_rate;
+        break;
+    }
+    case SENSOR_ITG3205:
+        if (sensor->get_itg3205_dlpf_fs(&original) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+        settings = itg3205_settings;
+        count = sizeof(itg3205_settings);
+        break;
+    case SENSOR_QMC5883L:
+        if (sensor->get_qmc5883l_ctrl(&original) != PICO_OK)
+        {
+            return PICO_ERROR_GENERIC;
+        }
+        settings = qmc5883l_settings;
+        count = sizeof(qmc5883l_settings);
+        break;
+    default:
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    int res = PICO_OK;
+    for (uint8_t i = 0; i < count && res == PICO_OK; i++)
+    {
+        if (set_sensor_setting(sensor, which, settings[i]) != PICO_OK)
+        {
+            res = PICO_ERROR_GENERIC;
+            break;
+        }
+
+        res = gy85_noise_run(sensor, which, samples, axes, report);
+        if (res == PICO_OK && report_fn != nullptr)
+        {
+            report_fn(report, user_data);
+        }
+    }
+
+    // The original configuration is put back even if a run failed
+    int restore;
+    switch (which)
+    {
+    case SENSOR_ADXL345:
+        restore = sensor->set_adxl345_data_rate((adxl345_data_rate_t)original);
+        break;
+    case SENSOR_ITG3205:
+        restore = sensor->set_itg3205_dlpf_fs(original);
+        break;
+    default:
+        restore = sensor->set_qmc5883l_ctrl(original);
+        break;
+    }
+
+    if (res == PICO_OK && restore != PICO_OK)
+    {
+        res = PICO_ERROR_GENERIC;
+    }
+
+    return res;
+}
@@ -0,0 +1,98 @@
+#include "gy85/preint.hpp"
+#include <string.h>
+
+static inline void cross_add(const float a[3], const float b[3], float scale, float out[3])
+{
+    out[0] += scale * (a[1] * b[2] - a[2] * b[1]);
+    out[1] += scale * (a[2] * b[0] - a[0] * b[2]);
+    out[2] += scale * (a[0] * b[1] - a[1] * b[0]);
+}
+
+gy85_preint::gy85_preint()
+{
+    this->sample_period_s = 0;
+    this->decimation = 1;
+
+    // The previous sample is only cleared here, it carries over between intervals
+    memset(this->prev_dalpha, 0, sizeof(this->prev_dalpha));
+    memset(this->prev_dvel, 0, sizeof(this->prev_dvel));
+
+    this->reset();
+}
+
+int gy85_preint::configure(float sample_rate_hz, uint16_t decimation)
+{
+    if (sample_rate_hz <= 0 || decimation == 0)
+    {
+        return -1;
+    }
+
+    this->sample_period_s = 1.0f / sample_rate_hz;
+    this->decimation = decimation;
+
+    memset(this->prev_dalpha, 0, sizeof(this->prev_dalpha));
+    memset(this->prev_dvel, 0, sizeof(this->prev_dvel));
+    this->reset();
+
+    return 0;
+}
+
+void gy85_preint::reset()
+{
+    this->count = 0;
+
+    memset(this->alpha, 0, sizeof(this->alpha));
+    memset(this->velocity, 0, sizeof(this->velocity));
+    memset(this->coning, 0, sizeof(this->coning));
+    memset(this->sculling, 0, sizeof(this->sculling));
+}
+
+bool gy85_preint::add(const vec3f_t &gyro, const vec3f_t &accel, gy85_preint_t *out)
+{
+    const float t = this->sample_period_s;
+    const float dalpha[3] = {(float)gyro.x * t, (float)gyro.y * t, (float)gyro.z * t};
+    const float dvel[3] = {(float)accel.x * t, (float)accel.y * t, (float)accel.z * t};
+
+    // Savage recursive form, the 1/6 terms use the previous sample as a
+    // first order fit of the rate over the current one
+    float alpha_fit[3];
+    float velocity_fit[3];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        alpha_fit[i] = this->alpha[i] + this->prev_dalpha[i] * (1.0f / 6.0f);
+        velocity_fit[i] = this->velocity[i] + this->prev_dvel[i] * (1.0f / 6.0f);
+    }
+
+    cross_add(alpha_fit, dalpha, 0.5f, this->coning);
+    cross_add(alpha_fit, dvel, 0.5f, this->sculling);
+    cross_add(velocity_fit, dalpha, 0.5f, this->sculling);
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        this->alpha[i] += dalpha[i];
+        this->velocity[i] += dvel[i];
+        this->prev_dalpha[i] = dalpha[i];
+        this->prev_dvel[i] = dvel[i];
+    }
+
+    if (++this->count < this->decimation)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        out->dtheta[i] = this->alpha[i] + this->coning[i];
+        out->dvel[i] = this->velocity[i] + this->sculling[i];
+    }
+
+    // Rotation of the velocity sum over the interval
+    cross_add(this->alpha, this->velocity, 0.5f, out->dvel);
+
+    out->dt = this->count * t;
+    out->count = this->count;
+
+    this->reset();
+
+    return true;
+}
@@ -0,0 +1,517 @@
+#include "gy85/recorder.hpp"
+#include <string.h>
+#include <stddef.h>
+
+static bool sector_header_valid(const gy85_recorder_sector_header_t *header)
+{
+    return header->magic == GY85_RECORDER_SECTOR_MAGIC &&
+           header->crc == gy85_crc32((const uint8_t *)header, offsetof(gy85_recorder_sector_header_t, crc));
+}
+
+static uint16_t block_header_crc(const gy85_recorder_block_header_t *header)
+{
+    return (uint16_t)gy85_crc32((const uint8_t *)header, offsetof(gy85_recorder_block_header_t, header_crc));
+}
+
+static bool block_header_valid(const gy85_recorder_block_header_t *header)
+{
+    return header->magic == GY85_RECORDER_BLOCK_MAGIC &&
+           header->length <= GY85_RECORDER_PAYLOAD_SIZE &&
+           header->header_crc == block_header_crc(header);
+}
+
+static bool block_header_blank(const gy85_recorder_block_header_t *header)
+{
+    // A torn program can leave any bit of the header cleared
+    const uint8_t *bytes = (const uint8_t *)header;
+    for (size_t i = 0; i < sizeof(*header); i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+gy85_recorder::gy85_recorder(gy85_storage *storage)
+{
+    this->storage = storage;
+    this->sectors = 0;
+    this->slots_per_sector = 0;
+    this->head_sector = 0;
+    this->head_slot = 0;
+    this->sequence = 0;
+    this->max_erase_count = 0;
+    this->read_only = false;
+
+    this->encoder.start(this->block, GY85_RECORDER_PAYLOAD_SIZE);
+}
+
+uint32_t gy85_recorder::slot_offset(uint32_t sector, uint32_t slot)
+{
+    return sector * this->storage->sector_size() + sizeof(gy85_recorder_sector_header_t) + slot * GY85_RECORDER_SLOT_SIZE;
+}
+
+/**
+ * Programs len bytes at any offset, the rest of the pages it touches is
+ * programmed with 0xFF
+ */
+int gy85_recorder::program_bytes(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint32_t page_size = this->storage->page_size();
+    uint8_t page[GY85_FLASH_PAGE_SIZE];
+
+    uint32_t page_offset = offset - offset % page_size;
+    while (page_offset < offset + len)
+    {
+        uint32_t start = offset > page_offset ? offset - page_offset : 0;
+        uint32_t end = offset + len < page_offset + page_size ? offset + len - page_offset : page_size;
+
+        memset(page, 0xFF, page_size);
+        memcpy(page + start, data + (page_offset + start - offset), end - start);
+
+        if (this->storage->program(page_offset, page, page_size) != 0)
+        {
+            return -1;
+        }
+
+        page_offset += page_size;
+    }
+
+    return 0;
+}
+
+/**
+ * True when the whole slot is erased, a header can read blank over a
+ * payload left by a torn program
+ */
+int gy85_recorder::slot_erased(uint32_t sector, uint32_t slot, bool *erased)
+{
+    uint8_t buffer[GY85_RECORDER_SLOT_SIZE];
+    if (this->storage->read(slot_offset(sector, slot), buffer, sizeof(buffer)) != 0)
+    {
+        return -1;
+    }
+
+    *erased = true;
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        if (buffer[i] != 0xFF)
+        {
+            *erased = false;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int gy85_recorder::read_sector_start(uint32_t sector, gy85_recorder_sector_header_t *sector_header, gy85_recorder_block_header_t *block_header)
+{
+    // Both headers are contiguous, one read
+    uint8_t buffer[sizeof(*sector_header) + sizeof(*block_header)];
+    if (this->storage->read(sector * this->storage->sector_size(), buffer, sizeof(buffer)) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(sector_header, buffer, sizeof(*sector_header));
+    memcpy(block_header, buffer + sizeof(*sector_header), sizeof(*block_header));
+
+    return 0;
+}
+
+/**
+ * Finds the write position back from the newest sector.
+ * Must be called once before anything else, an empty or unformatted
+ * region is a valid empty log.
+ */
+int gy85_recorder::recover(bool read_only)
+{
+    this->read_only = read_only;
+    uint32_t sector_size = this->storage->sector_size();
+
+    if (this->storage->page_size() > GY85_FLASH_PAGE_SIZE ||
+        sector_size < sizeof(gy85_recorder_sector_header_t) + GY85_RECORDER_SLOT_SIZE)
+    {
+        return -1;
+    }
+
+    // One sector is always being recycled, two are the minimum
+    this->sectors = this->storage->size() / sector_size;
+    this->slots_per_sector = (sector_size - sizeof(gy85_recorder_sector_header_t)) / GY85_RECORDER_SLOT_SIZE;
+    if (this->sectors < 2)
+    {
+        this->sectors = 0;
+        return -1;
+    }
+
+    bool found = false;
+    uint32_t newest_sector = 0;
+    uint32_t newest_sequence = 0;
+    this->max_erase_count = 0;
+
+    for (uint32_t sector = 0; sector < this->sectors; sector++)
+    {
+        gy85_recorder_sector_header_t sector_header;
+        gy85_recorder_block_header_t block_header;
+        if (read_sector_start(sector, &sector_header, &block_header) != 0)
+        {
+            this->sectors = 0;
+            return -1;
+        }
+
+        if (!sector_header_valid(&sector_header))
+        {
+            continue;
+        }
+
+        if (sector_header.erase_count > this->max_erase_count)
+        {
+            this->max_erase_count = sector_header.erase_count;
+        }
+
+        // Sequence numbers are compared modulo 2^32
+        if (block_header_valid(&block_header) && (!found || (int32_t)(block_header.sequence - newest_sequence) > 0))
+        {
+            found = true;
+            newest_sector = sector;
+            newest_sequence = block_header.sequence;
+        }
+    }
+
+    this->encoder.start(this->block, GY85_RECORDER_PAYLOAD_SIZE);
+
+    if (!found)
+    {
+        // Empty log, the first append opens sector 0
+        this->head_sector = this->sectors - 1;
+        this->head_slot = this->slots_per_sector;
+        this->sequence = 0;
+        return 0;
+    }
+
+    // Slots are programmed in order, the first blank one is the write position
+    uint32_t low = 1;
+    uint32_t high = this->slots_per_sector;
+    while (low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+
+        gy85_recorder_block_header_t header;
+        if (this->storage->read(slot_offset(newest_sector, mid), (uint8_t *)&header, sizeof(header)) != 0)
+        {
+            this->sectors = 0;
+            return -1;
+        }
+
+        if (block_header_blank(&header))
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    // Only a fully erased slot is reused. A dirty one is retired with a
+    // cleared header, which is not blank, so read_next() and the next
+    // binary search step over it like a torn block. Nothing follows it
+    // yet, an export stops there without retiring it
+    while (!read_only && low < this->slots_per_sector)
+    {
+        bool erased;
+        if (slot_erased(newest_sector, low, &erased) != 0)
+        {
+            this->sectors = 0;
+            return -1;
+        }
+
+        if (erased)
+        {
+            break;
+        }
+
+        gy85_recorder_block_header_t retired;
+        memset(&retired, 0, sizeof(retired));
+        if (program_bytes(slot_offset(newest_sector, low), (const uint8_t *)&retired, sizeof(retired)) != 0)
+        {
+            this->sectors = 0;
+            return -1;
+        }
+        low++;
+    }
+
+    // Every slot consumes a sequence number, even a torn one
+    this->head_sector = newest_sector;
+    this->head_slot = low;
+    this->sequence = newest_sequence + low;
+
+    return 0;
+}
+
+int gy85_recorder::open_next_sector()
+{
+    uint32_t next = (this->head_sector + 1) % this->sectors;
+
+    gy85_recorder_sector_header_t sector_header;
+    gy85_recorder_block_header_t block_header;
+    if (read_sector_start(next, &sector_header, &block_header) != 0)
+    {
+        return -1;
+    }
+
+    // Already erased and formatted before a reset, nothing written yet
+    bool erased = false;
+    if (sector_header_valid(&sector_header) && block_header_blank(&block_header) &&
+        slot_erased(next, 0, &erased) != 0)
+    {
+        return -1;
+    }
+
+    if (erased)
+    {
+        this->head_sector = next;
+        this->head_slot = 0;
+        return 0;
+    }
+
+    // The erase count of a sector without a header is not known, round robin
+    // keeps all sectors within one erase so the highest one is assumed
+    uint32_t erase_count = this->max_erase_count > 0 ? this->max_erase_count : 1;
+    if (sector_header_valid(&sector_header))
+    {
+        erase_count = sector_header.erase_count + 1;
+    }
+
+    if (this->storage->erase(next * this->storage->sector_size()) != 0)
+    {
+        return -1;
+    }
+
+    sector_header.magic = GY85_RECORDER_SECTOR_MAGIC;
+    sector_header.erase_count = erase_count;
+    sector_header.reserved = 0xFFFFFFFF;
+    sector_header.crc = gy85_crc32((const uint8_t *)&sector_header, offsetof(gy85_recorder_sector_header_t, crc));
+
+    if (program_bytes(next * this->storage->sector_size(), (const uint8_t *)&sector_header, sizeof(sector_header)) != 0)
+    {
+        return -1;
+    }
+
+    if (erase_count > this->max_erase_count)
+    {
+        this->max_erase_count = erase_count;
+    }
+
+    this->head_sector = next;
+    this->head_slot = 0;
+
+    return 0;
+}
+
+/**
+ * Writes one block of up to GY85_RECORDER_PAYLOAD_SIZE bytes.
+ * When the log is full the oldest sector is erased to make room.
+ */
+int gy85_recorder::append(const uint8_t *data, uint16_t len)
+{
+    if (this->sectors == 0 || this->read_only || len > GY85_RECORDER_PAYLOAD_SIZE)
+    {
+        return -1;
+    }
+
+    if (this->head_slot >= this->slots_per_sector && open_next_sector() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t slot[GY85_RECORDER_SLOT_SIZE];
+    gy85_recorder_block_header_t header;
+    header.magic = GY85_RECORDER_BLOCK_MAGIC;
+    header.sequence = this->sequence;
+    header.length = len;
+    header.header_crc = block_header_crc(&header);
+    header.crc = gy85_crc32(data, len);
+
+    memcpy(slot, &header, sizeof(header));
+    memcpy(slot + sizeof(header), data, len);
+
+    uint32_t offset = slot_offset(this->head_sector, this->head_slot);
+
+    // The slot is used up whether the program succeeds or not
+    this->head_slot++;
+    this->sequence++;
+
+    if (program_bytes(offset, slot, sizeof(header) + len) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Compresses the record into the pending block, the block is appended
+ * once it is full
+ */
+int gy85_recorder::add(const gy85_raw_record_t &record)
+{
+    if (this->encoder.add(record))
+    {
+        return 0;
+    }
+
+    int res = flush();
+    this->encoder.add(record);
+
+    return res;
+}
+
+/**
+ * Appends the pending block even if it is not full
+ */
+int gy85_recorder::flush()
+{
+    if (this->encoder.get_count() == 0)
+    {
+        return 0;
+    }
+
+    uint16_t len = this->encoder.finish();
+    int res = append(this->block, len);
+    this->encoder.start(this->block, GY85_RECORDER_PAYLOAD_SIZE);
+
+    return res;
+}
+
+/**
+ * Starts an export from the oldest block with a sequence of at least
+ * from_sequence. Recording must not lap the cursor while exporting.
+ */
+void gy85_recorder::begin_export(gy85_recorder_cursor_t *cursor, uint32_t from_sequence)
+{
+    cursor->sector = this->sectors > 0 ? (this->head_sector + 1) % this->sectors : 0;
+    cursor->slot = 0;
+    cursor->from_sequence = from_sequence;
+    cursor->done = this->sectors == 0;
+}
+
+/**
+ * Reads the next valid block into data (GY85_RECORDER_PAYLOAD_SIZE bytes).
+ * Returns 0 when a block was read, -1 at the end of the log or on a
+ * storage error. Torn and corrupted blocks are skipped.
+ */
+int gy85_recorder::read_next(gy85_recorder_cursor_t *cursor, uint8_t *data, uint16_t *len, uint32_t *sequence)
+{
+    while (!cursor->done)
+    {
+        if (cursor->sector == this->head_sector && cursor->slot >= this->head_slot)
+        {
+            cursor->done = true;
+            break;
+        }
+
+        if (cursor->slot >= this->slots_per_sector)
+        {
+            cursor->sector = (cursor->sector + 1) % this->sectors;
+            cursor->slot = 0;
+            continue;
+        }
+
+        if (cursor->slot == 0)
+        {
+            gy85_recorder_sector_header_t sector_header;
+            gy85_recorder_block_header_t block_header;
+            if (read_sector_start(cursor->sector, &sector_header, &block_header) != 0)
+            {
+                cursor->done = true;
+                break;
+            }
+
+            if (!sector_header_valid(&sector_header))
+            {
+                cursor->slot = this->slots_per_sector;
+                continue;
+            }
+        }
+
+        gy85_recorder_block_header_t header;
+        if (this->storage->read(slot_offset(cursor->sector, cursor->slot), (uint8_t *)&header, sizeof(header)) != 0)
+        {
+            cursor->done = true;
+            break;
+        }
+        cursor->slot++;
+
+        if (block_header_blank(&header))
+        {
+            // Nothing was written after a blank slot
+            cursor->slot = this->slots_per_sector;
+            continue;
+        }
+
+        if (!block_header_valid(&header) || (int32_t)(header.sequence - cursor->from_sequence) < 0)
+        {
+            continue;
+        }
+
+        if (this->storage->read(slot_offset(cursor->sector, cursor->slot - 1) + sizeof(header), data, header.length) != 0)
+        {
+            cursor->done = true;
+            break;
+        }
+
+        if (gy85_crc32(data, header.length) != header.crc)
+        {
+            continue;
+        }
+
+        *len = header.length;
+        *sequence = header.sequence;
+        return 0;
+    }
+
+    return -1;
+}
+
+uint32_t gy85_recorder::get_sequence()
+{
+    return this->sequence;
+}
+
+int gy85_recorder::get_wear(uint32_t *min_erases, uint32_t *max_erases)
+{
+    bool found = false;
+    *min_erases = 0;
+    *max_erases = 0;
+
+    for (uint32_t sector = 0; sector < this->sectors; sector++)
+    {
+        gy85_recorder_sector_header_t sector_header;
+        gy85_recorder_block_header_t block_header;
+        if (read_sector_start(sector, &sector_header, &block_header) != 0)
+        {
+            return -1;
+        }
+
+        if (!sector_header_valid(&sector_header))
+        {
+            continue;
+        }
+
+        if (!found || sector_header.erase_count < *min_erases)
+        {
+            *min_erases = sector_header.erase_count;
+        }
+        if (!found || sector_header.erase_count > *max_erases)
+        {
+            *max_erases = sector_header.erase_count;
+        }
+        found = true;
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include "gy85/sampler.hpp"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+gy85_sampler::gy85_sampler(gy85 *sensor, uint8_t sensors)
+{
+    this->sensor = sensor;
+    this->sensors = sensors;
+    this->alarm_id = 0;
+    this->running = false;
+    this->head = 0;
+    this->tail = 0;
+}
+
+int gy85_sampler::start(uint32_t period_us)
+{
+    if (this->running)
+    {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    if (period_us == 0)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    this->head = 0;
+    this->tail = 0;
+    this->schedule.start(time_us_64(), period_us);
+    this->running = true;
+
+    this->alarm_id = add_alarm_at(from_us_since_boot(this->schedule.get_target_us()), gy85_sampler::alarm_callback, this, true);
+    if (this->alarm_id < 0)
+    {
+        this->running = false;
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    return PICO_OK;
+}
+
+int gy85_sampler::stop()
+{
+    if (!this->running)
+    {
+        return PICO_OK;
+    }
+
+    this->running = false;
+    cancel_alarm(this->alarm_id);
+
+    return PICO_OK;
+}
+
+int64_t gy85_sampler::alarm_callback(int32_t id, void *user_data)
+{
+    (void)id;
+    return ((gy85_sampler *)user_data)->on_alarm();
+}
+
+int64_t gy85_sampler::on_alarm()
+{
+    if (!this->running)
+    {
+        return 0;
+    }
+
+    uint64_t now = time_us_64();
+    uint64_t target = this->schedule.get_target_us();
+    uint64_t next = this->schedule.fire(now);
+
+    gy85_sample_t *sample = &this->queue[this->head & (GY85_SAMPLER_QUEUE - 1)];
+    bool full = this->head - this->tail >= GY85_SAMPLER_QUEUE;
+    gy85_sample_t dropped;
+    if (full)
+    {
+        // Still read, so the decimating filters see every sample
+        sample = &dropped;
+    }
+
+    sample->timestamp_us = now;
+    sample->sequence = this->schedule.get_index();
+    sample->sensors = 0;
+
+    // PICO_ERROR_NO_DATA is a sample absorbed by a decimating filter
+    int res;
+    bool error = false;
+    if (this->sensors & GY85_SAMPLE_ACCEL)
+    {
+        res = this->sensor->read_adxl345(&sample->accel);
+        sample->sensors |= res == PICO_OK ? GY85_SAMPLE_ACCEL : 0;
+        error |= res != PICO_OK && res != PICO_ERROR_NO_DATA;
+    }
+
+    if (this->sensors & GY85_SAMPLE_GYRO)
+    {
+        res = this->sensor->read_itg3205(&sample->gyro);
+        sample->sensors |= res == PICO_OK ? GY85_SAMPLE_GYRO : 0;
+        error |= res != PICO_OK && res != PICO_ERROR_NO_DATA;
+    }
+
+    if (this->sensors & GY85_SAMPLE_MAG)
+    {
+        res = this->sensor->read_qmc5883l(&sample->mag);
+        sample->sensors |= res == PICO_OK ? GY85_SAMPLE_MAG : 0;
+        error |= res != PICO_OK && res != PICO_ERROR_NO_DATA;
+    }
+
+    if (error)
+    {
+        this->schedule.record_error();
+    }
+
+    if (sample->sensors != 0)
+    {
+        if (full)
+        {
+            this->schedule.record_dropped();
+        }
+        else
+        {
+            // Publish the sample before moving the head
+            __dmb();
+            this->head++;
+        }
+    }
+
+    // Negative means relative to the previous target, so no drift builds up
+    return -(int64_t)(next - target);
+}
+
+bool gy85_sampler::pop(gy85_sample_t *sample)
+{
+    if (this->tail == this->head)
+    {
+        return false;
+    }
+
+    __dmb();
+    *sample = this->queue[this->tail & (GY85_SAMPLER_QUEUE - 1)];
+    __dmb();
+    this->tail++;
+
+    return true;
+}
+
+uint32_t gy85_sampler::available()
+{
+    return this->head - this->tail;
+}
+
+int gy85_sampler::get_stats(gy85_sampler_stats_t *stats)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    this->schedule.get_stats(stats);
+    restore_interrupts(ints);
+
+    return PICO_OK;
+}
+
+int gy85_sampler::reset_stats()
+{
+    uint32_t ints = save_and_disable_interrupts();
+    this->schedule.reset_stats();
+    restore_interrupts(ints);
+
+    return PICO_OK;
+}
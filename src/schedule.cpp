@@ -0,0 +1,120 @@
+#include "gy85/sampler.hpp"
+#include <string.h>
+
+gy85_schedule::gy85_schedule()
+{
+    this->start(0, 1);
+}
+
+void gy85_schedule::start(uint64_t now_us, uint32_t period_us)
+{
+    this->period_us = period_us;
+    this->target_us = now_us + period_us;
+    this->last_fire_us = 0;
+    this->index = 0;
+    this->fired = false;
+
+    this->reset_stats();
+}
+
+uint64_t gy85_schedule::get_target_us()
+{
+    return this->target_us;
+}
+
+uint32_t gy85_schedule::get_index()
+{
+    // Index of the period that fired last
+    return this->index - 1;
+}
+
+uint64_t gy85_schedule::fire(uint64_t now_us)
+{
+    // Whole periods that already went by are skipped, not queued up
+    if (now_us >= this->target_us + this->period_us)
+    {
+        uint32_t skip = (now_us - this->target_us) / this->period_us;
+        this->target_us += (uint64_t)skip * this->period_us;
+        this->index += skip;
+        this->stats.missed += skip;
+    }
+
+    uint32_t latency = now_us > this->target_us ? now_us - this->target_us : 0;
+    if (latency > this->stats.latency_max_us)
+    {
+        this->stats.latency_max_us = latency;
+    }
+
+    if (this->fired)
+    {
+        // Actual interval against the nominal one, including skipped periods
+        int64_t expected = (int64_t)this->period_us * (this->index - this->last_index);
+        int32_t error = (int32_t)((int64_t)(now_us - this->last_fire_us) - expected);
+
+        if (error < this->stats.period_error_min_us)
+        {
+            this->stats.period_error_min_us = error;
+        }
+        if (error > this->stats.period_error_max_us)
+        {
+            this->stats.period_error_max_us = error;
+        }
+
+        uint32_t bin = (error < 0 ? -error : error) / GY85_SAMPLER_JITTER_BIN_US;
+        this->jitter_bins[bin < GY85_SAMPLER_JITTER_BINS ? bin : GY85_SAMPLER_JITTER_BINS - 1]++;
+    }
+
+    this->fired = true;
+    this->last_fire_us = now_us;
+    this->last_index = this->index;
+    this->stats.periods++;
+
+    this->index++;
+    this->target_us += this->period_us;
+
+    return this->target_us;
+}
+
+void gy85_schedule::record_dropped()
+{
+    this->stats.dropped++;
+}
+
+void gy85_schedule::record_error()
+{
+    this->stats.errors++;
+}
+
+void gy85_schedule::get_stats(gy85_sampler_stats_t *stats)
+{
+    *stats = this->stats;
+
+    // p99 from the histogram, reported as the upper edge of its bin
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < GY85_SAMPLER_JITTER_BINS; i++)
+    {
+        total += this->jitter_bins[i];
+    }
+
+    uint32_t threshold = total - total / 100;
+    uint32_t count = 0;
+    stats->period_error_p99_us = 0;
+    for (uint32_t i = 0; i < GY85_SAMPLER_JITTER_BINS && total > 0; i++)
+    {
+        count += this->jitter_bins[i];
+        if (count >= threshold)
+        {
+            stats->period_error_p99_us = (i + 1) * GY85_SAMPLER_JITTER_BIN_US;
+            break;
+        }
+    }
+}
+
+void gy85_schedule::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(this->stats));
+    memset(this->jitter_bins, 0, sizeof(this->jitter_bins));
+
+    this->stats.period_error_min_us = INT32_MAX;
+    this->stats.period_error_max_us = INT32_MIN;
+}
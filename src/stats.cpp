@@ -0,0 +1,182 @@
+#include "gy85/stats.hpp"
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+static const char *sensor_names[SENSOR_COUNT] = {
+    "adxl345",
+    "itg3205",
+    "qmc5883l",
+};
+
+static const char *op_names[OP_COUNT] = {
+    "read",
+    "read_adxl345",
+    "read_itg3205",
+    "read_qmc5883l",
+    "set_adxl345_range",
+    "set_adxl345_data_rate",
+    "set_adxl345_interrupt",
+    "set_adxl345_fifo_mode",
+    "set_adxl345_sleep",
+    "set_itg3205_sample_rate_div",
+    "set_itg3205_dlpf_fs",
+    "set_itg3205_fs",
+    "set_itg3205_dlpf",
+    "set_itg3205_interrupt",
+    "set_itg3205_sleep",
+    "set_qmc5883l_ctrl",
+    "set_qmc5883l_mode",
+    "set_qmc5883l_scale",
+    "set_qmc5883l_output_rate",
+    "set_qmc5883l_over_sample",
+    "set_qmc5883l_interrupt",
+    "set_qmc5883l_sleep",
+};
+
+void gy85_stats_reset(gy85_stats_t *stats)
+{
+    memset(stats, 0, sizeof(gy85_stats_t));
+
+    stats->magic = GY85_STATS_MAGIC;
+    stats->version = GY85_STATS_VERSION;
+    stats->sensor_count = SENSOR_COUNT;
+    stats->bus_error_count = BUS_ERROR_COUNT;
+    stats->op_count = OP_COUNT;
+    stats->bucket_count = GY85_STATS_BUCKETS;
+}
+
+void gy85_stats_record_transfer(gy85_stats_t *stats, gy85_sensor_t sensor, uint32_t bytes_read, uint32_t bytes_written, int result)
+{
+    gy85_bus_stats_t *bus = &stats->bus[sensor];
+
+    bus->transactions++;
+
+    if (result == PICO_OK)
+    {
+        bus->bytes_read += bytes_read;
+        bus->bytes_written += bytes_written;
+        return;
+    }
+
+    switch (result)
+    {
+    case PICO_ERROR_GENERIC:
+        bus->errors[BUS_ERROR_NACK]++;
+        break;
+    case PICO_ERROR_TIMEOUT:
+        bus->errors[BUS_ERROR_TIMEOUT]++;
+        break;
+    case PICO_ERROR_IO:
+        bus->errors[BUS_ERROR_SHORT]++;
+        break;
+    case PICO_ERROR_INVALID_ARG:
+        bus->errors[BUS_ERROR_INVALID]++;
+        break;
+    default:
+        bus->errors[BUS_ERROR_OTHER]++;
+        break;
+    }
+}
+
+void gy85_stats_record_latency(gy85_stats_t *stats, gy85_op_t op, uint32_t us)
+{
+    gy85_latency_record(&stats->ops[op], us);
+}
+
+void gy85_latency_record(gy85_latency_stats_t *latency, uint32_t us)
+{
+    uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= GY85_STATS_BUCKETS)
+    {
+        bucket = GY85_STATS_BUCKETS - 1;
+    }
+
+    latency->count++;
+    latency->buckets[bucket]++;
+    if (us > latency->max_us)
+    {
+        latency->max_us = us;
+    }
+}
+
+int gy85_stats_format(const gy85_stats_t *stats, char *buffer, size_t len)
+{
+    size_t used = 0;
+    int n;
+
+// Appends to buffer, fails once it is full
+#define STATS_APPEND(...)                                           \
+    n = snprintf(buffer + used, len - used, __VA_ARGS__);           \
+    if (n < 0 || (size_t)n >= len - used)                           \
+    {                                                               \
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;                   \
+    }                                                               \
+    used += n;
+
+    if (len == 0)
+    {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    buffer[0] = '\0';
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        const gy85_bus_stats_t *bus = &stats->bus[i];
+        STATS_APPEND("%s tx=%lu rd=%lu wr=%lu nack=%lu timeout=%lu short=%lu invalid=%lu other=%lu\n",
+                     sensor_names[i],
+                     (unsigned long)bus->transactions,
+                     (unsigned long)bus->bytes_read,
+                     (unsigned long)bus->bytes_written,
+                     (unsigned long)bus->errors[BUS_ERROR_NACK],
+                     (unsigned long)bus->errors[BUS_ERROR_TIMEOUT],
+                     (unsigned long)bus->errors[BUS_ERROR_SHORT],
+                     (unsigned long)bus->errors[BUS_ERROR_INVALID],
+                     (unsigned long)bus->errors[BUS_ERROR_OTHER]);
+    }
+
+    // Unused operations are skipped
+    for (uint8_t i = 0; i < OP_COUNT; i++)
+    {
+        const gy85_latency_stats_t *latency = &stats->ops[i];
+        if (latency->count == 0)
+        {
+            continue;
+        }
+
+        STATS_APPEND("%s n=%lu max=%luus log2us=", op_names[i], (unsigned long)latency->count, (unsigned long)latency->max_us);
+        for (uint8_t b = 0; b < GY85_STATS_BUCKETS; b++)
+        {
+            STATS_APPEND(b == 0 ? "%lu" : ",%lu", (unsigned long)latency->buckets[b]);
+        }
+        STATS_APPEND("\n");
+    }
+
+#undef STATS_APPEND
+
+    return (int)used;
+}
+
+int gy85_stats_serialize(const gy85_stats_t *stats, uint8_t *buffer, size_t len)
+{
+    if (len < sizeof(gy85_stats_t))
+    {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    memcpy(buffer, stats, sizeof(gy85_stats_t));
+
+    return (int)sizeof(gy85_stats_t);
+}
+
+gy85_stats_scope::gy85_stats_scope(gy85_stats_t *stats, gy85_op_t op)
+{
+    this->stats = stats;
+    this->op = op;
+    this->start_us = time_us_32();
+}
+
+gy85_stats_scope::~gy85_stats_scope()
+{
+    gy85_stats_record_latency(this->stats, this->op, time_us_32() - this->start_us);
+}
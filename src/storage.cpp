@@ -0,0 +1,82 @@
+#include "gy85/storage.hpp"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+typedef struct
+{
+    uint32_t flash_offset;
+    const uint8_t *data;
+    uint32_t len;
+} flash_op_t;
+
+static void flash_erase_op(void *param)
+{
+    const flash_op_t *op = (const flash_op_t *)param;
+    flash_range_erase(op->flash_offset, op->len);
+}
+
+static void flash_program_op(void *param)
+{
+    const flash_op_t *op = (const flash_op_t *)param;
+    flash_range_program(op->flash_offset, op->data, op->len);
+}
+
+gy85_flash_storage::gy85_flash_storage(uint32_t flash_offset, uint32_t region_size)
+{
+    this->flash_offset = flash_offset;
+    this->region_size = region_size;
+}
+
+uint32_t gy85_flash_storage::size()
+{
+    return this->region_size;
+}
+
+uint32_t gy85_flash_storage::sector_size()
+{
+    return FLASH_SECTOR_SIZE;
+}
+
+uint32_t gy85_flash_storage::page_size()
+{
+    return FLASH_PAGE_SIZE;
+}
+
+int gy85_flash_storage::read(uint32_t offset, uint8_t *buffer, uint32_t len)
+{
+    if (offset + len > this->region_size)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Flash is memory mapped through XIP
+    memcpy(buffer, (const uint8_t *)(XIP_BASE + this->flash_offset + offset), len);
+
+    return PICO_OK;
+}
+
+int gy85_flash_storage::erase(uint32_t offset)
+{
+    if (offset % FLASH_SECTOR_SIZE != 0 || offset + FLASH_SECTOR_SIZE > this->region_size)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // No code may run from flash while it is being erased, on either core:
+    // interrupts are disabled here and core 1 is parked in RAM
+    flash_op_t op = {this->flash_offset + offset, NULL, FLASH_SECTOR_SIZE};
+    return flash_safe_execute(flash_erase_op, &op, GY85_FLASH_LOCKOUT_TIMEOUT_MS);
+}
+
+int gy85_flash_storage::program(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    if (offset % FLASH_PAGE_SIZE != 0 || len % FLASH_PAGE_SIZE != 0 || offset + len > this->region_size)
+    {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    flash_op_t op = {this->flash_offset + offset, data, len};
+    return flash_safe_execute(flash_program_op, &op, GY85_FLASH_LOCKOUT_TIMEOUT_MS);
+}
@@ -0,0 +1,73 @@
+#include "gy85/trace.hpp"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+static_assert((GY85_TRACE_ENTRIES & (GY85_TRACE_ENTRIES - 1)) == 0, "GY85_TRACE_ENTRIES must be a power of two");
+
+// Not cleared by the runtime, so the previous boot's entries can be dumped
+static gy85_trace_t __uninitialized_ram(gy85_trace_ring);
+static bool gy85_trace_initialised = false;
+
+void gy85_trace_init()
+{
+    if (gy85_trace_initialised)
+    {
+        return;
+    }
+    gy85_trace_initialised = true;
+
+    if (gy85_trace_ring.magic == GY85_TRACE_MAGIC &&
+        gy85_trace_ring.magic_check == ~(uint32_t)GY85_TRACE_MAGIC &&
+        gy85_trace_ring.version == GY85_TRACE_VERSION &&
+        gy85_trace_ring.entry_count == GY85_TRACE_ENTRIES)
+    {
+        // Survived a reset, mark the boundary and keep appending
+        gy85_trace_record(0, 0, 0, GY85_TRACE_BOOT, PICO_OK, time_us_32());
+        return;
+    }
+
+    memset(&gy85_trace_ring, 0, sizeof(gy85_trace_ring));
+    gy85_trace_ring.magic = GY85_TRACE_MAGIC;
+    gy85_trace_ring.version = GY85_TRACE_VERSION;
+    gy85_trace_ring.entry_count = GY85_TRACE_ENTRIES;
+    gy85_trace_ring.magic_check = ~(uint32_t)GY85_TRACE_MAGIC;
+}
+
+void gy85_trace_record(uint8_t addr, uint8_t reg, uint8_t len, uint8_t flags, int result, uint32_t start_us)
+{
+    uint32_t duration = time_us_32() - start_us;
+
+    // The sampler records from its alarm interrupt, the slot and the entry
+    // are taken with interrupts off so a thread context record is not torn
+    uint32_t ints = save_and_disable_interrupts();
+    gy85_trace_entry_t *entry = &gy85_trace_ring.entries[gy85_trace_ring.head++ & (GY85_TRACE_ENTRIES - 1)];
+
+    // Distances modulo 2^32, valid across the wrap of head
+    if (gy85_trace_ring.head - gy85_trace_ring.first > GY85_TRACE_ENTRIES)
+    {
+        gy85_trace_ring.first = gy85_trace_ring.head - GY85_TRACE_ENTRIES;
+    }
+
+    entry->timestamp_us = start_us;
+    entry->duration_us = duration > UINT16_MAX ? UINT16_MAX : duration;
+    entry->addr = addr;
+    entry->reg = reg;
+    entry->len = len;
+    entry->flags = flags;
+    entry->result = result;
+    entry->reserved = 0;
+    restore_interrupts(ints);
+}
+
+int gy85_trace_dump(uint8_t *buffer, size_t len)
+{
+    if (len < sizeof(gy85_trace_t))
+    {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    memcpy(buffer, &gy85_trace_ring, sizeof(gy85_trace_t));
+
+    return (int)sizeof(gy85_trace_t);
+}
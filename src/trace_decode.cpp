@@ -0,0 +1,52 @@
+#include "gy85/trace.hpp"
+#include <string.h>
+
+/**
+ * Copies the entries of a dump in chronological order.
+ * Returns the number of entries, or -1 if the dump is not valid.
+ * first_sequence receives the sequence number of the oldest entry.
+ */
+int gy85_trace_decode(const uint8_t *dump, size_t len, gy85_trace_entry_t *entries, size_t max_entries, uint32_t *first_sequence)
+{
+    gy85_trace_t ring;
+
+    if (len < sizeof(gy85_trace_t))
+    {
+        return -1;
+    }
+    memcpy(&ring, dump, sizeof(gy85_trace_t));
+
+    if (ring.magic != GY85_TRACE_MAGIC ||
+        ring.magic_check != ~(uint32_t)GY85_TRACE_MAGIC ||
+        ring.version != GY85_TRACE_VERSION ||
+        ring.entry_count != GY85_TRACE_ENTRIES)
+    {
+        return -1;
+    }
+
+    // Modulo 2^32, head wraps after 2^32 transactions
+    uint32_t count = ring.head - ring.first;
+    uint32_t first = ring.first;
+    if (count > GY85_TRACE_ENTRIES)
+    {
+        return -1;
+    }
+
+    if (count > max_entries)
+    {
+        first += count - max_entries;
+        count = max_entries;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        entries[i] = ring.entries[(first + i) & (GY85_TRACE_ENTRIES - 1)];
+    }
+
+    if (first_sequence != NULL)
+    {
+        *first_sequence = first;
+    }
+
+    return (int)count;
+}
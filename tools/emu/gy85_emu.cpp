@@ -0,0 +1,1056 @@
+#include "gy85_emu.hpp"
+#include "gy85/gy85.hpp"
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#define EMU_GRAVITY (9.80665)
+#define EMU_ADXL345_OFFSET_G (0.0156) ///< OFSx scale, 15.6mg per lsb
+#define EMU_ITG3205_TEMP_C (25.0)
+
+static uint64_t now_ns = 0;
+static bool interrupts_enabled = true;
+static bool in_interrupt = false;
+
+typedef struct
+{
+    alarm_callback_t callback;
+    void *user_data;
+    uint64_t at_us;
+    bool active;
+} emu_alarm_t;
+
+static emu_alarm_t alarms[GY85_EMU_ALARMS];
+
+/**
+ * Runs the due alarm callbacks as the timer interrupt would, unless
+ * interrupts are masked or one is already running. Called wherever the
+ * virtual clock moves, so an alarm can fire in the middle of a transfer.
+ */
+static void run_alarms()
+{
+    if (!interrupts_enabled || in_interrupt)
+    {
+        return;
+    }
+
+    in_interrupt = true;
+    for (;;)
+    {
+        emu_alarm_t *due = nullptr;
+        for (uint32_t i = 0; i < GY85_EMU_ALARMS; i++)
+        {
+            if (alarms[i].active && alarms[i].at_us <= now_ns / 1000 && (due == nullptr || alarms[i].at_us < due->at_us))
+            {
+                due = &alarms[i];
+            }
+        }
+        if (due == nullptr)
+        {
+            break;
+        }
+
+        int64_t res = due->callback((alarm_id_t)(due - alarms) + 1, due->user_data);
+
+        // Negative reschedules from the previous target, positive from now
+        if (!due->active || res == 0)
+        {
+            due->active = false;
+        }
+        else if (res < 0)
+        {
+            due->at_us += -res;
+        }
+        else
+        {
+            due->at_us = now_ns / 1000 + res;
+        }
+    }
+    in_interrupt = false;
+}
+
+/**
+ * Moves the clock, a due alarm fires at its time within the step rather
+ * than at the end of it
+ */
+static void advance_ns(uint64_t ns)
+{
+    uint64_t target_ns = now_ns + ns;
+
+    while (interrupts_enabled && !in_interrupt)
+    {
+        emu_alarm_t *next = nullptr;
+        for (uint32_t i = 0; i < GY85_EMU_ALARMS; i++)
+        {
+            if (alarms[i].active && (next == nullptr || alarms[i].at_us < next->at_us))
+            {
+                next = &alarms[i];
+            }
+        }
+        if (next == nullptr || next->at_us * 1000 > target_ns)
+        {
+            break;
+        }
+
+        if (next->at_us * 1000 > now_ns)
+        {
+            now_ns = next->at_us * 1000;
+        }
+        run_alarms();
+    }
+
+    // The interrupt may have run past the end of the step
+    if (target_ns > now_ns)
+    {
+        now_ns = target_ns;
+    }
+}
+
+/**
+ * Virtual clock and the pico/stdlib.h host shim
+ */
+
+uint64_t gy85_emu_time_us()
+{
+    return now_ns / 1000;
+}
+
+void gy85_emu_advance_us(uint64_t us)
+{
+    advance_ns(us * 1000);
+}
+
+void gy85_emu_reset_time()
+{
+    now_ns = 0;
+}
+
+bool gy85_emu_in_interrupt()
+{
+    return in_interrupt;
+}
+
+uint32_t time_us_32()
+{
+    return (uint32_t)(now_ns / 1000);
+}
+
+uint64_t time_us_64()
+{
+    return now_ns / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+    advance_ns(us * 1000);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    advance_ns((uint64_t)ms * 1000000);
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)fire_if_past;
+    for (uint32_t i = 0; i < GY85_EMU_ALARMS; i++)
+    {
+        if (!alarms[i].active)
+        {
+            alarms[i] = {callback, user_data, time, true};
+            run_alarms();
+            return (alarm_id_t)i + 1;
+        }
+    }
+
+    return PICO_ERROR_INSUFFICIENT_RESOURCES;
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    if (alarm_id < 1 || alarm_id > GY85_EMU_ALARMS || !alarms[alarm_id - 1].active)
+    {
+        return false;
+    }
+
+    alarms[alarm_id - 1].active = false;
+    return true;
+}
+
+// PRIMASK, 1 when masked. A due alarm fires once they are enabled again.
+uint32_t save_and_disable_interrupts()
+{
+    uint32_t status = interrupts_enabled ? 0 : 1;
+    interrupts_enabled = false;
+    return status;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    interrupts_enabled = status == 0;
+    run_alarms();
+}
+
+// Nothing answers when no emulator is installed
+static int no_bus_write(void *, uint8_t, uint8_t, const uint8_t *, size_t, bool)
+{
+    return PICO_ERROR_GENERIC;
+}
+
+static int no_bus_read(void *, uint8_t, uint8_t, uint8_t *, size_t, bool)
+{
+    return PICO_ERROR_GENERIC;
+}
+
+static const gy85_bus_ops_t no_bus_ops = {no_bus_write, no_bus_read, nullptr};
+
+const gy85_bus_ops_t *gy85_default_bus_ops()
+{
+    return &no_bus_ops;
+}
+
+/**
+ * Quaternion helpers, [w, x, y, z], body to navigation
+ */
+
+static void quat_mul(const double a[4], const double b[4], double out[4])
+{
+    double r[4];
+    r[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+    r[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+    r[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+    r[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+    memcpy(out, r, sizeof(r));
+}
+
+static void quat_exp(const double rate[3], double dt, double out[4])
+{
+    double norm = sqrt(rate[0] * rate[0] + rate[1] * rate[1] + rate[2] * rate[2]);
+    double half = 0.5 * norm * dt;
+    if (norm < 1e-12)
+    {
+        out[0] = 1.0;
+        out[1] = out[2] = out[3] = 0.0;
+        return;
+    }
+
+    double s = sin(half) / norm;
+    out[0] = cos(half);
+    out[1] = rate[0] * s;
+    out[2] = rate[1] * s;
+    out[3] = rate[2] * s;
+}
+
+// Navigation to body, R^T v
+static void rotate_to_body(const double q[4], const double v[3], double out[3])
+{
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y + w * z) * v[1] + 2 * (x * z - w * y) * v[2];
+    out[1] = 2 * (x * y - w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z + w * x) * v[2];
+    out[2] = 2 * (x * z + w * y) * v[0] + 2 * (y * z - w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+static int16_t saturate(double value, int32_t max, bool *clipped)
+{
+    double rounded = floor(value + 0.5);
+    if (rounded > max)
+    {
+        *clipped = true;
+        return max;
+    }
+    if (rounded < -max - 1)
+    {
+        *clipped = true;
+        return -max - 1;
+    }
+    return (int16_t)rounded;
+}
+
+/**
+ * Script
+ */
+
+gy85_emu_script::gy85_emu_script()
+{
+    this->count = 0;
+    this->current = 0;
+    this->start_s[0] = 0.0;
+    this->attitude[0][0] = 1.0;
+    this->attitude[0][1] = this->attitude[0][2] = this->attitude[0][3] = 0.0;
+
+    // 0.5 Gauss, 60 degrees inclination
+    this->field[0] = 0.25;
+    this->field[1] = 0.0;
+    this->field[2] = -0.433;
+}
+
+int gy85_emu_script::add(const gy85_emu_segment_t &segment)
+{
+    if (this->count >= GY85_EMU_MAX_SEGMENTS || segment.duration_s <= 0.0)
+    {
+        return -1;
+    }
+
+    double step[4];
+    quat_exp(segment.rate, segment.duration_s, step);
+
+    this->segments[this->count] = segment;
+    quat_mul(this->attitude[this->count], step, this->attitude[this->count + 1]);
+    this->start_s[this->count + 1] = this->start_s[this->count] + segment.duration_s;
+    this->count++;
+
+    return 0;
+}
+
+void gy85_emu_script::set_field(const double field[3])
+{
+    memcpy(this->field, field, sizeof(this->field));
+}
+
+double gy85_emu_script::get_duration_s()
+{
+    return this->start_s[this->count];
+}
+
+void gy85_emu_script::evaluate(double t_s, gy85_emu_truth_t *truth)
+{
+    static const double zero[3] = {0.0, 0.0, 0.0};
+    const double *rate = zero;
+    const double *accel = zero;
+    double q[4];
+
+    if (t_s < 0.0)
+    {
+        t_s = 0.0;
+    }
+
+    if (t_s >= this->start_s[this->count])
+    {
+        // Still after the end
+        memcpy(q, this->attitude[this->count], sizeof(q));
+    }
+    else
+    {
+        // Time mostly moves forward, start from the last segment used
+        while (this->current > 0 && t_s < this->start_s[this->current])
+        {
+            this->current--;
+        }
+        while (t_s >= this->start_s[this->current + 1])
+        {
+            this->current++;
+        }
+
+        const gy85_emu_segment_t *segment = &this->segments[this->current];
+        double step[4];
+        quat_exp(segment->rate, t_s - this->start_s[this->current], step);
+        quat_mul(this->attitude[this->current], step, q);
+        rate = segment->rate;
+        accel = segment->accel;
+    }
+
+    double specific[3] = {accel[0], accel[1], accel[2] + EMU_GRAVITY};
+    rotate_to_body(q, specific, truth->accel);
+    rotate_to_body(q, this->field, truth->mag);
+    memcpy(truth->rate, rate, sizeof(truth->rate));
+}
+
+/**
+ * Register file
+ */
+
+gy85_emu_device::gy85_emu_device(gy85_emu *emu, uint8_t addr)
+{
+    this->emu = emu;
+    this->addr = addr;
+    this->pointer = 0;
+    this->transfers = 0;
+    memset(this->regs, 0, sizeof(this->regs));
+}
+
+void gy85_emu_device::write_reg(uint8_t reg, uint8_t value)
+{
+    this->regs[reg] = value;
+}
+
+uint8_t gy85_emu_device::next_pointer(uint8_t reg)
+{
+    return reg + 1;
+}
+
+// Nothing latched by default
+void gy85_emu_device::end_read(uint8_t, uint8_t)
+{
+}
+
+int gy85_emu_device::write(const uint8_t *data, size_t len)
+{
+    this->transfers++;
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    update(now_ns);
+
+    // First byte is the register pointer, the rest auto-increments
+    this->pointer = data[0];
+    for (size_t i = 1; i < len; i++)
+    {
+        write_reg(this->pointer, data[i]);
+        this->pointer = next_pointer(this->pointer);
+    }
+
+    return len;
+}
+
+int gy85_emu_device::read(uint8_t *data, size_t len)
+{
+    this->transfers++;
+    update(now_ns);
+
+    // Registers stay put during the transfer, so multi-byte reads are coherent
+    uint8_t first = this->pointer;
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = this->regs[this->pointer];
+        this->pointer = next_pointer(this->pointer);
+    }
+
+    end_read(first, len > 0xFF ? 0xFF : len);
+
+    return len;
+}
+
+static bool covers(uint8_t first, uint8_t count, uint8_t lo, uint8_t hi)
+{
+    return count > 0 && first <= hi && first + count - 1 >= lo;
+}
+
+/**
+ * ADXL345
+ */
+
+gy85_emu_adxl345::gy85_emu_adxl345(gy85_emu *emu, uint8_t addr) : gy85_emu_device(emu, addr)
+{
+    // ~400ug/sqrt(Hz) typical
+    memset(&this->error, 0, sizeof(this->error));
+    this->error.noise_density = 400e-6 * EMU_GRAVITY;
+
+    reset();
+}
+
+void gy85_emu_adxl345::reset()
+{
+    memset(this->regs, 0, sizeof(this->regs));
+    this->regs[ADXL345_REG_DEVID] = ADXL345_ID;
+    this->regs[ADXL345_REG_BW_RATE] = DATARATE_100_HZ;
+
+    this->measuring = false;
+    this->origin_ns = 0;
+    this->emitted = 0;
+    this->fifo_head = 0;
+    this->fifo_count = 0;
+    memset(this->output, 0, sizeof(this->output));
+    this->data_ready = false;
+    this->overrun = false;
+
+    load_output();
+    refresh();
+}
+
+void gy85_emu_adxl345::restart(uint64_t now_ns)
+{
+    this->origin_ns = now_ns;
+    this->emitted = 0;
+}
+
+void gy85_emu_adxl345::sample(double t_s, int16_t counts[3])
+{
+    gy85_emu_truth_t truth;
+    this->emu->trajectory->evaluate(t_s, &truth);
+
+    uint8_t format = this->regs[ADXL345_REG_DATA_FORMAT];
+    uint8_t range = format & 0x03;
+    bool full_res = format & 0x08;
+    uint8_t rate = this->regs[ADXL345_REG_BW_RATE] & 0x0F;
+
+    // Output bandwidth is half the data rate
+    double sigma = this->error.noise_density * sqrt(3200.0 / (1 << (15 - rate)) / 2.0);
+    double lsb = full_res ? ADXL345_SCALE_FACTOR : ADXL345_SCALE_FACTOR * (1 << range);
+    uint8_t bits = full_res ? 10 + range : 10;
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        double value = truth.accel[i] + this->error.bias[i] + sigma * this->emu->gaussian();
+        double g = value / EMU_GRAVITY + (int8_t)this->regs[ADXL345_REG_OFSX + i] * EMU_ADXL345_OFFSET_G;
+
+        bool clipped = false;
+        counts[i] = saturate(g / lsb, (1 << (bits - 1)) - 1, &clipped);
+
+        // Left justified
+        if (format & 0x04)
+        {
+            counts[i] = (int16_t)((uint16_t)counts[i] << (16 - bits));
+        }
+    }
+}
+
+void gy85_emu_adxl345::push(const int16_t counts[3])
+{
+    // Stream mode keeps the newest entries
+    if (this->fifo_count == GY85_EMU_ADXL345_FIFO)
+    {
+        this->fifo_head = (this->fifo_head + 1) % GY85_EMU_ADXL345_FIFO;
+        this->fifo_count--;
+        this->overrun = true;
+    }
+
+    uint8_t slot = (this->fifo_head + this->fifo_count) % GY85_EMU_ADXL345_FIFO;
+    memcpy(this->fifo[slot], counts, sizeof(this->fifo[slot]));
+    this->fifo_count++;
+}
+
+void gy85_emu_adxl345::load_output()
+{
+    uint8_t mode = this->regs[ADXL345_REG_FIFO_CTL] >> 6;
+    if (mode != FIFO_BYPASS && this->fifo_count > 0)
+    {
+        memcpy(this->output, this->fifo[this->fifo_head], sizeof(this->output));
+    }
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        this->regs[ADXL345_REG_DATAX0 + 2 * i] = (uint16_t)this->output[i] & 0xFF;
+        this->regs[ADXL345_REG_DATAX1 + 2 * i] = (uint16_t)this->output[i] >> 8;
+    }
+}
+
+void gy85_emu_adxl345::refresh()
+{
+    uint8_t mode = this->regs[ADXL345_REG_FIFO_CTL] >> 6;
+    uint8_t watermark = this->regs[ADXL345_REG_FIFO_CTL] & 0x1F;
+
+    if (mode != FIFO_BYPASS)
+    {
+        this->data_ready = this->fifo_count > 0;
+    }
+
+    this->regs[ADXL345_REG_INT_SOURCE] = (this->data_ready ? 0x80 : 0) | (this->fifo_count >= watermark ? 0x02 : 0) | (this->overrun ? 0x01 : 0);
+    this->regs[ADXL345_REG_FIFO_STATUS] = this->fifo_count;
+}
+
+void gy85_emu_adxl345::update(uint64_t now_ns)
+{
+    if (!this->measuring || now_ns < this->origin_ns)
+    {
+        return;
+    }
+
+    uint8_t rate = this->regs[ADXL345_REG_BW_RATE] & 0x0F;
+    uint64_t period_ns = 1000000000ull * (1 << (15 - rate)) / 3200;
+    uint64_t due = (now_ns - this->origin_ns) / period_ns;
+    uint64_t missed = due - this->emitted;
+    if (missed == 0)
+    {
+        return;
+    }
+
+    uint8_t mode = this->regs[ADXL345_REG_FIFO_CTL] >> 6;
+    uint64_t first, last;
+    if (mode == FIFO_BYPASS)
+    {
+        // Only the newest sample is visible, anything unread before is lost
+        this->overrun |= this->data_ready || missed > 1;
+        first = due;
+        last = due;
+    }
+    else if (mode == FIFO_FIFO)
+    {
+        // Collection stops once full
+        uint8_t space = GY85_EMU_ADXL345_FIFO - this->fifo_count;
+        first = this->emitted + 1;
+        last = this->emitted + (missed < space ? missed : space);
+        this->overrun |= missed > space;
+    }
+    else
+    {
+        // Stream, trigger events are not modelled
+        this->overrun |= missed + this->fifo_count > GY85_EMU_ADXL345_FIFO;
+        first = missed > GY85_EMU_ADXL345_FIFO ? due - GY85_EMU_ADXL345_FIFO + 1 : this->emitted + 1;
+        last = due;
+    }
+
+    for (uint64_t k = first; k <= last; k++)
+    {
+        int16_t counts[3];
+        sample((this->origin_ns + k * period_ns) * 1e-9, counts);
+
+        if (mode == FIFO_BYPASS)
+        {
+            memcpy(this->output, counts, sizeof(this->output));
+            this->data_ready = true;
+        }
+        else
+        {
+            push(counts);
+        }
+    }
+
+    this->emitted = due;
+    load_output();
+    refresh();
+}
+
+void gy85_emu_adxl345::write_reg(uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case ADXL345_REG_DEVID:
+    case ADXL345_REG_ACT_TAP_STATUS:
+    case ADXL345_REG_INT_SOURCE:
+    case ADXL345_REG_DATAX0:
+    case ADXL345_REG_DATAX1:
+    case ADXL345_REG_DATAY0:
+    case ADXL345_REG_DATAY1:
+    case ADXL345_REG_DATAZ0:
+    case ADXL345_REG_DATAZ1:
+    case ADXL345_REG_FIFO_STATUS:
+        // Read only
+        return;
+
+    case ADXL345_REG_BW_RATE:
+        this->regs[reg] = value & 0x1F;
+        restart(now_ns);
+        break;
+
+    case ADXL345_REG_POWER_CTL:
+    {
+        // Measure set and sleep clear
+        bool measuring = (value & 0x0C) == 0x08;
+        if (measuring && !this->measuring)
+        {
+            restart(now_ns);
+        }
+        this->measuring = measuring;
+        this->regs[reg] = value & 0x3F;
+        break;
+    }
+
+    case ADXL345_REG_FIFO_CTL:
+        // A mode change empties the FIFO
+        if ((value >> 6) != (this->regs[reg] >> 6))
+        {
+            this->fifo_head = 0;
+            this->fifo_count = 0;
+        }
+        this->regs[reg] = value;
+        break;
+
+    default:
+        this->regs[reg] = value;
+        break;
+    }
+
+    load_output();
+    refresh();
+}
+
+void gy85_emu_adxl345::end_read(uint8_t first, uint8_t count)
+{
+    if (!covers(first, count, ADXL345_REG_DATAX0, ADXL345_REG_DATAZ1))
+    {
+        return;
+    }
+
+    uint8_t mode = this->regs[ADXL345_REG_FIFO_CTL] >> 6;
+    if (mode == FIFO_BYPASS)
+    {
+        this->data_ready = false;
+    }
+    else if (this->fifo_count > 0)
+    {
+        this->fifo_head = (this->fifo_head + 1) % GY85_EMU_ADXL345_FIFO;
+        this->fifo_count--;
+    }
+    this->overrun = false;
+
+    load_output();
+    refresh();
+}
+
+/**
+ * ITG3205
+ */
+
+gy85_emu_itg3205::gy85_emu_itg3205(gy85_emu *emu, uint8_t addr) : gy85_emu_device(emu, addr)
+{
+    // 0.38 deg/s rms at 100Hz typical
+    memset(&this->error, 0, sizeof(this->error));
+    this->error.noise_density = 0.038 * M_PI / 180.0;
+
+    reset();
+}
+
+void gy85_emu_itg3205::reset()
+{
+    memset(this->regs, 0, sizeof(this->regs));
+    this->regs[0x00] = this->addr & 0x7E;
+
+    // TEMP_OUT, -13200 at 35C and 280 lsb/C
+    int16_t temp = -13200 + (int16_t)(280 * (EMU_ITG3205_TEMP_C - 35.0));
+    this->regs[0x1B] = (uint16_t)temp >> 8;
+    this->regs[0x1C] = (uint16_t)temp & 0xFF;
+
+    this->raw_ready = false;
+    this->ready_ns = now_ns + GY85_EMU_ITG3205_STARTUP_US * 1000ull;
+    restart(now_ns);
+    refresh();
+}
+
+void gy85_emu_itg3205::restart(uint64_t now_ns)
+{
+    this->origin_ns = now_ns > this->ready_ns ? now_ns : this->ready_ns;
+    this->emitted = 0;
+}
+
+void gy85_emu_itg3205::refresh()
+{
+    bool ready = now_ns >= this->ready_ns;
+    uint8_t int_cfg = this->regs[ITG3205_REG_INT_CFG];
+
+    this->regs[ITG3205_REG_INT_STATUS] = (ready && (int_cfg & 0x04) ? 0x04 : 0) | (this->raw_ready ? 0x01 : 0);
+}
+
+void gy85_emu_itg3205::update(uint64_t now_ns)
+{
+    if ((this->regs[ITG3205_REG_PWR_MGM] & 0x40) || now_ns < this->origin_ns)
+    {
+        refresh();
+        return;
+    }
+
+    uint8_t dlpf = this->regs[ITG3205_REG_DLPF_FS] & 0x07;
+    uint64_t internal_hz = dlpf == 0 ? 8000 : 1000;
+    uint64_t period_ns = 1000000000ull * (this->regs[ITG3205_REG_SMPLRT_DIV] + 1) / internal_hz;
+    uint64_t due = (now_ns - this->origin_ns) / period_ns;
+    if (due == this->emitted)
+    {
+        refresh();
+        return;
+    }
+
+    // Only the newest sample is visible
+    gy85_emu_truth_t truth;
+    this->emu->trajectory->evaluate((this->origin_ns + due * period_ns) * 1e-9, &truth);
+
+    static const double bandwidth[8] = {256, 188, 98, 42, 20, 10, 5, 256};
+    double sigma = this->error.noise_density * sqrt(bandwidth[dlpf]);
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        double rate = truth.rate[i] + this->error.bias[i] + sigma * this->emu->gaussian();
+        bool clipped = false;
+        int16_t counts = saturate(rate * 180.0 / M_PI * ITG3205_DIGIT_TO_DEG, 32767, &clipped);
+
+        this->regs[ITG3205_REG_GYRO_XOUT_H + 2 * i] = (uint16_t)counts >> 8;
+        this->regs[ITG3205_REG_GYRO_XOUT_H + 2 * i + 1] = (uint16_t)counts & 0xFF;
+    }
+
+    // RAW_DATA_RDY follows the driver's expectation of RAW_RDY_EN
+    if (this->regs[ITG3205_REG_INT_CFG] & 0x01)
+    {
+        this->raw_ready = true;
+    }
+
+    this->emitted = due;
+    refresh();
+}
+
+void gy85_emu_itg3205::write_reg(uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case ITG3205_REG_INT_STATUS:
+        return;
+
+    case ITG3205_REG_SMPLRT_DIV:
+    case ITG3205_REG_DLPF_FS:
+        this->regs[reg] = value;
+        restart(now_ns);
+        break;
+
+    case ITG3205_REG_PWR_MGM:
+    {
+        if (value & 0x80)
+        {
+            // H_RESET, self clearing
+            reset();
+            return;
+        }
+
+        bool was_sleeping = this->regs[reg] & 0x40;
+        this->regs[reg] = value;
+        if (was_sleeping && !(value & 0x40))
+        {
+            this->ready_ns = now_ns + GY85_EMU_ITG3205_STARTUP_US * 1000ull;
+            restart(now_ns);
+        }
+        break;
+    }
+
+    default:
+        if (reg >= 0x1B && reg <= 0x22)
+        {
+            // TEMP_OUT and GYRO_xOUT
+            return;
+        }
+        this->regs[reg] = value;
+        break;
+    }
+
+    refresh();
+}
+
+void gy85_emu_itg3205::end_read(uint8_t first, uint8_t count)
+{
+    // INT_ANYRD_2CLEAR, otherwise reading INT_STATUS clears it
+    if ((this->regs[ITG3205_REG_INT_CFG] & 0x10) || covers(first, count, ITG3205_REG_INT_STATUS, ITG3205_REG_INT_STATUS))
+    {
+        this->raw_ready = false;
+        refresh();
+    }
+}
+
+/**
+ * QMC5883L
+ */
+
+gy85_emu_qmc5883l::gy85_emu_qmc5883l(gy85_emu *emu, uint8_t addr) : gy85_emu_device(emu, addr)
+{
+    // ~2mG rms at 200Hz, 512x
+    memset(&this->error, 0, sizeof(this->error));
+    this->error.noise_density = 2e-4;
+
+    reset();
+}
+
+void gy85_emu_qmc5883l::reset()
+{
+    memset(this->regs, 0, sizeof(this->regs));
+    this->regs[QMC5883L_REG_ID] = QMC5883L_ID;
+
+    this->drdy = false;
+    this->overflow = false;
+    this->overrun = false;
+    restart(now_ns);
+    refresh();
+}
+
+void gy85_emu_qmc5883l::restart(uint64_t now_ns)
+{
+    this->origin_ns = now_ns;
+    this->emitted = 0;
+}
+
+void gy85_emu_qmc5883l::refresh()
+{
+    this->regs[QMC5883L_REG_STATUS] = (this->drdy ? 0x01 : 0) | (this->overflow ? 0x02 : 0) | (this->overrun ? 0x04 : 0);
+}
+
+void gy85_emu_qmc5883l::update(uint64_t now_ns)
+{
+    uint8_t ctrl = this->regs[QMC5883L_REG_CONFIG_A];
+    if ((ctrl & 0x03) != CONTINUOUS || now_ns < this->origin_ns)
+    {
+        return;
+    }
+
+    static const uint32_t odr_hz[4] = {10, 50, 100, 200};
+    uint32_t odr = odr_hz[(ctrl >> 2) & 0x03];
+    uint64_t period_ns = 1000000000ull / odr;
+    uint64_t due = (now_ns - this->origin_ns) / period_ns;
+    uint64_t missed = due - this->emitted;
+    if (missed == 0)
+    {
+        return;
+    }
+
+    gy85_emu_truth_t truth;
+    this->emu->trajectory->evaluate((this->origin_ns + due * period_ns) * 1e-9, &truth);
+
+    // RNG 0 is 2G at 12000 lsb/G, 1 is 8G at 3000 lsb/G
+    double lsb_per_gauss = ((ctrl >> 4) & 0x03) == 0 ? GY85_EMU_GAUSS_TO_COUNTS_2G : GY85_EMU_GAUSS_TO_COUNTS_2G / 4;
+    uint32_t osr = 512 >> ((ctrl >> 6) & 0x03);
+    double sigma = this->error.noise_density * sqrt(odr / 2.0) * sqrt(512.0 / osr);
+
+    bool clipped = false;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        double field = truth.mag[i] + this->error.bias[i] + sigma * this->emu->gaussian();
+        int16_t counts = saturate(field * lsb_per_gauss, 32767, &clipped);
+
+        this->regs[QMC5883L_REG_DATA + 2 * i] = (uint16_t)counts & 0xFF;
+        this->regs[QMC5883L_REG_DATA + 2 * i + 1] = (uint16_t)counts >> 8;
+    }
+
+    this->overrun |= this->drdy || missed > 1;
+    this->overflow = clipped;
+    this->drdy = true;
+    this->emitted = due;
+    refresh();
+}
+
+void gy85_emu_qmc5883l::write_reg(uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case QMC5883L_REG_CONFIG_A:
+        this->regs[reg] = value;
+        restart(now_ns);
+        break;
+
+    case QMC5883L_REG_CONFIG_B:
+        if (value & 0x80)
+        {
+            // SOFT_RST, every register back to default
+            reset();
+            return;
+        }
+        this->regs[reg] = value;
+        break;
+
+    case QMC5883L_REG_PERIOD:
+        this->regs[reg] = value;
+        break;
+
+    default:
+        // Data, status, temperature and ID are read only
+        break;
+    }
+}
+
+uint8_t gy85_emu_qmc5883l::next_pointer(uint8_t reg)
+{
+    // ROL_PNT, the pointer rolls over from the status register to the data
+    if ((this->regs[QMC5883L_REG_CONFIG_B] & 0x40) && reg == QMC5883L_REG_STATUS)
+    {
+        return QMC5883L_REG_DATA;
+    }
+    return reg + 1;
+}
+
+void gy85_emu_qmc5883l::end_read(uint8_t first, uint8_t count)
+{
+    if (covers(first, count, QMC5883L_REG_DATA, QMC5883L_REG_DATA + 5))
+    {
+        this->drdy = false;
+        this->overrun = false;
+        refresh();
+    }
+}
+
+/**
+ * Bus
+ */
+
+gy85_emu::gy85_emu(gy85_emu_trajectory *trajectory, uint64_t seed)
+    : adxl345(this, ADXL345_ADDR), itg3205(this, ITG3205_ADDR), qmc5883l(this, QMC5883L_ADDR)
+{
+    this->trajectory = trajectory;
+    this->rng_state = seed != 0 ? seed : 1;
+    this->bus_hz = GY85_EMU_BUS_HZ;
+
+    this->ops.write = bus_write;
+    this->ops.read = bus_read;
+    this->ops.context = this;
+}
+
+void gy85_emu::install()
+{
+    gy85_set_bus_ops(&this->ops);
+}
+
+void gy85_emu::uninstall()
+{
+    gy85_set_bus_ops(nullptr);
+}
+
+double gy85_emu::gaussian()
+{
+    // xorshift64* and Box-Muller, one value per call is enough here
+    double u[2];
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        this->rng_state ^= this->rng_state >> 12;
+        this->rng_state ^= this->rng_state << 25;
+        this->rng_state ^= this->rng_state >> 27;
+        u[i] = ((this->rng_state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    return sqrt(-2.0 * log(u[0] + 1e-300)) * cos(2.0 * M_PI * u[1]);
+}
+
+uint32_t gy85_emu::get_transfers()
+{
+    return this->adxl345.transfers + this->itg3205.transfers + this->qmc5883l.transfers;
+}
+
+gy85_emu_device *gy85_emu::find(uint8_t addr)
+{
+    if (addr == this->adxl345.addr)
+    {
+        return &this->adxl345;
+    }
+    if (addr == this->itg3205.addr)
+    {
+        return &this->itg3205;
+    }
+    if (addr == this->qmc5883l.addr)
+    {
+        return &this->qmc5883l;
+    }
+    return nullptr;
+}
+
+void gy85_emu::charge_bus(size_t len)
+{
+    // Address byte plus data, 9 clocks each, start and stop
+    advance_ns(((len + 1) * 9 + 2) * 1000000000ull / this->bus_hz);
+}
+
+int gy85_emu::bus_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    // One emulated bus, repeated starts cost the same as stops
+    (void)port;
+    (void)nostop;
+    gy85_emu *emu = (gy85_emu *)context;
+    gy85_emu_device *device = emu->find(addr);
+    if (device == nullptr)
+    {
+        emu->charge_bus(0);
+        return PICO_ERROR_GENERIC;
+    }
+
+    int res = device->write(data, len);
+    emu->charge_bus(len);
+    return res;
+}
+
+int gy85_emu::bus_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    (void)port;
+    (void)nostop;
+    gy85_emu *emu = (gy85_emu *)context;
+    gy85_emu_device *device = emu->find(addr);
+    if (device == nullptr)
+    {
+        emu->charge_bus(0);
+        return PICO_ERROR_GENERIC;
+    }
+
+    int res = device->read(data, len);
+    emu->charge_bus(len);
+    return res;
+}
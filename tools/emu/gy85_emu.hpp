@@ -0,0 +1,248 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "gy85/bus.hpp"
+
+// Emulator Misc
+#define GY85_EMU_MAX_SEGMENTS (32)
+#define GY85_EMU_BUS_HZ (400000)        ///< Bus time charged to the virtual clock per transfer
+#define GY85_EMU_ADXL345_FIFO (32)
+#define GY85_EMU_ITG3205_STARTUP_US (50000) ///< Gyro start-up after power on or wake
+#define GY85_EMU_GAUSS_TO_COUNTS_2G (12000.0)
+#define GY85_EMU_ALARMS (4)             ///< add_alarm_at() slots of the host shim
+
+/**
+ * Virtual clock shared by the emulators and the pico/stdlib.h host shim.
+ * It only moves when slept on or when a transfer is charged to it, so a
+ * run goes as fast as the host can execute it.
+ * Alarms of add_alarm_at() fire as the clock passes them, also within a
+ * transfer, like the timer interrupt, and wait while interrupts are masked
+ * (hardware/sync.h shim).
+ */
+uint64_t gy85_emu_time_us();
+void gy85_emu_advance_us(uint64_t us);
+void gy85_emu_reset_time();
+bool gy85_emu_in_interrupt();
+
+/**
+ * What the sensors see, in the body frame
+ */
+typedef struct
+{
+    double accel[3]; ///< Specific force, m/s^2 (+1g up at rest)
+    double rate[3];  ///< rad/s
+    double mag[3];   ///< Gauss
+} gy85_emu_truth_t;
+
+class gy85_emu_trajectory
+{
+public:
+    virtual void evaluate(double t_s, gy85_emu_truth_t *truth) = 0;
+};
+
+typedef struct
+{
+    double duration_s;
+    double rate[3];  ///< Constant body rate, rad/s
+    double accel[3]; ///< Constant linear acceleration, navigation frame (z up), m/s^2
+} gy85_emu_segment_t;
+
+/**
+ * Piecewise motion: each segment turns at a constant body rate and
+ * accelerates at a constant rate in the navigation frame. The attitude is
+ * exact (closed form per segment), after the last segment the board stays
+ * still. The default start is level with a 0.5 Gauss field along +x, -z
+ * inclined.
+ */
+class gy85_emu_script : public gy85_emu_trajectory
+{
+private:
+    gy85_emu_segment_t segments[GY85_EMU_MAX_SEGMENTS];
+    double start_s[GY85_EMU_MAX_SEGMENTS + 1];
+    double attitude[GY85_EMU_MAX_SEGMENTS + 1][4]; ///< Body to navigation quaternion at each segment start
+    uint8_t count;
+    uint8_t current;
+    double field[3];
+
+public:
+    gy85_emu_script();
+
+    int add(const gy85_emu_segment_t &segment);
+    void set_field(const double field[3]);
+    double get_duration_s();
+
+    void evaluate(double t_s, gy85_emu_truth_t *truth) override;
+};
+
+/**
+ * Sensor error model, in the truth units
+ */
+typedef struct
+{
+    double bias[3];
+    double noise_density; ///< unit / sqrt(Hz) over the output bandwidth of the current setting
+} gy85_emu_error_t;
+
+class gy85_emu;
+
+/**
+ * Register file with an auto-incrementing pointer, the base of the three
+ * chip models. Samples are produced lazily on access, for the sample times
+ * that went by since the previous access.
+ */
+class gy85_emu_device
+{
+protected:
+    gy85_emu *emu;
+    uint8_t regs[256];
+    uint8_t pointer;
+
+    virtual void write_reg(uint8_t reg, uint8_t value);
+    virtual uint8_t next_pointer(uint8_t reg);
+    virtual void end_read(uint8_t first, uint8_t count);
+
+public:
+    uint8_t addr;
+    uint32_t transfers;
+
+    gy85_emu_device(gy85_emu *emu, uint8_t addr);
+
+    virtual void reset() = 0;
+    virtual void update(uint64_t now_ns) = 0;
+
+    int write(const uint8_t *data, size_t len);
+    int read(uint8_t *data, size_t len);
+};
+
+/**
+ * ADXL345: DEVID, BW_RATE, POWER_CTL, DATA_FORMAT (range, FULL_RES),
+ * OFSx, INT_SOURCE (DATA_READY, watermark, overrun), FIFO_CTL / FIFO_STATUS
+ * with bypass, FIFO and stream modes. Data registers latch on the first
+ * byte read, a read that covers them consumes the sample / FIFO entry.
+ */
+class gy85_emu_adxl345 : public gy85_emu_device
+{
+private:
+    bool measuring;
+    uint64_t origin_ns;
+    uint64_t emitted;
+    int16_t fifo[GY85_EMU_ADXL345_FIFO][3];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    int16_t output[3];
+    bool data_ready;
+    bool overrun;
+
+    void restart(uint64_t now_ns);
+    void sample(double t_s, int16_t counts[3]);
+    void push(const int16_t counts[3]);
+    void load_output();
+    void refresh();
+
+protected:
+    void write_reg(uint8_t reg, uint8_t value) override;
+    void end_read(uint8_t first, uint8_t count) override;
+
+public:
+    gy85_emu_error_t error;
+
+    gy85_emu_adxl345(gy85_emu *emu, uint8_t addr);
+
+    void reset() override;
+    void update(uint64_t now_ns) override;
+};
+
+/**
+ * ITG3205: WHO_AM_I, SMPLRT_DIV, DLPF_FS (8kHz / 1kHz internal rate),
+ * INT_CFG (RAW_RDY_EN, ITG_RDY_EN, INT_ANYRD_2CLEAR), INT_STATUS, TEMP_OUT,
+ * GYRO_xOUT, PWR_MGM (H_RESET, SLEEP) with the start-up delay.
+ */
+class gy85_emu_itg3205 : public gy85_emu_device
+{
+private:
+    uint64_t ready_ns;
+    uint64_t origin_ns;
+    uint64_t emitted;
+    bool raw_ready;
+
+    void restart(uint64_t now_ns);
+    void refresh();
+
+protected:
+    void write_reg(uint8_t reg, uint8_t value) override;
+    void end_read(uint8_t first, uint8_t count) override;
+
+public:
+    gy85_emu_error_t error;
+
+    gy85_emu_itg3205(gy85_emu *emu, uint8_t addr);
+
+    void reset() override;
+    void update(uint64_t now_ns) override;
+};
+
+/**
+ * QMC5883L: data, status (DRDY, OVL, DOR), temperature, control 1 (mode,
+ * ODR, range, over sampling), control 2 (soft reset, pointer roll over),
+ * SET/RESET period and chip ID. Noise scales with the over sampling ratio.
+ */
+class gy85_emu_qmc5883l : public gy85_emu_device
+{
+private:
+    uint64_t origin_ns;
+    uint64_t emitted;
+    bool drdy;
+    bool overflow;
+    bool overrun;
+
+    void restart(uint64_t now_ns);
+    void refresh();
+
+protected:
+    void write_reg(uint8_t reg, uint8_t value) override;
+    uint8_t next_pointer(uint8_t reg) override;
+    void end_read(uint8_t first, uint8_t count) override;
+
+public:
+    gy85_emu_error_t error; ///< noise_density is at 512x over sampling
+
+    gy85_emu_qmc5883l(gy85_emu *emu, uint8_t addr);
+
+    void reset() override;
+    void update(uint64_t now_ns) override;
+};
+
+/**
+ * The three chips on one emulated bus, driven by a trajectory.
+ * install() routes every gy85 transfer to them.
+ */
+class gy85_emu
+{
+private:
+    uint64_t rng_state;
+    gy85_bus_ops_t ops;
+
+    gy85_emu_device *find(uint8_t addr);
+
+    static int bus_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop);
+    static int bus_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop);
+
+public:
+    gy85_emu_trajectory *trajectory;
+    gy85_emu_adxl345 adxl345;
+    gy85_emu_itg3205 itg3205;
+    gy85_emu_qmc5883l qmc5883l;
+    uint32_t bus_hz;
+
+    gy85_emu(gy85_emu_trajectory *trajectory, uint64_t seed = 1);
+
+    void install();
+    void uninstall();
+
+    double gaussian();
+    uint32_t get_transfers();
+
+    // Moves the virtual clock by the bus time of a transfer, also for
+    // devices simulated outside of this class
+    void charge_bus(size_t len);
+};
@@ -0,0 +1,13 @@
+#pragma once
+// Host stand-in for the hardware/sync.h interrupt masking and barriers,
+// the state is kept by the emulators (tools/emu/gy85_emu.cpp)
+
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,45 @@
+#pragma once
+// Host stand-in for the few pico/stdlib.h pieces the driver sources use,
+// so they build unchanged against the emulators. Time is the emulator's
+// virtual clock (tools/emu/gy85_emu.hpp), sleeping only advances it and
+// alarms fire from it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Same values as the SDK pico_error_codes
+enum pico_error_codes
+{
+    PICO_OK = 0,
+    PICO_ERROR_NONE = 0,
+    PICO_ERROR_TIMEOUT = -1,
+    PICO_ERROR_GENERIC = -2,
+    PICO_ERROR_NO_DATA = -3,
+    PICO_ERROR_NOT_PERMITTED = -4,
+    PICO_ERROR_INVALID_ARG = -5,
+    PICO_ERROR_IO = -6,
+    PICO_ERROR_BADAUTH = -7,
+    PICO_ERROR_CONNECT_FAILED = -8,
+    PICO_ERROR_INSUFFICIENT_RESOURCES = -9,
+};
+
+// No reset survives on the host, plain zero initialised RAM
+#define __uninitialized_ram(group) group
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+static inline absolute_time_t from_us_since_boot(uint64_t us)
+{
+    return us;
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
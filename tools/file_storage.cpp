@@ -0,0 +1,239 @@
+#include "file_storage.hpp"
+#include <string.h>
+
+// Same values as the SDK pico_error_codes
+#define STORAGE_OK (0)
+#define STORAGE_ERROR_IO (-6)
+#define STORAGE_ERROR_NOT_PERMITTED (-4)
+#define STORAGE_ERROR_INVALID_ARG (-5)
+
+gy85_file_storage::gy85_file_storage()
+{
+    this->file = NULL;
+    this->region_size = 0;
+    this->sector = GY85_FLASH_SECTOR_SIZE;
+    this->page = GY85_FLASH_PAGE_SIZE;
+    this->read_only = false;
+    this->powered = true;
+    this->cut_countdown = 0;
+    this->reset_counters();
+}
+
+gy85_file_storage::~gy85_file_storage()
+{
+    this->close();
+}
+
+/**
+ * Opens the backing file, format creates it (or wipes it) as erased flash
+ */
+int gy85_file_storage::open(const char *path, uint32_t region_size, bool format)
+{
+    this->close();
+
+    this->file = fopen(path, format ? "w+b" : "r+b");
+    this->read_only = false;
+    if (this->file == NULL)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    this->region_size = region_size - region_size % this->sector;
+
+    if (format)
+    {
+        uint8_t erased[GY85_FLASH_SECTOR_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        for (uint32_t offset = 0; offset < this->region_size; offset += this->sector)
+        {
+            if (fwrite(erased, 1, this->sector, this->file) != this->sector)
+            {
+                return STORAGE_ERROR_IO;
+            }
+        }
+        fflush(this->file);
+    }
+
+    return STORAGE_OK;
+}
+
+/**
+ * Opens an existing image as it is, the region is the whole file
+ */
+int gy85_file_storage::open_read_only(const char *path)
+{
+    this->close();
+
+    this->file = fopen(path, "rb");
+    if (this->file == NULL)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    this->read_only = true;
+
+    if (fseek(this->file, 0, SEEK_END) != 0)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    long size = ftell(this->file);
+    if (size < 0)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    this->region_size = size - size % this->sector;
+
+    return STORAGE_OK;
+}
+
+void gy85_file_storage::close()
+{
+    if (this->file != NULL)
+    {
+        fclose(this->file);
+        this->file = NULL;
+    }
+}
+
+void gy85_file_storage::cut_power_after(uint32_t operations)
+{
+    this->cut_countdown = operations + 1;
+}
+
+void gy85_file_storage::power_on()
+{
+    this->powered = true;
+    this->cut_countdown = 0;
+}
+
+void gy85_file_storage::reset_counters()
+{
+    this->reads = 0;
+    this->bytes_read = 0;
+    this->programs = 0;
+    this->erases = 0;
+}
+
+bool gy85_file_storage::power_lost()
+{
+    if (this->cut_countdown > 0 && --this->cut_countdown == 0)
+    {
+        this->powered = false;
+        return true;
+    }
+    return false;
+}
+
+uint32_t gy85_file_storage::size()
+{
+    return this->region_size;
+}
+
+uint32_t gy85_file_storage::sector_size()
+{
+    return this->sector;
+}
+
+uint32_t gy85_file_storage::page_size()
+{
+    return this->page;
+}
+
+int gy85_file_storage::read(uint32_t offset, uint8_t *buffer, uint32_t len)
+{
+    if (!this->powered)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    if (this->file == NULL || offset + len > this->region_size)
+    {
+        return STORAGE_ERROR_INVALID_ARG;
+    }
+
+    this->reads++;
+    this->bytes_read += len;
+
+    if (fseek(this->file, offset, SEEK_SET) != 0 || fread(buffer, 1, len, this->file) != len)
+    {
+        return STORAGE_ERROR_IO;
+    }
+
+    return STORAGE_OK;
+}
+
+int gy85_file_storage::erase(uint32_t offset)
+{
+    if (!this->powered)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    if (this->read_only)
+    {
+        return STORAGE_ERROR_NOT_PERMITTED;
+    }
+    if (this->file == NULL || offset % this->sector != 0 || offset + this->sector > this->region_size)
+    {
+        return STORAGE_ERROR_INVALID_ARG;
+    }
+
+    // A torn erase only clears the first half of the sector
+    bool torn = power_lost();
+    uint32_t len = torn ? this->sector / 2 : this->sector;
+
+    uint8_t erased[GY85_FLASH_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    if (fseek(this->file, offset, SEEK_SET) != 0 || fwrite(erased, 1, len, this->file) != len)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    fflush(this->file);
+
+    this->erases++;
+
+    return torn ? STORAGE_ERROR_IO : STORAGE_OK;
+}
+
+int gy85_file_storage::program(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    if (!this->powered)
+    {
+        return STORAGE_ERROR_IO;
+    }
+    if (this->read_only)
+    {
+        return STORAGE_ERROR_NOT_PERMITTED;
+    }
+    if (this->file == NULL || offset % this->page != 0 || len % this->page != 0 || offset + len > this->region_size)
+    {
+        return STORAGE_ERROR_INVALID_ARG;
+    }
+
+    // A torn program only lands the first half of the data
+    bool torn = power_lost();
+    uint32_t landed = torn ? len / 2 : len;
+
+    uint8_t page[GY85_FLASH_PAGE_SIZE];
+    for (uint32_t done = 0; done < landed; done += this->page)
+    {
+        uint32_t chunk = landed - done < this->page ? landed - done : this->page;
+
+        if (fseek(this->file, offset + done, SEEK_SET) != 0 || fread(page, 1, chunk, this->file) != chunk)
+        {
+            return STORAGE_ERROR_IO;
+        }
+
+        // NOR flash can only clear bits
+        for (uint32_t i = 0; i < chunk; i++)
+        {
+            page[i] &= data[done + i];
+        }
+
+        if (fseek(this->file, offset + done, SEEK_SET) != 0 || fwrite(page, 1, chunk, this->file) != chunk)
+        {
+            return STORAGE_ERROR_IO;
+        }
+    }
+    fflush(this->file);
+
+    this->programs++;
+
+    return torn ? STORAGE_ERROR_IO : STORAGE_OK;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdio.h>
+#include "gy85/storage.hpp"
+
+/**
+ * gy85_storage backed by a host file, with the same NOR semantics as the
+ * flash: erase sets a sector to 0xFF, program only clears bits.
+ * cut_power_after() tears the n-th following erase or program (half of it
+ * lands) and fails everything until power_on(), to simulate a power loss.
+ * open_read_only() keeps the file as it is, erase and program fail.
+ */
+class gy85_file_storage : public gy85_storage
+{
+private:
+    FILE *file;
+    uint32_t region_size;
+    uint32_t sector;
+    uint32_t page;
+    bool read_only;
+
+    bool powered;
+    uint32_t cut_countdown; ///< 0 when no cut is armed
+
+    bool power_lost();
+
+public:
+    uint32_t reads;
+    uint32_t bytes_read;
+    uint32_t programs;
+    uint32_t erases;
+
+    gy85_file_storage();
+    ~gy85_file_storage();
+
+    int open(const char *path, uint32_t region_size, bool format);
+    int open_read_only(const char *path);
+    void close();
+
+    void cut_power_after(uint32_t operations);
+    void power_on();
+    void reset_counters();
+
+    uint32_t size() override;
+    uint32_t sector_size() override;
+    uint32_t page_size() override;
+
+    int read(uint32_t offset, uint8_t *buffer, uint32_t len) override;
+    int erase(uint32_t offset) override;
+    int program(uint32_t offset, const uint8_t *data, uint32_t len) override;
+};
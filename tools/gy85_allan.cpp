@@ -0,0 +1,234 @@
+// Allan deviation of a captured still-sensor run (see include/gy85/allan.hpp)
+// The capture is one sample per line, three integer raw count columns
+// separated by spaces, commas or tabs. Lines that do not parse are skipped.
+// --self-test feeds white noise plus a rate random walk of known size on
+// every axis and checks the random walk and bias instability read off the
+// curve against the closed form sigma^2(tau) = N^2 / tau + K^2 tau / 3.
+//
+// Usage: gy85_allan <capture file> <sample rate Hz> [scale per count]
+//        gy85_allan --bench [samples]
+//        gy85_allan --self-test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gy85/allan.hpp"
+
+// Self-test signal, in counts at 100Hz
+#define SELF_TEST_RATE_HZ (100.0)
+#define SELF_TEST_SAMPLES (1u << 20)
+#define SELF_TEST_WHITE (100.0)    ///< Sigma per sample
+#define SELF_TEST_WALK (0.0173)    ///< Sigma of the bias step per sample, puts the minimum near 100s
+#define SELF_TEST_WALK_TOLERANCE (0.05)
+#define SELF_TEST_BIAS_TOLERANCE (0.20)
+
+static allan_variance axes[3];
+
+static void print_report(double sample_period_s, double scale)
+{
+    static const char axis_names[] = "xyz";
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        gy85_allan_point_t curve[GY85_ALLAN_LEVELS];
+        uint8_t count = axes[i].get_curve(sample_period_s, scale, curve, GY85_ALLAN_LEVELS);
+
+        printf("axis %c\n", axis_names[i]);
+        printf("%14s %14s %10s\n", "tau_s", "adev", "terms");
+        for (uint8_t k = 0; k < count; k++)
+        {
+            printf("%14.6g %14.6g %10lu\n", curve[k].tau_s, curve[k].adev, (unsigned long)curve[k].terms);
+        }
+
+        gy85_noise_params_t params;
+        if (gy85_allan_noise_params(curve, count, &params) != 0)
+        {
+            printf("not enough samples\n\n");
+            continue;
+        }
+
+        printf("random walk %.6g /sqrt(Hz), bias instability %.6g at tau %.6g s\n\n",
+               params.random_walk, params.bias_instability, params.bias_instability_tau_s);
+    }
+}
+
+static int run_bench(uint32_t samples)
+{
+    // xorshift noise, the generator cost is measured separately and removed
+    uint32_t state = 0x12345678;
+    int32_t sink = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        sink += (int16_t)state;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double base_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    state = 0x12345678;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        axes[0].add((int16_t)state);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("%lu samples, %.1f ns per update (one axis), state %lu bytes per axis\n",
+           (unsigned long)samples, (total_ns - base_ns) / samples, (unsigned long)sizeof(allan_variance));
+
+    return sink == 1 ? 1 : 0;
+}
+
+static double gaussian(uint64_t *state)
+{
+    // xorshift64* and Box-Muller
+    double u[2];
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        *state ^= *state >> 12;
+        *state ^= *state << 25;
+        *state ^= *state >> 27;
+        u[i] = ((*state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    return sqrt(-2.0 * log(u[0] + 1e-300)) * cos(2.0 * M_PI * u[1]);
+}
+
+static int run_self_test()
+{
+    double period_s = 1.0 / SELF_TEST_RATE_HZ;
+    uint64_t state[3] = {1, 2, 3};
+    double bias[3] = {0, 0, 0};
+
+    for (uint32_t n = 0; n < SELF_TEST_SAMPLES; n++)
+    {
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            bias[i] += SELF_TEST_WALK * gaussian(&state[i]);
+            axes[i].add((int32_t)lround(bias[i] + SELF_TEST_WHITE * gaussian(&state[i])));
+        }
+    }
+
+    // Random walk N and rate random walk K, the minimum of the curve is at
+    // tau = sqrt(3) N / K with sigma^2 = 2 N K / sqrt(3)
+    double walk = sqrt(SELF_TEST_WHITE * SELF_TEST_WHITE + 1.0 / 12.0) * sqrt(period_s);
+    double rate_walk = SELF_TEST_WALK / sqrt(period_s);
+    double bias_instability = sqrt(2.0 * walk * rate_walk / sqrt(3.0)) / 0.664;
+    double bias_tau_s = sqrt(3.0) * walk / rate_walk;
+    printf("%lu samples at %.6g Hz, expected random walk %.4g, bias instability %.4g at tau %.3g s\n",
+           (unsigned long)SELF_TEST_SAMPLES, SELF_TEST_RATE_HZ, walk, bias_instability, bias_tau_s);
+
+    int failures = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        gy85_allan_point_t curve[GY85_ALLAN_LEVELS];
+        uint8_t count = axes[i].get_curve(period_s, 1.0, curve, GY85_ALLAN_LEVELS);
+
+        gy85_noise_params_t params;
+        if (gy85_allan_noise_params(curve, count, &params) != 0)
+        {
+            printf("FAIL: axis %u, no noise parameters\n", i);
+            failures++;
+            continue;
+        }
+
+        double walk_error = params.random_walk / walk - 1.0;
+        double bias_error = params.bias_instability / bias_instability - 1.0;
+        printf("axis %u: random walk %.4g (%+.1f%%), bias instability %.4g (%+.1f%%) at tau %.3g s\n", i, params.random_walk,
+               walk_error * 100.0, params.bias_instability, bias_error * 100.0, params.bias_instability_tau_s);
+
+        // The minimum is flat, its tau is only checked to be near
+        if (fabs(walk_error) > SELF_TEST_WALK_TOLERANCE || fabs(bias_error) > SELF_TEST_BIAS_TOLERANCE ||
+            params.bias_instability_tau_s < bias_tau_s / 4 || params.bias_instability_tau_s > bias_tau_s * 4)
+        {
+            printf("FAIL: axis %u out of tolerance\n", i);
+            failures++;
+        }
+    }
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000000);
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--self-test") == 0)
+    {
+        return run_self_test();
+    }
+
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "usage: %s <capture file> <sample rate Hz> [scale per count]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [samples]\n", argv[0]);
+        fprintf(stderr, "       %s --self-test\n", argv[0]);
+        return 2;
+    }
+
+    double rate_hz = atof(argv[2]);
+    double scale = argc == 4 ? atof(argv[3]) : 1.0;
+    if (rate_hz <= 0)
+    {
+        fprintf(stderr, "%s: invalid sample rate\n", argv[2]);
+        return 2;
+    }
+
+    FILE *file = fopen(argv[1], "r");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        long values[3];
+        char *cursor = line;
+        int parsed = 0;
+
+        for (; parsed < 3; parsed++)
+        {
+            char *end;
+            cursor += strspn(cursor, " ,\t");
+            values[parsed] = strtol(cursor, &end, 10);
+            if (end == cursor)
+            {
+                break;
+            }
+            cursor = end;
+        }
+
+        if (parsed != 3)
+        {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            axes[i].add((int32_t)values[i]);
+        }
+    }
+    fclose(file);
+
+    printf("%lu samples at %.6g Hz\n\n", (unsigned long)axes[0].get_samples(), rate_hz);
+    print_report(1.0 / rate_hz, scale);
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+// Error sweeps and cost of the fixed point attitude kernels (see
+// include/gy85/attitude.hpp) against libm in double precision.
+// gy85_atan2() is checked on every input pair of a 4096x4096 grid, every
+// binary angle at radii up to 2^30 and random full range pairs,
+// gy85_isqrt() at every rounding boundary, and gy85_attitude() on a 1 degree
+// roll/pitch/heading grid at several input scales. The reference is
+// computed from the same integer inputs, so only the kernel error shows.
+//
+// Usage: gy85_attitude
+//        gy85_attitude --bench [calls]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gy85/attitude.hpp"
+
+#define GRID_HALF (2048)
+#define RANDOM_PAIRS (20000000)
+#define INCLINATION_DEG (60.0) ///< Field dip of the attitude sweep
+
+// Accel and mag scales of the attitude sweep: raw counts at 1g and 0.5G,
+// get_attitude() inputs, and close to the int32 limit
+static const double accel_scales[] = {256, 9.80665 * 4096, 1 << 28};
+static const double mag_scales[] = {1500, 6000 * 16, 1 << 28};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double to_angle(double rad)
+{
+    return rad * GY85_ANGLE_FULL / (2 * M_PI);
+}
+
+/**
+ * Difference in binary angle units, wrapped to half a turn.
+ */
+static double angle_error(double angle, double reference)
+{
+    double error = fmod(angle - reference, GY85_ANGLE_FULL);
+    if (error >= GY85_ANGLE_FULL / 2)
+    {
+        error -= GY85_ANGLE_FULL;
+    }
+    else if (error < -GY85_ANGLE_FULL / 2)
+    {
+        error += GY85_ANGLE_FULL;
+    }
+    return fabs(error);
+}
+
+static double atan2_error(int32_t y, int32_t x)
+{
+    return angle_error(gy85_atan2(y, x), to_angle(atan2((double)y, (double)x)));
+}
+
+/**
+ * What the driver users write: double precision roll, pitch with asin,
+ * then the mag rotated to the horizontal plane with sines and cosines.
+ */
+static void attitude_libm(const int32_t accel[3], const int32_t mag[3], double out[3])
+{
+    double ax = accel[0], ay = accel[1], az = accel[2];
+    double mx = mag[0], my = mag[1], mz = mag[2];
+
+    double roll = atan2(ay, az);
+    double pitch = asin(-ax / sqrt(ax * ax + ay * ay + az * az));
+    double sr = sin(roll), cr = cos(roll);
+    double sp = sin(pitch), cp = cos(pitch);
+
+    double north = mx * cp + (my * sr + mz * cr) * sp;
+    double east = my * cr - mz * sr;
+
+    out[0] = roll;
+    out[1] = pitch;
+    out[2] = atan2(east, north);
+}
+
+static int32_t scaled(double value, double scale)
+{
+    return (int32_t)lround(value * scale);
+}
+
+/**
+ * Body frame specific force and field of the attitude R = Rz(-heading) Ry(pitch) Rx(roll),
+ * x north, y west, z up.
+ */
+static void synthesize(double roll, double pitch, double heading, double accel[3], double mag[3])
+{
+    double inclination = INCLINATION_DEG * M_PI / 180;
+    double world_mag[3] = {cos(inclination), 0, -sin(inclination)};
+    double world_up[3] = {0, 0, 1};
+
+    double sr = sin(roll), cr = cos(roll);
+    double sp = sin(pitch), cp = cos(pitch);
+    double sy = sin(-heading), cy = cos(-heading);
+
+    // Rows of R, body = R^T world
+    double r[3][3] = {
+        {cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr},
+        {sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr},
+        {-sp, cp * sr, cp * cr},
+    };
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        accel[i] = r[0][i] * world_up[0] + r[1][i] * world_up[1] + r[2][i] * world_up[2];
+        mag[i] = r[0][i] * world_mag[0] + r[1][i] * world_mag[1] + r[2][i] * world_mag[2];
+    }
+}
+
+static int sweep_atan2()
+{
+    double grid = 0, rings = 0, random = 0;
+
+    for (int32_t y = -GRID_HALF; y < GRID_HALF; y++)
+    {
+        for (int32_t x = -GRID_HALF; x < GRID_HALF; x++)
+        {
+            grid = fmax(grid, atan2_error(y, x));
+        }
+    }
+
+    for (uint8_t bits = 4; bits <= 30; bits += 2)
+    {
+        double radius = (double)(1u << bits) - 1;
+        for (uint32_t angle = 0; angle < GY85_ANGLE_FULL; angle++)
+        {
+            double rad = angle * 2 * M_PI / GY85_ANGLE_FULL;
+            rings = fmax(rings, atan2_error((int32_t)lround(radius * sin(rad)), (int32_t)lround(radius * cos(rad))));
+        }
+    }
+
+    for (uint32_t i = 0; i < RANDOM_PAIRS; i++)
+    {
+        uint64_t r = rng_next();
+        random = fmax(random, atan2_error((int32_t)r, (int32_t)(r >> 32)));
+    }
+    random = fmax(random, atan2_error(INT32_MIN, INT32_MIN));
+    random = fmax(random, atan2_error(INT32_MAX, INT32_MIN));
+
+    printf("atan2     grid %d^2 max %.3f, radii 2^4..2^30 max %.3f, %d random max %.3f units (bound %d)\n",
+           2 * GRID_HALF, grid, rings, RANDOM_PAIRS, random, GY85_ATAN2_MAX_ERROR);
+
+    return fmax(grid, fmax(rings, random)) <= GY85_ATAN2_MAX_ERROR ? 0 : 1;
+}
+
+static int sweep_isqrt()
+{
+    uint32_t failures = 0;
+
+    // Rounds to k from k^2 - k + 1 up to k^2 + k, check both ends of every step
+    for (uint32_t k = 1; k <= 65535; k++)
+    {
+        uint32_t low = k * k - k + 1;
+        uint32_t high = k * k + k;
+        failures += gy85_isqrt(low) != k;
+        failures += gy85_isqrt(low - 1) != k - 1;
+        failures += gy85_isqrt(high) != k;
+        failures += high < UINT32_MAX && gy85_isqrt(high + 1) != k + 1;
+    }
+    failures += gy85_isqrt(0) != 0;
+    failures += gy85_isqrt(UINT32_MAX) != 65536;
+
+    printf("isqrt     %lu failures at the rounding boundaries\n", (unsigned long)failures);
+
+    return failures == 0 ? 0 : 1;
+}
+
+static int sweep_attitude()
+{
+    int failures = 0;
+
+    for (size_t s = 0; s < sizeof(accel_scales) / sizeof(accel_scales[0]); s++)
+    {
+        double roll_max = 0, pitch_max = 0;
+        double heading_max[3] = {}; ///< Up to 60, 80 and 89 degrees of pitch
+
+        for (int16_t pitch_deg = -89; pitch_deg <= 89; pitch_deg++)
+        {
+            for (int16_t roll_deg = -180; roll_deg < 180; roll_deg++)
+            {
+                for (int16_t heading_deg = 0; heading_deg < 360; heading_deg++)
+                {
+                    double accel[3], mag[3];
+                    synthesize(roll_deg * M_PI / 180, pitch_deg * M_PI / 180, heading_deg * M_PI / 180, accel, mag);
+
+                    int32_t accel_counts[3], mag_counts[3];
+                    for (uint8_t i = 0; i < 3; i++)
+                    {
+                        accel_counts[i] = scaled(accel[i], accel_scales[s]);
+                        mag_counts[i] = scaled(mag[i], mag_scales[s]);
+                    }
+
+                    gy85_attitude_t attitude;
+                    double reference[3];
+                    gy85_attitude(accel_counts, mag_counts, &attitude);
+                    attitude_libm(accel_counts, mag_counts, reference);
+
+                    double heading = angle_error(attitude.heading, to_angle(reference[2]));
+                    roll_max = fmax(roll_max, angle_error(attitude.roll, to_angle(reference[0])));
+                    pitch_max = fmax(pitch_max, angle_error(attitude.pitch, to_angle(reference[1])));
+                    heading_max[2] = fmax(heading_max[2], heading);
+                    if (abs(pitch_deg) <= 80)
+                    {
+                        heading_max[1] = fmax(heading_max[1], heading);
+                    }
+                    if (abs(pitch_deg) <= 60)
+                    {
+                        heading_max[0] = fmax(heading_max[0], heading);
+                    }
+                }
+            }
+        }
+
+        printf("attitude  scales %.0f/%.0f max roll %.3f pitch %.3f heading %.3f / %.3f / %.3f units (pitch up to 60/80/89 degrees, bound %d)\n",
+               accel_scales[s], mag_scales[s], roll_max, pitch_max, heading_max[0], heading_max[1], heading_max[2], GY85_ATTITUDE_MAX_ERROR);
+
+        if (roll_max > GY85_ATTITUDE_MAX_ERROR || pitch_max > GY85_ATTITUDE_MAX_ERROR || heading_max[2] > GY85_ATTITUDE_MAX_ERROR)
+        {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static double elapsed_ns(const struct timespec &start, const struct timespec &end)
+{
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+static int run_bench(unsigned long calls)
+{
+    // A table of inputs so neither side sees a constant
+    static int32_t accel[1024][3], mag[1024][3];
+    for (uint16_t i = 0; i < 1024; i++)
+    {
+        double a[3], m[3];
+        synthesize((rng_next() % 360) * M_PI / 180, ((int)(rng_next() % 161) - 80) * M_PI / 180, (rng_next() % 360) * M_PI / 180, a, m);
+        for (uint8_t j = 0; j < 3; j++)
+        {
+            accel[i][j] = scaled(a[j], 256);
+            mag[i][j] = scaled(m[j], 1500);
+        }
+    }
+
+    struct timespec start, end;
+    volatile int32_t sink = 0;
+    volatile double dsink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < calls; i++)
+    {
+        sink = sink + gy85_atan2(accel[i & 1023][1], accel[i & 1023][2]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double kernel_atan2 = elapsed_ns(start, end) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < calls; i++)
+    {
+        dsink = dsink + atan2((double)accel[i & 1023][1], (double)accel[i & 1023][2]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double libm_atan2 = elapsed_ns(start, end) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < calls; i++)
+    {
+        gy85_attitude_t attitude;
+        gy85_attitude(accel[i & 1023], mag[i & 1023], &attitude);
+        sink = sink + attitude.heading;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double kernel_attitude = elapsed_ns(start, end) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < calls; i++)
+    {
+        double reference[3];
+        attitude_libm(accel[i & 1023], mag[i & 1023], reference);
+        dsink = dsink + reference[2];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double libm_attitude = elapsed_ns(start, end) / calls;
+
+    printf("atan2     %.1f ns fixed point, %.1f ns libm double\n", kernel_atan2, libm_atan2);
+    printf("attitude  %.1f ns fixed point, %.1f ns libm double\n", kernel_attitude, libm_attitude);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000000);
+    }
+
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        fprintf(stderr, "       %s --bench [calls]\n", argv[0]);
+        return 2;
+    }
+
+    int failures = sweep_atan2();
+    failures += sweep_isqrt();
+    failures += sweep_attitude();
+
+    return failures == 0 ? 0 : 1;
+}
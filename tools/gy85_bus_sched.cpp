@@ -0,0 +1,463 @@
+// Shared bus scheduling on the emulated bus (see include/gy85/bus_sched.hpp)
+// The GY-85 driver reads at its output data rate next to a simulated
+// 24C256 EEPROM (page writes with a 5ms write cycle, 4KB read backs) and a
+// PMIC polled every 10ms, once with a bare bus (FIFO, nothing split) and
+// once with the priority scheduler. Reports the queueing delay per client,
+// how late the sensor reads were and the EEPROM throughput, and checks
+// every block read back. A third run reads the sensors from gy85_sampler,
+// in the emulated alarm interrupt, while the EEPROM and PMIC transfers run
+// in thread context, and checks that no transaction started on the bus
+// while another one was in progress.
+//
+// Usage: gy85_bus_sched [virtual seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gy85/gy85.hpp"
+#include "gy85/bus_sched.hpp"
+#include "gy85/sampler.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#define EEPROM_ADDR (0x50)
+#define EEPROM_SIZE (32768)
+#define EEPROM_PAGE (64)
+#define EEPROM_WRITE_US (5000)
+#define EEPROM_BLOCK (4096)
+#define PMIC_ADDR (0x34)
+#define PMIC_PERIOD_US (10000)
+
+// 24C256: 2 byte address, page writes wrap in the page, NACK while writing
+typedef struct
+{
+    uint8_t memory[EEPROM_SIZE];
+    uint16_t pointer;
+    uint64_t busy_until_us;
+} eeprom_t;
+
+typedef struct
+{
+    uint8_t regs[256];
+    uint8_t pointer;
+} pmic_t;
+
+typedef struct
+{
+    gy85_emu *emu;
+    const gy85_bus_ops_t *sensors;
+    eeprom_t eeprom;
+    pmic_t pmic;
+    bool in_transaction;  ///< A transfer is on the bus
+    bool held;            ///< A pointer write went out without a stop, the read follows
+    uint8_t held_addr;
+    uint32_t collisions;  ///< Transactions started in the middle of another one
+    uint32_t interrupt_transfers;
+} sim_bus_t;
+
+static int device_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    sim_bus_t *bus = (sim_bus_t *)context;
+
+    if (addr == EEPROM_ADDR)
+    {
+        eeprom_t *eeprom = &bus->eeprom;
+        if (gy85_emu_time_us() < eeprom->busy_until_us)
+        {
+            bus->emu->charge_bus(0);
+            return PICO_ERROR_GENERIC;
+        }
+
+        bus->emu->charge_bus(len);
+        if (len >= 2)
+        {
+            eeprom->pointer = (data[0] << 8 | data[1]) % EEPROM_SIZE;
+        }
+        if (len > 2)
+        {
+            uint16_t page = eeprom->pointer & ~(EEPROM_PAGE - 1);
+            for (size_t i = 2; i < len; i++)
+            {
+                eeprom->memory[eeprom->pointer] = data[i];
+                eeprom->pointer = page | ((eeprom->pointer + 1) & (EEPROM_PAGE - 1));
+            }
+            eeprom->busy_until_us = gy85_emu_time_us() + EEPROM_WRITE_US;
+        }
+        return len;
+    }
+
+    if (addr == PMIC_ADDR)
+    {
+        bus->emu->charge_bus(len);
+        if (len > 0)
+        {
+            bus->pmic.pointer = data[0];
+        }
+        for (size_t i = 1; i < len; i++)
+        {
+            bus->pmic.regs[bus->pmic.pointer++] = data[i];
+        }
+        return len;
+    }
+
+    return bus->sensors->write(bus->sensors->context, port, addr, data, len, nostop);
+}
+
+static int device_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    sim_bus_t *bus = (sim_bus_t *)context;
+
+    if (addr == EEPROM_ADDR)
+    {
+        eeprom_t *eeprom = &bus->eeprom;
+        if (gy85_emu_time_us() < eeprom->busy_until_us)
+        {
+            bus->emu->charge_bus(0);
+            return PICO_ERROR_GENERIC;
+        }
+
+        bus->emu->charge_bus(len);
+        for (size_t i = 0; i < len; i++)
+        {
+            data[i] = eeprom->memory[eeprom->pointer];
+            eeprom->pointer = (eeprom->pointer + 1) % EEPROM_SIZE;
+        }
+        return len;
+    }
+
+    if (addr == PMIC_ADDR)
+    {
+        bus->emu->charge_bus(len);
+        for (size_t i = 0; i < len; i++)
+        {
+            data[i] = bus->pmic.regs[bus->pmic.pointer++];
+        }
+        return len;
+    }
+
+    return bus->sensors->read(bus->sensors->context, port, addr, data, len, nostop);
+}
+
+/**
+ * One master on the bus: a transfer must not start while another one is
+ * on the bus, or between a pointer write without stop and its read
+ */
+static void begin_transaction(sim_bus_t *bus, uint8_t addr, bool read, bool *outer)
+{
+    // The read completing a pointer write is the same transaction
+    bool completes = read && bus->held && bus->held_addr == addr;
+    if (bus->in_transaction || (bus->held && !completes))
+    {
+        bus->collisions++;
+    }
+    if (gy85_emu_in_interrupt())
+    {
+        bus->interrupt_transfers++;
+    }
+
+    *outer = bus->in_transaction;
+    bus->in_transaction = true;
+}
+
+static int sim_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    sim_bus_t *bus = (sim_bus_t *)context;
+    bool outer;
+    begin_transaction(bus, addr, false, &outer);
+
+    int res = device_write(context, port, addr, data, len, nostop);
+    bus->in_transaction = outer;
+    bus->held = nostop && res >= 0;
+    bus->held_addr = addr;
+
+    return res;
+}
+
+static int sim_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    sim_bus_t *bus = (sim_bus_t *)context;
+
+    bool outer;
+    begin_transaction(bus, addr, true, &outer);
+    bus->held = false;
+
+    int res = device_read(context, port, addr, data, len, nostop);
+    bus->in_transaction = outer;
+
+    return res;
+}
+
+typedef enum
+{
+    EEPROM_IDLE,
+    EEPROM_WRITING,
+    EEPROM_READING,
+} eeprom_state_t;
+
+static uint32_t percentile_us(const gy85_latency_stats_t *latency, double fraction)
+{
+    // Upper bound of the bucket holding the percentile
+    uint32_t target = (uint32_t)(latency->count * fraction);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < GY85_STATS_BUCKETS; i++)
+    {
+        seen += latency->buckets[i];
+        if (seen > target)
+        {
+            return i == GY85_STATS_BUCKETS - 1 ? latency->max_us : 1u << i;
+        }
+    }
+    return latency->max_us;
+}
+
+static void print_client(const gy85_bus_client_t *client)
+{
+    const gy85_bus_client_stats_t *stats = &client->stats;
+    printf("  %-7s %7lu xfers %8lu pieces %6lu retries %3lu errors %6lu missed | wait mean %7.1f p99 <%6lu max %6lu us | done max %6lu us\n",
+           client->name, (unsigned long)stats->transfers, (unsigned long)stats->chunks, (unsigned long)stats->retries,
+           (unsigned long)stats->errors, (unsigned long)stats->deadline_misses,
+           stats->transfers ? (double)stats->wait_us / stats->transfers : 0.0,
+           (unsigned long)percentile_us(&stats->wait, 0.99), (unsigned long)stats->wait.max_us,
+           (unsigned long)stats->complete.max_us);
+}
+
+static int run(gy85_bus_policy_t policy, bool sampled, double duration_s)
+{
+    gy85_emu_reset_time();
+
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.install();
+
+    static sim_bus_t sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.emu = &emu;
+    sim.sensors = gy85_get_bus_ops();
+    gy85_bus_ops_t sim_ops = {sim_write, sim_read, &sim};
+
+    gy85_bus_sched sched(&sim_ops);
+    sched.set_policy(policy);
+
+    gy85_bus_client_t imu, pmic, eeprom;
+    sched.attach(&imu, "imu", BUS_PRIORITY_SENSOR, 1000);
+    sched.attach(&pmic, "pmic", BUS_PRIORITY_CONTROL);
+    sched.attach(&eeprom, "eeprom", BUS_PRIORITY_BULK);
+    gy85_set_bus_ops(&imu.ops);
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    uint32_t period_us;
+    sensor.get_odr_period_us(&period_us);
+    sched.reset_stats(&imu);
+
+    // PMIC status poll
+    static const uint8_t pmic_reg = 0x01;
+    uint8_t pmic_status[2];
+    gy85_bus_xfer_t pmic_xfer = {};
+    pmic_xfer.client = &pmic;
+    pmic_xfer.addr = PMIC_ADDR;
+    pmic_xfer.tx = &pmic_reg;
+    pmic_xfer.tx_len = 1;
+    pmic_xfer.rx = pmic_status;
+    pmic_xfer.rx_len = sizeof(pmic_status);
+    pmic_xfer.result = 0;
+
+    // EEPROM blocks, written then read back, splittable on page boundaries
+    static uint8_t block_tx[2 + EEPROM_BLOCK];
+    static uint8_t block_rx[EEPROM_BLOCK];
+    uint8_t read_header[2];
+    gy85_bus_xfer_t eeprom_xfer = {};
+    eeprom_xfer.client = &eeprom;
+    eeprom_xfer.addr = EEPROM_ADDR;
+    eeprom_xfer.header_len = 2;
+    eeprom_xfer.page = EEPROM_PAGE;
+    eeprom_xfer.retry_us = 200;
+    eeprom_xfer.timeout_us = 50000;
+    eeprom_xfer.result = 0;
+
+    uint32_t block = 0;
+    eeprom_state_t eeprom_state = EEPROM_IDLE;
+    uint32_t verify_failures = 0;
+    uint64_t eeprom_bytes = 0;
+
+    uint64_t late_sum_us = 0;
+    uint64_t late_max_us = 0;
+    uint32_t reads = 0, read_failures = 0;
+
+    uint64_t end_us = gy85_emu_time_us() + (uint64_t)(duration_s * 1e6);
+    uint64_t next_imu_us = gy85_emu_time_us() + period_us;
+    uint64_t next_pmic_us = gy85_emu_time_us();
+
+    // The alarm interrupt reads the sensors, the loop below only drains
+    // the queue
+    gy85_sampler sampler(&sensor);
+    gy85_sample_t sample;
+    if (sampled)
+    {
+        next_imu_us = UINT64_MAX;
+        if (sampler.start(period_us) != PICO_OK)
+        {
+            fprintf(stderr, "sampler start failed\n");
+            return 1;
+        }
+    }
+
+    while (gy85_emu_time_us() < end_us)
+    {
+        uint64_t now_us = gy85_emu_time_us();
+
+        while (sampler.pop(&sample))
+        {
+            reads++;
+        }
+
+        if (now_us >= next_imu_us)
+        {
+            uint64_t late_us = now_us - next_imu_us;
+            if (sensor.read() != PICO_OK)
+            {
+                read_failures++;
+            }
+            late_sum_us += late_us;
+            late_max_us = late_us > late_max_us ? late_us : late_max_us;
+            reads++;
+            next_imu_us += period_us;
+            continue;
+        }
+
+        if (pmic_xfer.result != GY85_BUS_PENDING && now_us >= next_pmic_us)
+        {
+            pmic_xfer.deadline_us = (uint32_t)now_us + PMIC_PERIOD_US / 2;
+            sched.submit(&pmic_xfer);
+            next_pmic_us += PMIC_PERIOD_US;
+        }
+
+        if (eeprom_xfer.result != GY85_BUS_PENDING)
+        {
+            uint16_t address = (block * EEPROM_BLOCK) % EEPROM_SIZE;
+
+            if (eeprom_state != EEPROM_IDLE)
+            {
+                if (eeprom_xfer.result < 0)
+                {
+                    verify_failures++;
+                }
+                else if (eeprom_state == EEPROM_READING && memcmp(block_rx, block_tx + 2, EEPROM_BLOCK) != 0)
+                {
+                    verify_failures++;
+                }
+                eeprom_bytes += EEPROM_BLOCK;
+            }
+
+            if (eeprom_state == EEPROM_WRITING)
+            {
+                read_header[0] = address >> 8;
+                read_header[1] = address & 0xFF;
+                eeprom_xfer.tx = read_header;
+                eeprom_xfer.tx_len = sizeof(read_header);
+                eeprom_xfer.rx = block_rx;
+                eeprom_xfer.rx_len = sizeof(block_rx);
+                eeprom_state = EEPROM_READING;
+            }
+            else
+            {
+                if (eeprom_state == EEPROM_READING)
+                {
+                    block++;
+                    address = (block * EEPROM_BLOCK) % EEPROM_SIZE;
+                }
+                block_tx[0] = address >> 8;
+                block_tx[1] = address & 0xFF;
+                for (uint32_t i = 0; i < EEPROM_BLOCK; i++)
+                {
+                    block_tx[2 + i] = (uint8_t)(i * 7 + block * 13);
+                }
+                eeprom_xfer.tx = block_tx;
+                eeprom_xfer.tx_len = sizeof(block_tx);
+                eeprom_xfer.rx = nullptr;
+                eeprom_xfer.rx_len = 0;
+                eeprom_state = EEPROM_WRITING;
+            }
+            sched.submit(&eeprom_xfer);
+        }
+
+        if (sched.run() == PICO_ERROR_NO_DATA)
+        {
+            // Idle until the next client is due or a retry is allowed
+            uint64_t wake_us = next_imu_us < next_pmic_us ? next_imu_us : next_pmic_us;
+            uint32_t ready_us;
+            if (sched.get_next_ready_us(&ready_us) == PICO_OK && now_us + ready_us < wake_us)
+            {
+                wake_us = now_us + ready_us;
+            }
+            sleep_us(wake_us > now_us ? wake_us - now_us : 1);
+        }
+    }
+
+    // Let the queue drain, our transfers live on this stack
+    sampler.stop();
+    while (!sched.is_idle())
+    {
+        if (sched.run() == PICO_ERROR_NO_DATA)
+        {
+            sleep_us(100);
+        }
+    }
+
+    gy85_sampler_stats_t sampler_stats;
+    sampler.get_stats(&sampler_stats);
+    while (sampler.pop(&sample))
+    {
+        reads++;
+    }
+    if (sampled)
+    {
+        read_failures = sampler_stats.errors + sampler_stats.missed + sampler_stats.dropped;
+    }
+
+    printf("%s, %.0f s, sensor reads every %lu us%s\n", policy == BUS_POLICY_FIFO ? "bare bus (FIFO, no split)" : "priority scheduler",
+           duration_s, (unsigned long)period_us, sampled ? " from the sampler interrupt" : "");
+    print_client(&imu);
+    print_client(&pmic);
+    print_client(&eeprom);
+    if (sampled)
+    {
+        printf("  sensor reads %lu of %lu periods (%lu missed, %lu errors, %lu dropped), alarm latency max %lu us | eeprom %.1f KB/s, %lu verify failures\n",
+               (unsigned long)reads, (unsigned long)sampler_stats.periods, (unsigned long)sampler_stats.missed,
+               (unsigned long)sampler_stats.errors, (unsigned long)sampler_stats.dropped, (unsigned long)sampler_stats.latency_max_us,
+               eeprom_bytes / duration_s / 1024, (unsigned long)verify_failures);
+        printf("  %lu transfers in the interrupt, %lu bus collisions\n", (unsigned long)sim.interrupt_transfers,
+               (unsigned long)sim.collisions);
+    }
+    else
+    {
+        printf("  sensor reads %lu (%lu failed), late mean %.1f max %llu us | eeprom %.1f KB/s, %lu verify failures\n",
+               (unsigned long)reads, (unsigned long)read_failures, reads ? (double)late_sum_us / reads : 0.0,
+               (unsigned long long)late_max_us, eeprom_bytes / duration_s / 1024, (unsigned long)verify_failures);
+    }
+
+    gy85_set_bus_ops(nullptr);
+
+    bool sampled_ok = !sampled || (sim.interrupt_transfers > 0 && reads == sampler_stats.periods);
+    return read_failures == 0 && verify_failures == 0 && sim.collisions == 0 && sampled_ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    double duration_s = argc >= 2 ? atof(argv[1]) : 60;
+    if (duration_s <= 0)
+    {
+        fprintf(stderr, "usage: %s [virtual seconds]\n", argv[0]);
+        return 2;
+    }
+
+    int res = run(BUS_POLICY_FIFO, false, duration_s);
+    res |= run(BUS_POLICY_PRIORITY, false, duration_s);
+    res |= run(BUS_POLICY_PRIORITY, true, duration_s);
+
+    return res;
+}
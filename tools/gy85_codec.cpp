@@ -0,0 +1,291 @@
+// Encodes, decodes and benchmarks raw record blocks (see include/gy85/codec.hpp)
+// A capture is one record per line: timestamp_us and the 9 raw counts
+// (accel, gyro, mag) as integers separated by spaces, commas or tabs.
+// Lines that do not parse are skipped.
+//
+// Usage: gy85_codec encode <capture> <blocks file>
+//        gy85_codec decode <blocks file>
+//        gy85_codec --bench [capture]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "gy85/codec.hpp"
+
+static bool load_capture(const char *path, std::vector<gy85_raw_record_t> &records)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        long values[GY85_CODEC_CHANNELS];
+        char *cursor = line;
+        int parsed = 0;
+
+        for (; parsed < GY85_CODEC_CHANNELS; parsed++)
+        {
+            char *end;
+            cursor += strspn(cursor, " ,\t");
+            values[parsed] = strtol(cursor, &end, 10);
+            if (end == cursor)
+            {
+                break;
+            }
+            cursor = end;
+        }
+
+        if (parsed != GY85_CODEC_CHANNELS)
+        {
+            continue;
+        }
+
+        gy85_raw_record_t record;
+        record.timestamp_us = (uint32_t)values[0];
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            record.accel[i] = (int16_t)values[1 + i];
+            record.gyro[i] = (int16_t)values[4 + i];
+            record.mag[i] = (int16_t)values[7 + i];
+        }
+        records.push_back(record);
+    }
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * Still sensor at 1kHz with a slow wobble, white noise of a few counts
+ * and the magnetometer updating at 200Hz
+ */
+static void synthesize_capture(std::vector<gy85_raw_record_t> &records, uint32_t count)
+{
+    uint32_t state = 0x2545F491;
+    auto gaussian = [&state]() {
+        double sum = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            sum += (state >> 8) / 16777216.0;
+        }
+        return (sum - 2.0) * sqrt(3.0);
+    };
+
+    static const double accel_mean[3] = {12, -7, 256};
+    static const double gyro_mean[3] = {-120, -20, -93};
+    static const double mag_mean[3] = {1500, -800, 3200};
+
+    gy85_raw_record_t record;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        double wobble = sin(2 * M_PI * 0.5 * n / 1000.0);
+
+        record.timestamp_us = n * 1000 + (uint32_t)(gaussian() * 2 + 2);
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            record.accel[i] = (int16_t)lround(accel_mean[i] + 8 * wobble + 2 * gaussian());
+            record.gyro[i] = (int16_t)lround(gyro_mean[i] + 30 * wobble + 3 * gaussian());
+            if (n % 5 == 0)
+            {
+                record.mag[i] = (int16_t)lround(mag_mean[i] + 20 * wobble + 3 * gaussian());
+            }
+        }
+        records.push_back(record);
+    }
+}
+
+static void encode_records(const std::vector<gy85_raw_record_t> &records, std::vector<uint8_t> &blocks, size_t *used_bytes)
+{
+    uint8_t block[GY85_CODEC_BLOCK_SIZE];
+    gy85_encoder encoder;
+
+    *used_bytes = 0;
+    encoder.start(block);
+    for (const gy85_raw_record_t &record : records)
+    {
+        if (!encoder.add(record))
+        {
+            *used_bytes += encoder.finish();
+            blocks.insert(blocks.end(), block, block + GY85_CODEC_BLOCK_SIZE);
+            encoder.start(block);
+            encoder.add(record);
+        }
+    }
+
+    if (encoder.get_count() > 0)
+    {
+        *used_bytes += encoder.finish();
+        blocks.insert(blocks.end(), block, block + GY85_CODEC_BLOCK_SIZE);
+    }
+}
+
+static bool decode_blocks(const std::vector<uint8_t> &blocks, std::vector<gy85_raw_record_t> &records)
+{
+    gy85_raw_record_t decoded[GY85_CODEC_MAX_RECORDS];
+
+    for (size_t offset = 0; offset + GY85_CODEC_BLOCK_SIZE <= blocks.size(); offset += GY85_CODEC_BLOCK_SIZE)
+    {
+        int count = gy85_codec_decode(&blocks[offset], GY85_CODEC_BLOCK_SIZE, decoded, GY85_CODEC_MAX_RECORDS);
+        if (count < 0)
+        {
+            fprintf(stderr, "block %lu: not a valid block\n", (unsigned long)(offset / GY85_CODEC_BLOCK_SIZE));
+            return false;
+        }
+        records.insert(records.end(), decoded, decoded + count);
+    }
+
+    return true;
+}
+
+static bool records_equal(const gy85_raw_record_t &a, const gy85_raw_record_t &b)
+{
+    return a.timestamp_us == b.timestamp_us &&
+           memcmp(a.accel, b.accel, sizeof(a.accel)) == 0 &&
+           memcmp(a.gyro, b.gyro, sizeof(a.gyro)) == 0 &&
+           memcmp(a.mag, b.mag, sizeof(a.mag)) == 0;
+}
+
+static double elapsed_s(const struct timespec &start, const struct timespec &end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+static int run_bench(const char *path)
+{
+    std::vector<gy85_raw_record_t> records;
+    if (path != NULL)
+    {
+        if (!load_capture(path, records))
+        {
+            perror(path);
+            return 1;
+        }
+    }
+    else
+    {
+        synthesize_capture(records, 1000000);
+    }
+
+    if (records.empty())
+    {
+        fprintf(stderr, "no records\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> blocks;
+    std::vector<gy85_raw_record_t> decoded;
+    size_t used_bytes;
+    struct timespec start, middle, end;
+
+    blocks.reserve(records.size() * GY85_CODEC_RAW_RECORD_SIZE);
+    decoded.reserve(records.size());
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    encode_records(records, blocks, &used_bytes);
+    clock_gettime(CLOCK_MONOTONIC, &middle);
+    bool valid = decode_blocks(blocks, decoded);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!valid || decoded.size() != records.size())
+    {
+        fprintf(stderr, "round trip failed: %lu records in, %lu out\n", (unsigned long)records.size(), (unsigned long)decoded.size());
+        return 1;
+    }
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (!records_equal(records[i], decoded[i]))
+        {
+            fprintf(stderr, "round trip failed at record %lu\n", (unsigned long)i);
+            return 1;
+        }
+    }
+
+    double raw_mb = records.size() * (double)GY85_CODEC_RAW_RECORD_SIZE / 1e6;
+    printf("%lu records (%s), %lu blocks of %u bytes\n", (unsigned long)records.size(), path != NULL ? path : "synthetic",
+           (unsigned long)(blocks.size() / GY85_CODEC_BLOCK_SIZE), GY85_CODEC_BLOCK_SIZE);
+    printf("ratio %.2f with fixed blocks, %.2f counting used bytes only (%.1f bits per record)\n",
+           raw_mb * 1e6 / blocks.size(), raw_mb * 1e6 / used_bytes, used_bytes * 8.0 / records.size());
+    printf("encode %.1f MB/s, decode %.1f MB/s (raw data rate)\n",
+           raw_mb / elapsed_s(start, middle), raw_mb / elapsed_s(middle, end));
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? argv[2] : NULL);
+    }
+
+    if (argc == 4 && strcmp(argv[1], "encode") == 0)
+    {
+        std::vector<gy85_raw_record_t> records;
+        if (!load_capture(argv[2], records))
+        {
+            perror(argv[2]);
+            return 1;
+        }
+
+        std::vector<uint8_t> blocks;
+        size_t used_bytes;
+        encode_records(records, blocks, &used_bytes);
+
+        FILE *file = fopen(argv[3], "wb");
+        if (file == NULL || fwrite(blocks.data(), 1, blocks.size(), file) != blocks.size())
+        {
+            perror(argv[3]);
+            return 1;
+        }
+        fclose(file);
+
+        printf("%lu records, %lu blocks\n", (unsigned long)records.size(), (unsigned long)(blocks.size() / GY85_CODEC_BLOCK_SIZE));
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "decode") == 0)
+    {
+        FILE *file = fopen(argv[2], "rb");
+        if (file == NULL)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+
+        std::vector<uint8_t> blocks;
+        int c;
+        while ((c = fgetc(file)) != EOF)
+        {
+            blocks.push_back((uint8_t)c);
+        }
+        fclose(file);
+
+        std::vector<gy85_raw_record_t> records;
+        if (!decode_blocks(blocks, records))
+        {
+            return 1;
+        }
+
+        for (const gy85_raw_record_t &record : records)
+        {
+            printf("%lu %d %d %d %d %d %d %d %d %d\n", (unsigned long)record.timestamp_us,
+                   record.accel[0], record.accel[1], record.accel[2],
+                   record.gyro[0], record.gyro[1], record.gyro[2],
+                   record.mag[0], record.mag[1], record.mag[2]);
+        }
+        return 0;
+    }
+
+    fprintf(stderr, "usage: %s encode <capture> <blocks file>\n", argv[0]);
+    fprintf(stderr, "       %s decode <blocks file>\n", argv[0]);
+    fprintf(stderr, "       %s --bench [capture]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,171 @@
+// Runs the unmodified driver against the register emulators (tools/emu)
+// for a long stretch of virtual time: init, calibration while still, then
+// a looping motion script read at the output data rate. Reports the error
+// against the scripted truth and how much faster than real time it ran.
+//
+// Usage: gy85_emu_soak [virtual seconds] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+// Turns and moves and comes back to the start, so it can loop seamlessly
+static const gy85_emu_segment_t motion[] = {
+    {4.0, {0, 0, 0}, {0, 0, 0}},
+    {1.5, {0, 0, M_PI / 3}, {0, 0, 0}},
+    {1.5, {0, 0, -M_PI / 3}, {0, 0, 0}},
+    {1.0, {0.5, 0, 0}, {0, 0, 0}},
+    {1.0, {-0.5, 0, 0}, {0, 0, 0}},
+    {1.0, {0, -0.3, 0}, {0, 0, 0}},
+    {1.0, {0, 0.3, 0}, {0, 0, 0}},
+    {0.5, {0, 0, 0}, {2.0, 0, 0}},
+    {0.5, {0, 0, 0}, {-2.0, 0, 0}},
+    {1.0, {0.2, 0.1, 0.4}, {0, 1.0, 0}},
+    {1.0, {-0.2, -0.1, -0.4}, {0, -1.0, 0}},
+};
+
+class looped_script : public gy85_emu_trajectory
+{
+public:
+    gy85_emu_script script;
+
+    void evaluate(double t_s, gy85_emu_truth_t *truth) override
+    {
+        this->script.evaluate(fmod(t_s, this->script.get_duration_s()), truth);
+    }
+};
+
+typedef struct
+{
+    double sum[3];
+    uint32_t count;
+} rms_t;
+
+static void rms_add(rms_t *rms, const vec3f_t &value, const double truth[3], double scale)
+{
+    double measured[3] = {value.x, value.y, value.z};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        double error = measured[i] * scale - truth[i];
+        rms->sum[i] += error * error;
+    }
+    rms->count++;
+}
+
+static void rms_print(const char *name, const rms_t *rms, const char *unit)
+{
+    printf("%-6s rms error %.4f %.4f %.4f %s\n", name,
+           sqrt(rms->sum[0] / rms->count), sqrt(rms->sum[1] / rms->count), sqrt(rms->sum[2] / rms->count), unit);
+}
+
+int main(int argc, char **argv)
+{
+    double duration_s = argc >= 2 ? atof(argv[1]) : 3600;
+    uint64_t seed = argc >= 3 ? strtoull(argv[2], NULL, 0) : 1;
+    if (duration_s <= 0)
+    {
+        fprintf(stderr, "usage: %s [virtual seconds] [seed]\n", argv[0]);
+        return 2;
+    }
+
+    looped_script trajectory;
+    for (size_t i = 0; i < sizeof(motion) / sizeof(motion[0]); i++)
+    {
+        trajectory.script.add(motion[i]);
+    }
+
+    gy85_emu emu(&trajectory, seed);
+    emu.adxl345.error.bias[0] = 0.2;
+    emu.adxl345.error.bias[1] = -0.1;
+    emu.itg3205.error.bias[0] = 0.02;
+    emu.itg3205.error.bias[1] = -0.01;
+    emu.itg3205.error.bias[2] = 0.015;
+    emu.install();
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    printf("init %llu us to first sample\n", (unsigned long long)sensor.get_init_to_first_sample_us());
+
+    // The script starts with 4s still, calibration takes ~2s
+    if (sensor.calibrate(100) != PICO_OK)
+    {
+        fprintf(stderr, "calibration failed\n");
+        return 1;
+    }
+
+    uint32_t period_us;
+    uint8_t ctrl;
+    if (sensor.get_odr_period_us(&period_us) != PICO_OK || sensor.get_qmc5883l_ctrl(&ctrl) != PICO_OK)
+    {
+        return 1;
+    }
+    double gauss_per_count = 1.0 / (((ctrl >> 4) & 0x03) == SCALE_2_GA ? GY85_EMU_GAUSS_TO_COUNTS_2G : GY85_EMU_GAUSS_TO_COUNTS_2G / 4);
+
+    rms_t accel_rms = {}, gyro_rms = {}, mag_rms = {};
+    uint32_t failures = 0;
+    uint64_t reads = 0;
+    uint64_t steps = 0;
+    uint64_t end_us = gy85_emu_time_us() + (uint64_t)(duration_s * 1e6);
+    uint64_t next_us = gy85_emu_time_us();
+
+    while (gy85_emu_time_us() < end_us)
+    {
+        next_us += period_us;
+        if (next_us > gy85_emu_time_us())
+        {
+            sleep_us(next_us - gy85_emu_time_us());
+        }
+
+        if (sensor.read() != PICO_OK)
+        {
+            failures++;
+            continue;
+        }
+        reads++;
+
+        gy85_emu_truth_t truth, previous;
+        trajectory.evaluate(gy85_emu_time_us() * 1e-6, &truth);
+
+        // The samples can be up to a period old, skip reads across a step
+        trajectory.evaluate((gy85_emu_time_us() - period_us) * 1e-6, &previous);
+        if (memcmp(truth.rate, previous.rate, sizeof(truth.rate)) != 0)
+        {
+            steps++;
+            continue;
+        }
+
+        // Calibration takes out the accel x/y bias but keeps gravity
+        double accel_truth[3] = {truth.accel[0], truth.accel[1], truth.accel[2] + emu.adxl345.error.bias[2]};
+        rms_add(&accel_rms, sensor.get_accel(), accel_truth, 1.0);
+        rms_add(&gyro_rms, sensor.get_gyro(), truth.rate, 1.0);
+        rms_add(&mag_rms, sensor.get_mag(), truth.mag, gauss_per_count);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    double virtual_s = gy85_emu_time_us() * 1e-6;
+
+    printf("%llu reads every %lu us, %lu failures, %llu across rate steps not compared\n",
+           (unsigned long long)reads, (unsigned long)period_us, (unsigned long)failures, (unsigned long long)steps);
+    rms_print("accel", &accel_rms, "m/s^2");
+    rms_print("gyro", &gyro_rms, "rad/s");
+    rms_print("mag", &mag_rms, "G");
+    printf("%.1f s virtual in %.3f s wall, %.0fx real time, %lu transfers (%.0f per wall second)\n",
+           virtual_s, wall_s, virtual_s / wall_s, (unsigned long)emu.get_transfers(), emu.get_transfers() / wall_s);
+
+    emu.uninstall();
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+// Frequency response and cost of the filter stages (see include/gy85/filter.hpp)
+// Drives each stage with sines at several frequencies, fits the gain and
+// phase of the output by least squares and compares them with the response
+// of the floating point design: the RBJ biquad, the CIC transfer function
+// and the windowed sinc FIR. Decimating stages are fitted at the input
+// sample each output is taken at, so the frequencies above the output
+// Nyquist check the alias rejection. A constant input checks the unity
+// DC gain. gy85::read() on the register emulators (tools/emu) with every
+// sensor decimated must report the reads whose samples were all absorbed.
+//
+// Usage: gy85_filter
+//        gy85_filter --bench [samples]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <complex>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#define RATE_HZ (800.0)
+#define AMPLITUDE (8000.0)     ///< Input sine, counts
+#define INPUT_SAMPLES (64000)  ///< Per frequency
+#define SETTLE_SAMPLES (4000)  ///< Skipped before fitting
+#define RESPONSE_TOLERANCE (1e-3) ///< Max |measured - design| of the complex gain
+#define DC_INPUT (12345)
+#define READ_DECIMATION (4)
+#define READS (400)
+
+typedef std::complex<double> complex_t;
+
+// Avoids multiples of the 50Hz half output rate, where the decimated
+// samples of a sine carry no phase information
+static const double frequencies[] = {3, 17, 31, 45, 60, 80, 130, 230, 370};
+
+static complex_t biquad_response(double cutoff_hz, double q, double freq)
+{
+    double w0 = 2 * M_PI * cutoff_hz / RATE_HZ;
+    double alpha = sin(w0) / (2 * q);
+    double b0 = (1 - cos(w0)) / 2, b1 = 1 - cos(w0);
+    double a0 = 1 + alpha, a1 = -2 * cos(w0), a2 = 1 - alpha;
+
+    complex_t z1 = std::polar(1.0, -2 * M_PI * freq / RATE_HZ);
+    return (b0 + b1 * z1 + b0 * z1 * z1) / (a0 + a1 * z1 + a2 * z1 * z1);
+}
+
+static complex_t cic_response(uint8_t order, uint8_t decimation, double freq)
+{
+    double w = 2 * M_PI * freq / RATE_HZ;
+    complex_t stage = (1.0 - std::polar(1.0, -w * decimation)) / ((double)decimation * (1.0 - std::polar(1.0, -w)));
+    return std::pow(stage, (int)order);
+}
+
+static complex_t fir_response(uint8_t taps, uint8_t decimation, double freq)
+{
+    // Same Hamming windowed sinc as fir_decimator::design_lowpass(), unquantised
+    double cutoff = 0.4 / decimation;
+    double center = (taps - 1) / 2.0;
+    double w = 2 * M_PI * freq / RATE_HZ;
+    complex_t sum = 0;
+    double dc = 0;
+
+    for (uint8_t i = 0; i < taps; i++)
+    {
+        double t = i - center;
+        double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        double h = sinc * (0.54 - 0.46 * cos(2 * M_PI * i / (taps - 1)));
+        sum += h * std::polar(1.0, -w * i);
+        dc += h;
+    }
+
+    return sum / dc;
+}
+
+/**
+ * Complex gain of the stage at freq: y = c sin(w n) + d cos(w n) fitted
+ * over the outputs, n being the input sample each output is taken at.
+ */
+static complex_t measure(axis_filter *filter, double freq)
+{
+    double w = 2 * M_PI * freq / RATE_HZ;
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+
+    filter->reset();
+    for (uint32_t n = 0; n < INPUT_SAMPLES; n++)
+    {
+        int32_t out;
+        int32_t in = (int32_t)lround(AMPLITUDE * sin(w * n));
+        if (!filter->process(in, &out) || n < SETTLE_SAMPLES)
+        {
+            continue;
+        }
+
+        double s = sin(w * n), c = cos(w * n);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += out * s;
+        yc += out * c;
+    }
+
+    double det = ss * cc - sc * sc;
+    double gain_sin = (ys * cc - yc * sc) / det;
+    double gain_cos = (yc * ss - ys * sc) / det;
+
+    return complex_t(gain_sin, gain_cos) / AMPLITUDE;
+}
+
+static int32_t settle_dc(axis_filter *filter)
+{
+    int32_t out = 0;
+
+    filter->reset();
+    for (uint32_t n = 0; n < SETTLE_SAMPLES; n++)
+    {
+        filter->process(DC_INPUT, &out);
+    }
+
+    return out;
+}
+
+static double to_db(double gain)
+{
+    return 20 * log10(fmax(gain, 1e-9));
+}
+
+static int check(const char *name, axis_filter *filter, complex_t (*design)(double freq))
+{
+    double max_error = 0;
+
+    printf("%s\n", name);
+    printf("  %8s %12s %12s %12s %12s %10s\n", "Hz", "gain dB", "design dB", "phase deg", "design deg", "error");
+    for (size_t i = 0; i < sizeof(frequencies) / sizeof(frequencies[0]); i++)
+    {
+        complex_t measured = measure(filter, frequencies[i]);
+        complex_t expected = design(frequencies[i]);
+        double error = std::abs(measured - expected);
+        max_error = fmax(max_error, error);
+
+        printf("  %8.1f %12.3f %12.3f %12.3f %12.3f %10.2e\n", frequencies[i],
+               to_db(std::abs(measured)), to_db(std::abs(expected)),
+               std::arg(measured) * 180 / M_PI, std::arg(expected) * 180 / M_PI, error);
+    }
+
+    int32_t dc = settle_dc(filter);
+    bool pass = max_error <= RESPONSE_TOLERANCE && dc == DC_INPUT;
+    printf("  %s: max error %.2e (tolerance %.0e), DC %ld for %d in\n",
+           pass ? "PASS" : "FAIL", max_error, RESPONSE_TOLERANCE, (long)dc, DC_INPUT);
+
+    return pass ? 0 : 1;
+}
+
+// The configurations of the README example, a low cutoff biquad and a CIC
+static complex_t lpf_100_design(double freq)
+{
+    return biquad_response(100, 0.7071, freq);
+}
+
+static complex_t lpf_2_design(double freq)
+{
+    return biquad_response(2, 0.7071, freq);
+}
+
+static complex_t cic_design(double freq)
+{
+    return cic_response(3, 8, freq);
+}
+
+static complex_t fir_design(double freq)
+{
+    return fir_response(32, 8, freq);
+}
+
+static double bench_stage(axis_filter *filter, uint32_t samples, int32_t *sink)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        int32_t out;
+        if (filter->process((int32_t)(n * 2654435761u) >> 20, &out))
+        {
+            *sink += out;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / samples;
+}
+
+static int run_bench(uint32_t samples)
+{
+    biquad_lpf lpf;
+    cic_decimator cic;
+    fir_decimator fir;
+    lpf.configure(100, RATE_HZ);
+    cic.configure(3, 8);
+    fir.design_lowpass(32, 8);
+    int32_t sink = 0;
+
+    printf("%lu samples per stage, ns per input sample\n", (unsigned long)samples);
+    printf("  biquad_lpf                  %6.1f\n", bench_stage(&lpf, samples, &sink));
+    printf("  cic_decimator order 3 / 8   %6.1f\n", bench_stage(&cic, samples, &sink));
+    printf("  fir_decimator 32 taps / 8   %6.1f\n", bench_stage(&fir, samples, &sink));
+
+    // The README accel chain, three axes per sample
+    static biquad_lpf lpfs[3];
+    static fir_decimator firs[3];
+    vec3_filter chain;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        lpfs[i].configure(100, RATE_HZ);
+        firs[i].design_lowpass(32, 8);
+    }
+    chain.add_stage(&lpfs[0], &lpfs[1], &lpfs[2]);
+    chain.add_stage(&firs[0], &firs[1], &firs[2]);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        int16_t in[3] = {(int16_t)(n * 7), (int16_t)(n * 11), (int16_t)(n * 13)};
+        int32_t out[3];
+        if (chain.process(in, out))
+        {
+            sink += out[0] + out[1] + out[2];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("  vec3_filter biquad + FIR    %6.1f (3 axes)\n", total_ns / samples);
+
+    return sink == 1 ? 1 : 0;
+}
+
+/**
+ * Every sensor behind a CIC decimating by READ_DECIMATION: three reads in
+ * four absorb all samples, return PICO_ERROR_NO_DATA and keep the values,
+ * the fourth reports all three sensors as new
+ */
+static int check_decimated_read()
+{
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.install();
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        emu.uninstall();
+        return 1;
+    }
+
+    cic_decimator cic[3][3];
+    vec3_filter filters[3];
+    for (int s = 0; s < 3; s++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            cic[s][i].configure(2, READ_DECIMATION);
+        }
+        filters[s].add_stage(&cic[s][0], &cic[s][1], &cic[s][2]);
+    }
+    sensor.set_adxl345_filter(&filters[0]);
+    sensor.set_itg3205_filter(&filters[1]);
+    sensor.set_qmc5883l_filter(&filters[2]);
+
+    uint32_t fresh = 0;
+    uint32_t absorbed = 0;
+    uint32_t wrong = 0;
+    for (uint32_t n = 0; n < READS; n++)
+    {
+        vec3f_t before = sensor.get_accel();
+        sleep_ms(10);
+        int res = sensor.read();
+        vec3f_t after = sensor.get_accel();
+
+        if (n % READ_DECIMATION == READ_DECIMATION - 1)
+        {
+            fresh += res == PICO_OK && sensor.get_new_samples() == GY85_SAMPLE_ALL;
+        }
+        else if (res == PICO_ERROR_NO_DATA && sensor.get_new_samples() == 0 && memcmp(&before, &after, sizeof(before)) == 0)
+        {
+            absorbed++;
+        }
+        else
+        {
+            wrong++;
+        }
+    }
+    emu.uninstall();
+
+    printf("read() decimated by %d: %lu reads, %lu new, %lu absorbed, %lu wrong\n", READ_DECIMATION,
+           (unsigned long)READS, (unsigned long)fresh, (unsigned long)absorbed, (unsigned long)wrong);
+
+    if (fresh != READS / READ_DECIMATION || absorbed != READS - READS / READ_DECIMATION || wrong != 0)
+    {
+        printf("  FAIL\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000000);
+    }
+
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        fprintf(stderr, "       %s --bench [samples]\n", argv[0]);
+        return 2;
+    }
+
+    biquad_lpf lpf_100, lpf_2;
+    cic_decimator cic;
+    fir_decimator fir;
+    lpf_100.configure(100, RATE_HZ);
+    lpf_2.configure(2, RATE_HZ);
+    cic.configure(3, 8);
+    fir.design_lowpass(32, 8);
+
+    printf("%.0f Hz in, sine amplitude %.0f counts\n", RATE_HZ, AMPLITUDE);
+    int failures = 0;
+    failures += check("biquad_lpf 100 Hz", &lpf_100, lpf_100_design);
+    failures += check("biquad_lpf 2 Hz", &lpf_2, lpf_2_design);
+    failures += check("cic_decimator order 3, decimation 8", &cic, cic_design);
+    failures += check("fir_decimator 32 taps, decimation 8", &fir, fir_design);
+    failures += check_decimated_read();
+
+    return failures == 0 ? 0 : 1;
+}
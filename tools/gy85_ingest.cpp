@@ -0,0 +1,634 @@
+// Host ingest daemon: reads the ASCII stream of gy85_example from the
+// serial device once, decodes it into fixed layout records and publishes
+// them in a shared memory ring (see shm_ring.hpp), so the logger, fusion
+// and dashboard processes all tail the same stream without opening the
+// device or parsing text.
+// Any readable file works as the device, e.g. a capture to replay.
+//
+// Usage: gy85_ingest <device> [shm name] [slots]
+//        gy85_ingest --tail [shm name]
+//        gy85_ingest --bench [readers] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <thread>
+#include "shm_ring.hpp"
+
+#define READ_CHUNK (65536)
+#define LINE_MAX_LEN (128)
+#define BENCH_SHM_NAME "/gy85_bench"
+#define BENCH_PATTERN (1000) ///< Records of the generated stream before its values repeat
+
+// Decoder Lines
+#define LINE_ACCEL (0x01)
+#define LINE_GYRO (0x02)
+#define LINE_MAG (0x04)
+
+typedef struct
+{
+    char line[LINE_MAX_LEN];
+    size_t len;
+    bool overflow;        ///< Current line is too long, dropped at its end
+    uint8_t have;         ///< LINE_xxx decoded for the record in progress
+    gy85_shm_record_t record;
+} decoder_t;
+
+typedef struct
+{
+    uint64_t records;
+    uint64_t lost;
+    uint64_t torn;
+    uint64_t mismatches;
+    double elapsed_s;
+} reader_result_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int signal)
+{
+    (void)signal;
+    stop_requested = 1;
+}
+
+static double elapsed_s(const struct timespec &start, const struct timespec &end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/**
+ * Opens the device, a tty is switched to raw mode: no echo, no line
+ * editing, every byte passed on as it comes.
+ */
+static int open_device(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0 || !isatty(fd))
+    {
+        return fd;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        cfsetspeed(&tio, B115200); // Ignored by USB CDC
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    return fd;
+}
+
+static bool parse_vector(const char *text, float vector[3])
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        char *end;
+        vector[i] = strtof(text, &end);
+        if (end == text)
+        {
+            return false;
+        }
+        text = end;
+    }
+
+    while (*text == ' ' || *text == '\r')
+    {
+        text++;
+    }
+
+    return *text == 0;
+}
+
+/**
+ * Decodes one line, a record is published once its Accel, Gyro and Mag
+ * lines came in that order. Anything else counts as a parse error.
+ */
+static void decode_line(decoder_t *decoder, gy85_shm_writer *writer)
+{
+    const char *line = decoder->line;
+    bool ok;
+
+    if (strncmp(line, "Accel: ", 7) == 0)
+    {
+        ok = parse_vector(line + 7, decoder->record.accel);
+        decoder->have = ok ? LINE_ACCEL : 0;
+    }
+    else if (strncmp(line, "Gyro: ", 6) == 0)
+    {
+        ok = decoder->have == LINE_ACCEL && parse_vector(line + 6, decoder->record.gyro);
+        decoder->have = ok ? decoder->have | LINE_GYRO : 0;
+    }
+    else if (strncmp(line, "Mag: ", 5) == 0)
+    {
+        ok = decoder->have == (LINE_ACCEL | LINE_GYRO) && parse_vector(line + 5, decoder->record.mag);
+        if (ok)
+        {
+            writer->publish(&decoder->record);
+        }
+        decoder->have = 0;
+    }
+    else
+    {
+        // e.g. "Error initializing gy85"
+        ok = false;
+        decoder->have = 0;
+    }
+
+    if (!ok)
+    {
+        writer->count_parse_error();
+    }
+}
+
+/**
+ * Splits a chunk into lines, all records completed in it get the arrival
+ * time of the chunk.
+ */
+static void decode_chunk(decoder_t *decoder, const char *data, size_t len, uint64_t time_ns, gy85_shm_writer *writer)
+{
+    decoder->record.time_ns = time_ns;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = data[i];
+        if (c != '\n')
+        {
+            if (decoder->len < LINE_MAX_LEN - 1)
+            {
+                decoder->line[decoder->len++] = c;
+            }
+            else
+            {
+                decoder->overflow = true;
+            }
+            continue;
+        }
+
+        decoder->line[decoder->len] = 0;
+        if (decoder->overflow)
+        {
+            writer->count_parse_error();
+            decoder->have = 0;
+        }
+        else if (decoder->len > 0)
+        {
+            decode_line(decoder, writer);
+        }
+        decoder->len = 0;
+        decoder->overflow = false;
+    }
+}
+
+/**
+ * Reads the device until it closes or a signal comes in.
+ */
+static uint64_t ingest(int fd, gy85_shm_writer *writer)
+{
+    static char chunk[READ_CHUNK];
+    decoder_t decoder = {};
+    uint64_t bytes = 0;
+
+    while (!stop_requested)
+    {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            // EIO once the other end of a tty hangs up
+            break;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        decode_chunk(&decoder, chunk, n, now.tv_sec * 1000000000ull + now.tv_nsec, writer);
+        bytes += n;
+    }
+
+    writer->set_closed();
+    return bytes;
+}
+
+static int run_daemon(const char *device, const char *name, uint32_t slots)
+{
+    struct sigaction action = {};
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int fd = open_device(device);
+    if (fd < 0)
+    {
+        perror(device);
+        return 1;
+    }
+
+    gy85_shm_writer writer;
+    if (writer.create(name, slots) != SHM_OK)
+    {
+        fprintf(stderr, "cannot create %s\n", name);
+        close(fd);
+        return 1;
+    }
+
+    ingest(fd, &writer);
+    close(fd);
+
+    return 0;
+}
+
+static int attach_retry(gy85_shm_reader *reader, const char *name, uint32_t timeout_ms)
+{
+    for (uint32_t waited_ms = 0; waited_ms <= timeout_ms; waited_ms++)
+    {
+        int res = reader->attach(name);
+        if (res != SHM_ERROR_NO_DATA)
+        {
+            return res;
+        }
+        usleep(1000);
+    }
+
+    return SHM_ERROR_NO_DATA;
+}
+
+static int run_tail(const char *name)
+{
+    gy85_shm_reader reader;
+    if (attach_retry(&reader, name, 5000) != SHM_OK)
+    {
+        fprintf(stderr, "cannot attach to %s\n", name);
+        return 1;
+    }
+
+    uint64_t reported = 0;
+    while (true)
+    {
+        const gy85_shm_record_t *record;
+        if (reader.begin(&record) != SHM_OK)
+        {
+            if (reader.is_closed())
+            {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        char line[256];
+        snprintf(line, sizeof(line), "%llu %.6f  %f %f %f  %f %f %f  %f %f %f\n",
+                 (unsigned long long)record->index, record->time_ns * 1e-9,
+                 record->accel[0], record->accel[1], record->accel[2],
+                 record->gyro[0], record->gyro[1], record->gyro[2],
+                 record->mag[0], record->mag[1], record->mag[2]);
+        if (reader.end())
+        {
+            fputs(line, stdout);
+        }
+
+        if (reader.lost != reported)
+        {
+            printf("# %llu records lost\n", (unsigned long long)(reader.lost - reported));
+            reported = reader.lost;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Values of the n-th generated record, so every reader can check what it
+ * got. All of them survive the 6 decimals of printf("%f") exactly.
+ */
+static void pattern(uint64_t index, gy85_shm_record_t *record)
+{
+    float n = (float)(index % BENCH_PATTERN);
+    record->accel[0] = n;
+    record->accel[1] = -n / 8;
+    record->accel[2] = 9.8125f;
+    record->gyro[0] = n / 64;
+    record->gyro[1] = 0;
+    record->gyro[2] = -n / 32;
+    record->mag[0] = 2000 - n;
+    record->mag[1] = n * 2;
+    record->mag[2] = -3500;
+}
+
+static bool matches(const gy85_shm_record_t *record)
+{
+    gy85_shm_record_t expected;
+    pattern(record->index, &expected);
+    return memcmp(record->accel, expected.accel, sizeof(expected.accel)) == 0 &&
+           memcmp(record->gyro, expected.gyro, sizeof(expected.gyro)) == 0 &&
+           memcmp(record->mag, expected.mag, sizeof(expected.mag)) == 0;
+}
+
+/**
+ * Reader process: tails the ring until the writer closes it, checking
+ * every record it gets, and sends the counts back through the pipe.
+ */
+static void reader_process(int ready_fd, int result_fd)
+{
+    gy85_shm_reader reader;
+    reader_result_t result = {};
+    if (attach_retry(&reader, BENCH_SHM_NAME, 5000) != SHM_OK)
+    {
+        _exit(1);
+    }
+    if (write(ready_fd, "r", 1) != 1)
+    {
+        _exit(1);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (true)
+    {
+        const gy85_shm_record_t *record;
+        if (reader.begin(&record) != SHM_OK)
+        {
+            if (reader.is_closed() && reader.begin(&record) != SHM_OK)
+            {
+                break;
+            }
+            // Only when idle, one CPU can be shared with the writer
+            sched_yield();
+            continue;
+        }
+
+        bool ok = matches(record);
+        if (reader.end())
+        {
+            result.records++;
+            result.mismatches += !ok;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result.lost = reader.lost;
+    result.torn = reader.torn;
+    result.elapsed_s = elapsed_s(start, end);
+
+    if (write(result_fd, &result, sizeof(result)) != sizeof(result))
+    {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+static bool start_readers(int readers, int result_fd)
+{
+    int ready[2];
+    if (pipe(ready) != 0)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < readers; i++)
+    {
+        if (fork() == 0)
+        {
+            close(ready[0]);
+            reader_process(ready[1], result_fd);
+        }
+    }
+    close(ready[1]);
+
+    // Readers start at the head, wait for all of them before publishing
+    char c;
+    int attached = 0;
+    while (attached < readers && read(ready[0], &c, 1) == 1)
+    {
+        attached++;
+    }
+    close(ready[0]);
+
+    return attached == readers;
+}
+
+static int collect_readers(int readers, int result_fd, uint64_t published)
+{
+    int failures = 0;
+
+    for (int i = 0; i < readers; i++)
+    {
+        reader_result_t result;
+        if (read(result_fd, &result, sizeof(result)) != sizeof(result))
+        {
+            failures++;
+            continue;
+        }
+
+        printf("  reader %d: %llu records (%.0f/s), %llu lost (%llu torn), %llu mismatches\n", i,
+               (unsigned long long)result.records, result.records / result.elapsed_s,
+               (unsigned long long)result.lost, (unsigned long long)result.torn, (unsigned long long)result.mismatches);
+
+        // Everything published is either read or counted as lost
+        if (result.mismatches != 0 || result.records + result.lost != published)
+        {
+            failures++;
+        }
+    }
+
+    while (wait(NULL) > 0)
+    {
+    }
+
+    return failures;
+}
+
+/**
+ * Writes the text of gy85_example into the pty master as fast as it is
+ * taken, the same BENCH_PATTERN records over and over.
+ */
+static void generate(int master, int slave, double seconds, std::atomic<uint64_t> *records)
+{
+    static char text[BENCH_PATTERN * 128];
+    size_t len = 0;
+    for (uint32_t i = 0; i < BENCH_PATTERN; i++)
+    {
+        gy85_shm_record_t record;
+        pattern(i, &record);
+        len += sprintf(text + len, "Accel: %f %f %f\n", record.accel[0], record.accel[1], record.accel[2]);
+        len += sprintf(text + len, "Gyro: %f %f %f\n", record.gyro[0], record.gyro[1], record.gyro[2]);
+        len += sprintf(text + len, "Mag: %f %f %f\n", record.mag[0], record.mag[1], record.mag[2]);
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        for (size_t offset = 0; offset < len;)
+        {
+            ssize_t n = write(master, text + offset, len - offset);
+            if (n <= 0)
+            {
+                return;
+            }
+            offset += n;
+        }
+        records->fetch_add(BENCH_PATTERN, std::memory_order_relaxed);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (elapsed_s(start, now) < seconds);
+
+    // A hang up drops what the slave has not read yet, wait for it to drain
+    int pending = 1;
+    while (ioctl(slave, FIONREAD, &pending) == 0 && pending > 0)
+    {
+        usleep(1000);
+    }
+}
+
+/**
+ * Fan-out cost alone: records published straight into the ring.
+ */
+static int bench_ring(int readers, double seconds)
+{
+    gy85_shm_writer writer;
+    int results[2];
+    if (writer.create(BENCH_SHM_NAME) != SHM_OK || pipe(results) != 0)
+    {
+        return 1;
+    }
+    if (!start_readers(readers, results[1]))
+    {
+        return 1;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t published = 0;
+    do
+    {
+        for (uint32_t i = 0; i < 1024; i++)
+        {
+            gy85_shm_record_t record;
+            pattern(published, &record);
+            record.time_ns = published;
+            writer.publish(&record);
+            published++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (elapsed_s(start, now) < seconds);
+    writer.set_closed();
+
+    double elapsed = elapsed_s(start, now);
+    printf("ring: %llu records in %.2f s, %.0f records/s published, %d readers\n",
+           (unsigned long long)published, elapsed, published / elapsed, readers);
+
+    int failures = collect_readers(readers, results[0], published);
+    close(results[0]);
+    close(results[1]);
+    return failures;
+}
+
+/**
+ * The whole path: text through a pseudo-terminal standing in for the
+ * device, decoded and published by the daemon loop, tailed by the readers.
+ */
+static int bench_pty(int readers, double seconds)
+{
+    // Readers first, they must not inherit the pty or the master would
+    // stay open in them and the slave never see the hang up
+    gy85_shm_writer writer;
+    int results[2];
+    if (writer.create(BENCH_SHM_NAME) != SHM_OK || pipe(results) != 0)
+    {
+        return 1;
+    }
+    if (!start_readers(readers, results[1]))
+    {
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    // Raw mode is set before anything is written
+    int fd = open_device(ptsname(master));
+    if (fd < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+
+    std::atomic<uint64_t> generated(0);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    std::thread generator([&]()
+    {
+        generate(master, fd, seconds, &generated);
+        close(master);
+    });
+    uint64_t bytes = ingest(fd, &writer);
+    generator.join();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    close(fd);
+
+    uint64_t published = writer.get_head();
+    uint64_t parse_errors = writer.get_parse_errors();
+    double elapsed = elapsed_s(start, end);
+    printf("pty: %llu records in %.2f s, %.0f records/s (%.1f MB/s of text), %llu parse errors, %d readers\n",
+           (unsigned long long)published, elapsed, published / elapsed, bytes / elapsed / 1e6,
+           (unsigned long long)parse_errors, readers);
+
+    int failures = collect_readers(readers, results[0], published);
+    close(results[0]);
+    close(results[1]);
+    return failures + (parse_errors != 0 || published != generated.load());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        int readers = argc >= 3 ? atoi(argv[2]) : 4;
+        double seconds = argc >= 4 ? atof(argv[3]) : 2;
+        if (readers < 1 || seconds <= 0)
+        {
+            fprintf(stderr, "usage: %s --bench [readers] [seconds]\n", argv[0]);
+            return 2;
+        }
+
+        int failures = bench_ring(readers, seconds);
+        failures += bench_pty(readers, seconds);
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--tail") == 0)
+    {
+        return run_tail(argc >= 3 ? argv[2] : GY85_SHM_NAME);
+    }
+
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "usage: %s <device> [shm name] [slots]\n", argv[0]);
+        fprintf(stderr, "       %s --tail [shm name]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [readers] [seconds]\n", argv[0]);
+        return 2;
+    }
+
+    return run_daemon(argv[1], argc >= 3 ? argv[2] : GY85_SHM_NAME, argc >= 4 ? strtoul(argv[3], NULL, 0) : GY85_SHM_SLOTS);
+}
@@ -0,0 +1,306 @@
+// Transaction count and order of gy85::init() on the register emulators
+// (tools/emu). Every transfer is recorded below the bus ops: the
+// configuration writes are checked against the expected sequence, the
+// start-up wait must only poll status registers and stop polling a sensor
+// once it is ready, and the first sample must come within the slowest
+// start-up time plus one output period. It also checks that a warm reboot
+// keeps the upper DATA_FORMAT bits and that a sensor that never gets ready
+// times out on elapsed time.
+//
+// Usage: gy85_init
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#define MAX_TRANSACTIONS (512)
+#define ITG3205_INIT_PERIOD_US (8000) ///< 125Hz set by init(), the first sample comes one period after the start-up
+
+typedef struct
+{
+    uint8_t addr;
+    bool write;
+    uint8_t reg;
+    uint8_t len;   ///< Data bytes, the register pointer excluded
+    uint8_t value; ///< First data byte
+} transaction_t;
+
+// Configuration phase of init(), in order
+static const transaction_t expected[] = {
+    {ADXL345_ADDR, false, ADXL345_REG_DEVID, 1, 0},
+    {ADXL345_ADDR, false, ADXL345_REG_DATA_FORMAT, 1, 0},
+    {ADXL345_ADDR, true, ADXL345_REG_DATA_FORMAT, 1, 0},
+    {ADXL345_ADDR, true, ADXL345_REG_BW_RATE, 2, 0},
+    {ITG3205_ADDR, true, ITG3205_REG_PWR_MGM, 1, 0},
+    {ITG3205_ADDR, true, ITG3205_REG_SMPLRT_DIV, 3, 0},
+    {QMC5883L_ADDR, true, QMC5883L_REG_CONFIG_B, 1, 0},
+    {QMC5883L_ADDR, true, QMC5883L_REG_PERIOD, 1, 0},
+    {QMC5883L_ADDR, true, QMC5883L_REG_CONFIG_B, 1, 0},
+    {QMC5883L_ADDR, true, QMC5883L_REG_CONFIG_A, 1, 0},
+};
+
+/**
+ * Records the transfers on their way to the emulators
+ */
+static struct
+{
+    const gy85_bus_ops_t *target;
+    transaction_t log[MAX_TRANSACTIONS];
+    uint32_t count;
+    uint8_t pointer[128]; ///< Register pointer per address, set by the nostop writes
+    bool itg3205_never_ready;
+} recorder;
+
+static void record(uint8_t addr, bool write, uint8_t reg, size_t len, uint8_t value)
+{
+    if (recorder.count < MAX_TRANSACTIONS)
+    {
+        recorder.log[recorder.count] = {addr, write, reg, (uint8_t)len, value};
+    }
+    recorder.count++;
+}
+
+static int record_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    int res = recorder.target->write(recorder.target->context, port, addr, data, len, nostop);
+
+    // A pointer write with a repeated start is the first half of a read
+    if (len > 0)
+    {
+        recorder.pointer[addr & 0x7F] = data[0];
+        if (!nostop)
+        {
+            record(addr, true, data[0], len - 1, len > 1 ? data[1] : 0);
+        }
+    }
+
+    return res;
+}
+
+static int record_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    int res = recorder.target->read(recorder.target->context, port, addr, data, len, nostop);
+    uint8_t reg = recorder.pointer[addr & 0x7F];
+
+    if (recorder.itg3205_never_ready && addr == ITG3205_ADDR && reg == ITG3205_REG_INT_STATUS && len > 0)
+    {
+        data[0] = 0;
+    }
+
+    record(addr, false, reg, len, len > 0 ? data[0] : 0);
+    return res;
+}
+
+static const gy85_bus_ops_t recorder_ops = {record_write, record_read, nullptr};
+
+static void start_recording(gy85_emu *emu)
+{
+    emu->install();
+    recorder.target = gy85_get_bus_ops();
+    recorder.count = 0;
+    recorder.itg3205_never_ready = false;
+    gy85_set_bus_ops(&recorder_ops);
+}
+
+static const char *device_name(uint8_t addr)
+{
+    return addr == ADXL345_ADDR ? "ADXL345" : addr == ITG3205_ADDR ? "ITG3205" : addr == QMC5883L_ADDR ? "QMC5883L" : "?";
+}
+
+static void print_transaction(uint32_t index, const transaction_t *t)
+{
+    printf("  %3lu %-8s %s 0x%02X x%u\n", (unsigned long)index, device_name(t->addr), t->write ? "write" : "read ", t->reg, t->len);
+}
+
+/**
+ * Ready bit of a status poll, false for any other transaction
+ */
+static bool is_status_poll(const transaction_t *t, bool *ready)
+{
+    if (t->write || t->len != 1)
+    {
+        return false;
+    }
+
+    if (t->addr == ADXL345_ADDR && t->reg == ADXL345_REG_INT_SOURCE)
+    {
+        *ready = t->value & 0x80;
+        return true;
+    }
+    if (t->addr == ITG3205_ADDR && t->reg == ITG3205_REG_INT_STATUS)
+    {
+        *ready = t->value & 0x01;
+        return true;
+    }
+    if (t->addr == QMC5883L_ADDR && t->reg == QMC5883L_REG_STATUS)
+    {
+        *ready = t->value & 0x01;
+        return true;
+    }
+
+    return false;
+}
+
+static int check_sequence(gy85 *sensor)
+{
+    const uint32_t config_count = sizeof(expected) / sizeof(expected[0]);
+    int failures = 0;
+
+    if (recorder.count > MAX_TRANSACTIONS)
+    {
+        printf("FAIL: %lu transactions, more than the log holds\n", (unsigned long)recorder.count);
+        return 1;
+    }
+
+    printf("configuration, %lu transactions\n", (unsigned long)config_count);
+    for (uint32_t i = 0; i < config_count; i++)
+    {
+        const transaction_t *t = &recorder.log[i];
+        print_transaction(i, t);
+        if (i >= recorder.count || t->addr != expected[i].addr || t->write != expected[i].write ||
+            t->reg != expected[i].reg || t->len != expected[i].len)
+        {
+            printf("FAIL: expected");
+            print_transaction(i, &expected[i]);
+            failures++;
+        }
+    }
+
+    // Start-up wait: status polls only, each sensor until it is ready
+    bool ready[3] = {false, false, false};
+    const uint8_t addrs[3] = {ADXL345_ADDR, ITG3205_ADDR, QMC5883L_ADDR};
+    for (uint32_t i = config_count; i < recorder.count; i++)
+    {
+        const transaction_t *t = &recorder.log[i];
+        bool bit;
+        if (!is_status_poll(t, &bit))
+        {
+            printf("FAIL: not a status poll");
+            print_transaction(i, t);
+            failures++;
+            continue;
+        }
+
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            if (t->addr != addrs[k])
+            {
+                continue;
+            }
+            if (ready[k])
+            {
+                printf("FAIL: polled again once ready");
+                print_transaction(i, t);
+                failures++;
+            }
+            ready[k] = bit;
+        }
+    }
+
+    uint64_t first_us = sensor->get_init_to_first_sample_us();
+    uint64_t bound_us = GY85_EMU_ITG3205_STARTUP_US + ITG3205_INIT_PERIOD_US + 2 * GY85_INIT_POLL_MS * 1000;
+    printf("start-up wait, %lu status polls, first sample %llu us after init (bound %llu us)\n",
+           (unsigned long)(recorder.count - config_count), (unsigned long long)first_us, (unsigned long long)bound_us);
+
+    if (!ready[0] || !ready[1] || !ready[2])
+    {
+        printf("FAIL: init returned before every sensor was ready\n");
+        failures++;
+    }
+    if (first_us == 0 || first_us > bound_us)
+    {
+        printf("FAIL: first sample out of bound\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    gy85_emu_script still;
+    int failures = 0;
+
+    // Cold boot
+    {
+        gy85_emu_reset_time();
+        gy85_emu emu(&still);
+        start_recording(&emu);
+
+        gy85 sensor;
+        if (sensor.init() != PICO_OK)
+        {
+            printf("FAIL: init\n");
+            return 1;
+        }
+        failures += check_sequence(&sensor);
+        printf("%lu transactions in total\n", (unsigned long)recorder.count);
+        emu.uninstall();
+    }
+
+    // Warm reboot, the ADXL345 keeps INT_INVERT and the full resolution
+    // 16g setting from before, init() only replaces the range bits
+    {
+        gy85_emu_reset_time();
+        gy85_emu emu(&still);
+        emu.install();
+
+        const gy85_bus_ops_t *ops = gy85_get_bus_ops();
+        uint8_t data_format[] = {ADXL345_REG_DATA_FORMAT, 0x20 | 0x08 | RANGE_16_G};
+        ops->write(ops->context, 0, ADXL345_ADDR, data_format, 2, false);
+
+        gy85 sensor;
+        uint8_t reg = 0;
+        if (sensor.init() != PICO_OK ||
+            ops->write(ops->context, 0, ADXL345_ADDR, data_format, 1, true) != 1 ||
+            ops->read(ops->context, 0, ADXL345_ADDR, &reg, 1, false) != 1)
+        {
+            printf("FAIL: warm reboot init\n");
+            return 1;
+        }
+
+        printf("warm reboot, DATA_FORMAT 0x%02X before, 0x%02X after init\n", data_format[1], reg);
+        if (reg != (0x20 | RANGE_2_G))
+        {
+            printf("FAIL: expected 0x%02X\n", 0x20 | RANGE_2_G);
+            failures++;
+        }
+        emu.uninstall();
+    }
+
+    // A gyro that never reports data ready, the wait ends on elapsed time
+    {
+        gy85_emu_reset_time();
+        gy85_emu emu(&still);
+        start_recording(&emu);
+        recorder.itg3205_never_ready = true;
+
+        gy85 sensor;
+        uint64_t start_us = gy85_emu_time_us();
+        int res = sensor.init();
+        uint64_t elapsed_us = gy85_emu_time_us() - start_us;
+
+        printf("gyro never ready, init %d after %llu us (timeout %d ms)\n", res, (unsigned long long)elapsed_us, GY85_INIT_TIMEOUT_MS);
+        if (res == PICO_OK || elapsed_us < GY85_INIT_TIMEOUT_MS * 1000 ||
+            elapsed_us > (GY85_INIT_TIMEOUT_MS + 2 * GY85_INIT_POLL_MS) * 1000)
+        {
+            printf("FAIL: expected a failure after the timeout\n");
+            failures++;
+        }
+        emu.uninstall();
+    }
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
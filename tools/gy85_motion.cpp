@@ -0,0 +1,329 @@
+// Drift and cost of the linear acceleration / zero velocity update
+// estimator (see include/gy85/motion.hpp)
+// Runs gy85_motion on synthetic stop-and-go trajectories with gyro and
+// accel bias and noise: still phases alternate with moves that accelerate,
+// brake to a stop and turn and tilt the sensor on the way. The truth is
+// integrated with a step 100 times finer than the samples. The same
+// estimator with still detection disabled (plain gravity removal and
+// double integration) is the baseline.
+//
+// Usage: gy85_motion [seed]
+//        gy85_motion --bench [samples]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gy85/motion.hpp"
+
+#define SAMPLE_RATE_HZ (100.0)
+#define SUBSTEPS (100)
+#define GRAVITY (9.80665)
+#define MAX_LATENCY_S (0.5) ///< Still flags allowed into a move, the slowest start of a move takes this long to show
+
+typedef struct
+{
+    const char *name;
+    double duration_s;
+    double still_s;  ///< Still phase of every cycle
+    double move_s;   ///< Move phase, the velocity is back to zero at its end
+    double accel;    ///< Peak horizontal acceleration of a move, m/s^2
+    double turn;     ///< Heading change of a move, rad
+    double tilt;     ///< Peak roll of a move, rad
+    double bound;    ///< Max estimator velocity error allowed, m/s
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    {"short stops", 120, 0.6, 2.0, 2.0, 0.8, 0.3, 0.5},
+    {"long moves", 120, 2.0, 8.0, 1.0, 1.5, 0.2, 1.0},
+    {"jogging", 120, 0.5, 1.0, 6.0, 0.3, 0.4, 0.3},
+};
+
+// Sensor errors
+static const double gyro_bias[3] = {0.01, -0.008, 0.006}; ///< rad/s
+static const double gyro_noise = 0.005;                   ///< rad/s per sample
+static const double accel_bias[3] = {0.05, -0.04, 0.08};  ///< m/s^2
+static const double accel_noise = 0.03;                   ///< m/s^2 per sample
+
+static uint64_t rng_state;
+
+static double uniform()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian()
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+typedef struct
+{
+    double w, x, y, z;
+} quat_t;
+
+static quat_t quat_mul(const quat_t &p, const quat_t &q)
+{
+    return {p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z,
+            p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+            p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+            p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w};
+}
+
+static quat_t quat_exp(const double v[3])
+{
+    double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (angle == 0)
+    {
+        return {1, 0, 0, 0};
+    }
+
+    double s = sin(angle / 2) / angle;
+    return {cos(angle / 2), v[0] * s, v[1] * s, v[2] * s};
+}
+
+static void quat_rotate(const quat_t &q, const double v[3], double out[3])
+{
+    quat_t p = {0, v[0], v[1], v[2]};
+    quat_t r = quat_mul(quat_mul(q, p), {q.w, -q.x, -q.y, -q.z});
+    out[0] = r.x;
+    out[1] = r.y;
+    out[2] = r.z;
+}
+
+/**
+ * Navigation frame acceleration and body rates at time t. A move of
+ * length T accelerates along its heading with a sin(2 pi s / T) profile,
+ * so the velocity is back to zero at its end, bobs up and down, turns by
+ * turn and rolls out and back.
+ */
+static bool motion_at(const scenario_t *scenario, double t, double accel[3], double rate[3])
+{
+    double cycle_s = scenario->still_s + scenario->move_s;
+    uint32_t cycle = (uint32_t)(t / cycle_s);
+    double s = t - cycle * cycle_s - scenario->still_s;
+
+    memset(accel, 0, 3 * sizeof(double));
+    memset(rate, 0, 3 * sizeof(double));
+    if (s < 0)
+    {
+        return false;
+    }
+
+    double T = scenario->move_s;
+    double phase = 2 * M_PI * s / T;
+    double heading = cycle * 2.4; // Not the body heading, the frames drift apart on purpose
+
+    accel[0] = scenario->accel * sin(phase) * cos(heading);
+    accel[1] = scenario->accel * sin(phase) * sin(heading);
+    accel[2] = 0.3 * scenario->accel * sin(2 * phase);
+
+    rate[0] = scenario->tilt * M_PI / T * sin(phase);
+    rate[1] = 0.5 * scenario->tilt * 2 * M_PI / T * sin(2 * phase);
+    rate[2] = scenario->turn / T * (1 - cos(phase));
+
+    return true;
+}
+
+typedef struct
+{
+    double velocity_sum2;
+    double velocity_max;
+    double accel_sum2;
+    uint32_t samples;
+    uint32_t still_samples;   ///< Truly still samples
+    uint32_t still_detected;  ///< ... of them flagged still
+    uint32_t stray_still;     ///< Moving samples flagged still after the move was first detected
+    uint32_t latency;         ///< Longest run of them at the start of a move, samples
+    uint32_t run;
+    bool detected;
+} run_stats_t;
+
+static void stats_add(run_stats_t *stats, const gy85_motion_t *out, const double velocity[3], const double linear[3], bool moving)
+{
+    double verror2 = 0, aerror2 = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        verror2 += (out->velocity[i] - velocity[i]) * (out->velocity[i] - velocity[i]);
+        aerror2 += (out->linear_accel[i] - linear[i]) * (out->linear_accel[i] - linear[i]);
+    }
+
+    stats->velocity_sum2 += verror2;
+    stats->velocity_max = fmax(stats->velocity_max, sqrt(verror2));
+    stats->accel_sum2 += aerror2;
+    stats->samples++;
+    stats->still_samples += !moving;
+    stats->still_detected += !moving && out->still;
+
+    // The window lags the start of a move, after that it must not be still
+    if (!moving)
+    {
+        stats->run = 0;
+        stats->detected = false;
+    }
+    else if (!out->still)
+    {
+        stats->detected = true;
+    }
+    else if (stats->detected)
+    {
+        stats->stray_still++;
+    }
+    else
+    {
+        stats->run++;
+        stats->latency = stats->run > stats->latency ? stats->run : stats->latency;
+    }
+}
+
+static int run(const scenario_t *scenario, uint64_t seed)
+{
+    rng_state = seed;
+
+    gy85_motion estimator, baseline;
+    estimator.configure(SAMPLE_RATE_HZ);
+
+    // Never still: gravity removal with the gyro attitude and plain integration
+    gy85_motion_config_t config = gy85_motion_default_config();
+    config.gyro_threshold = 0;
+    baseline.configure(SAMPLE_RATE_HZ, config);
+
+    double period = 1.0 / SAMPLE_RATE_HZ;
+    double step = period / SUBSTEPS;
+    uint32_t samples = (uint32_t)(scenario->duration_s * SAMPLE_RATE_HZ);
+
+    quat_t attitude = {1, 0, 0, 0};
+    double velocity[3] = {0, 0, 0};
+    run_stats_t stats = {}, plain = {};
+    double final_plain = 0;
+
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        double mean_rate[3] = {0, 0, 0};
+        double mean_force[3] = {0, 0, 0};
+        double mean_linear[3] = {0, 0, 0};
+        bool moving = false;
+
+        for (uint32_t k = 0; k < SUBSTEPS; k++)
+        {
+            double t = n * period + (k + 0.5) * step;
+            double accel[3], rate[3];
+            moving |= motion_at(scenario, t, accel, rate);
+
+            double half_angle[3] = {rate[0] * step / 2, rate[1] * step / 2, rate[2] * step / 2};
+            quat_t half = quat_exp(half_angle);
+            attitude = quat_mul(attitude, half);
+
+            // Specific force and linear acceleration in the body frame, mid step
+            quat_t inverse = {attitude.w, -attitude.x, -attitude.y, -attitude.z};
+            double force[3] = {accel[0], accel[1], accel[2] + GRAVITY};
+            double body_force[3], body_linear[3];
+            quat_rotate(inverse, force, body_force);
+            quat_rotate(inverse, accel, body_linear);
+
+            attitude = quat_mul(attitude, half);
+
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                mean_rate[i] += rate[i] / SUBSTEPS;
+                mean_force[i] += body_force[i] / SUBSTEPS;
+                mean_linear[i] += body_linear[i] / SUBSTEPS;
+                velocity[i] += accel[i] * step;
+            }
+        }
+
+        vec3f_t gyro = {mean_rate[0] + gyro_bias[0] + gyro_noise * gaussian(),
+                        mean_rate[1] + gyro_bias[1] + gyro_noise * gaussian(),
+                        mean_rate[2] + gyro_bias[2] + gyro_noise * gaussian()};
+        vec3f_t accel = {mean_force[0] + accel_bias[0] + accel_noise * gaussian(),
+                         mean_force[1] + accel_bias[1] + accel_noise * gaussian(),
+                         mean_force[2] + accel_bias[2] + accel_noise * gaussian()};
+
+        gy85_motion_t out, out_plain;
+        estimator.add(gyro, accel, &out);
+        baseline.add(gyro, accel, &out_plain);
+
+        stats_add(&stats, &out, velocity, mean_linear, moving);
+        stats_add(&plain, &out_plain, velocity, mean_linear, moving);
+        final_plain = sqrt((out_plain.velocity[0] - velocity[0]) * (out_plain.velocity[0] - velocity[0]) +
+                           (out_plain.velocity[1] - velocity[1]) * (out_plain.velocity[1] - velocity[1]) +
+                           (out_plain.velocity[2] - velocity[2]) * (out_plain.velocity[2] - velocity[2]));
+    }
+
+    float bias[3];
+    estimator.get_gyro_bias(bias);
+
+    printf("%-12s %.0f s, still %.1f s / move %.1f s, %.1f m/s^2 peak\n",
+           scenario->name, scenario->duration_s, scenario->still_s, scenario->move_s, scenario->accel);
+    printf("  estimator: velocity error rms %.3f max %.3f m/s, linear accel error rms %.3f m/s^2\n",
+           sqrt(stats.velocity_sum2 / stats.samples), stats.velocity_max, sqrt(stats.accel_sum2 / stats.samples));
+    printf("             still detected %.1f%% of still samples, moves detected %.0f ms late at most, %lu stray still samples\n",
+           100.0 * stats.still_detected / stats.still_samples, 1000 * stats.latency / SAMPLE_RATE_HZ, (unsigned long)stats.stray_still);
+    printf("             gyro bias %.4f %.4f %.4f rad/s (true %.4f %.4f %.4f)\n",
+           bias[0], bias[1], bias[2], gyro_bias[0], gyro_bias[1], gyro_bias[2]);
+    printf("  baseline:  velocity error rms %.3f max %.3f m/s, %.3f m/s at the end, linear accel error rms %.3f m/s^2\n",
+           sqrt(plain.velocity_sum2 / plain.samples), plain.velocity_max, final_plain, sqrt(plain.accel_sum2 / plain.samples));
+
+    bool pass = stats.velocity_max <= scenario->bound && stats.stray_still == 0 &&
+                stats.latency <= MAX_LATENCY_S * SAMPLE_RATE_HZ;
+    printf("  %s: velocity error within %.2f m/s, no stray still samples, moves detected within %.0f ms\n",
+           pass ? "PASS" : "FAIL", scenario->bound, 1000 * MAX_LATENCY_S);
+
+    return pass ? 0 : 1;
+}
+
+static int run_bench(uint32_t samples)
+{
+    gy85_motion estimator;
+    estimator.configure(SAMPLE_RATE_HZ);
+
+    vec3f_t gyro = {0.01, -0.02, 0.03};
+    vec3f_t accel = {0.1, 0.2, 9.8};
+    gy85_motion_t out;
+    float sink = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        // Alternates between still and moving every 256 samples
+        gyro.x = (n & 0x100) ? (n & 0xFF) * 1e-3 : 0;
+        estimator.add(gyro, accel, &out);
+        sink += out.velocity[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("%lu samples, %.1f ns per sample, %lu bytes of state\n",
+           (unsigned long)samples, total_ns / samples, (unsigned long)sizeof(gy85_motion));
+
+    return sink == 1 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000000);
+    }
+
+    uint64_t seed = argc >= 2 ? strtoull(argv[1], NULL, 0) : 1;
+    if (seed == 0)
+    {
+        fprintf(stderr, "usage: %s [seed]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [samples]\n", argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        failures += run(&scenarios[i], seed);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// Noise characterisation sweeps (see include/gy85/noise.hpp) on the
+// register emulators (tools/emu)
+// Each sensor is swept over its noise related enum with white noise of a
+// known density: the settings must come in order with their output period,
+// the random walk of every axis must match the emulated noise within
+// tolerance, and the original configuration must be back afterwards, also
+// when a read fails in the middle of the sweep.
+//
+// Usage: gy85_noise [samples per setting]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gy85/noise.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#define DEG_TO_RAD (M_PI / 180.0)
+#define MAX_SETTINGS (8)
+#define WALK_TOLERANCE (0.15)  ///< Relative random walk error allowed per axis
+#define FAILING_REPORTS (2)    ///< Reports before the read failure of the interrupted sweep
+
+// Densities raised over the emulator defaults so that the slowest setting
+// is still a few lsb of noise and the quantisation stays a small term
+#define ADXL345_NOISE_DENSITY (0.04)                 ///< m/s^2 / sqrt(Hz)
+#define ITG3205_NOISE_DENSITY (0.15 * DEG_TO_RAD)    ///< rad/s / sqrt(Hz)
+#define QMC5883L_NOISE_DENSITY (2e-4)                ///< Gauss / sqrt(Hz)
+#define QMC5883L_COUNTS_PER_GAUSS (3000.0)           ///< 8G range set by init()
+
+typedef struct
+{
+    gy85_sensor_t sensor;
+    const char *name;
+    uint8_t settings[MAX_SETTINGS]; ///< Expected order of the sweep
+    uint8_t count;
+} sweep_t;
+
+static const sweep_t sweeps[SENSOR_COUNT] = {
+    {SENSOR_ADXL345, "adxl345",
+     {DATARATE_12_5_HZ, DATARATE_25_HZ, DATARATE_50_HZ, DATARATE_100_HZ, DATARATE_200_HZ, DATARATE_400_HZ, DATARATE_800_HZ}, 7},
+    {SENSOR_ITG3205, "itg3205", {DLPF_256_8, DLPF_188_1, DLPF_98_1, DLPF_42_1, DLPF_20_1, DLPF_10_1, DLPF_5_1}, 7},
+    {SENSOR_QMC5883L, "qmc5883l", {OVER_SAMPLE_512, OVER_SAMPLE_256, OVER_SAMPLE_128, OVER_SAMPLE_64}, 4},
+};
+
+typedef struct
+{
+    adxl345_data_rate_t adxl345_data_rate;
+    uint8_t itg3205_dlpf_fs;
+    uint8_t itg3205_div;
+    uint8_t qmc5883l_ctrl;
+} config_t;
+
+typedef struct
+{
+    const sweep_t *sweep;
+    uint32_t reports;
+    bool fail_early; ///< Arm a read failure after FAILING_REPORTS reports
+    double worst_error;
+    int failures;
+} sweep_log_t;
+
+/**
+ * Fails the next read on request, on the way to the emulators
+ */
+static struct
+{
+    const gy85_bus_ops_t *target;
+    bool fail_read;
+} faults;
+
+static int fault_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    return faults.target->write(faults.target->context, port, addr, data, len, nostop);
+}
+
+static int fault_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    if (faults.fail_read)
+    {
+        faults.fail_read = false;
+        return PICO_ERROR_TIMEOUT;
+    }
+    return faults.target->read(faults.target->context, port, addr, data, len, nostop);
+}
+
+static const gy85_bus_ops_t fault_ops = {fault_write, fault_read, nullptr};
+
+static int get_config(gy85 *sensor, config_t *config)
+{
+    if (sensor->get_adxl345_data_rate(&config->adxl345_data_rate) != PICO_OK ||
+        sensor->get_itg3205_dlpf_fs(&config->itg3205_dlpf_fs) != PICO_OK ||
+        sensor->get_itg3205_sample_rate_div(&config->itg3205_div) != PICO_OK ||
+        sensor->get_qmc5883l_ctrl(&config->qmc5883l_ctrl) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+    return PICO_OK;
+}
+
+/**
+ * Output period of a setting, from the register model rather than noise.cpp
+ */
+static double expected_period_s(const config_t *config, gy85_sensor_t sensor, uint8_t setting)
+{
+    static const double qmc5883l_periods[] = {0.1, 0.02, 0.01, 0.005};
+
+    switch (sensor)
+    {
+    case SENSOR_ADXL345:
+        return 1.0 / (3200.0 / (1 << (15 - setting)));
+    case SENSOR_ITG3205:
+        return (config->itg3205_div + 1) / (setting == DLPF_256_8 ? 8000.0 : 1000.0);
+    default:
+        return qmc5883l_periods[(config->qmc5883l_ctrl >> 2) & 0x03];
+    }
+}
+
+/**
+ * White noise sigma per sample of the emulated chips, with the
+ * quantisation of one lsb added as lsb^2 / 12, times sqrt(period)
+ */
+static double expected_random_walk(gy85_sensor_t sensor, uint8_t setting, double period_s)
+{
+    static const double itg3205_bandwidth[8] = {256, 188, 98, 42, 20, 10, 5, 256};
+    double sigma, lsb;
+
+    switch (sensor)
+    {
+    case SENSOR_ADXL345:
+        sigma = ADXL345_NOISE_DENSITY * sqrt(0.5 / period_s);
+        lsb = ADXL345_SCALE_FACTOR * SENSORS_GRAVITY_EARTH;
+        break;
+    case SENSOR_ITG3205:
+        sigma = ITG3205_NOISE_DENSITY * sqrt(itg3205_bandwidth[setting]);
+        lsb = DEG_TO_RAD / ITG3205_DIGIT_TO_DEG;
+        break;
+    default:
+        sigma = QMC5883L_NOISE_DENSITY * sqrt(0.5 / period_s) * sqrt((double)(1 << setting)) * QMC5883L_COUNTS_PER_GAUSS;
+        lsb = 1.0;
+        break;
+    }
+
+    return sqrt(sigma * sigma + lsb * lsb / 12.0) * sqrt(period_s);
+}
+
+static config_t sweep_config;
+
+static void check_report(const gy85_noise_report_t *report, void *user_data)
+{
+    sweep_log_t *log = (sweep_log_t *)user_data;
+    const sweep_t *sweep = log->sweep;
+    uint32_t n = log->reports++;
+
+    if (log->fail_early && log->reports == FAILING_REPORTS)
+    {
+        faults.fail_read = true;
+    }
+
+    if (n >= sweep->count || report->sensor != sweep->sensor || report->setting != sweep->settings[n])
+    {
+        printf("FAIL: %s report %lu is setting %u\n", sweep->name, (unsigned long)n, report->setting);
+        log->failures++;
+        return;
+    }
+
+    double period_s = expected_period_s(&sweep_config, sweep->sensor, report->setting);
+    if (fabs(report->sample_period_s - period_s) > 1e-9 * period_s)
+    {
+        printf("FAIL: %s setting %u period %.6g s, expected %.6g s\n", sweep->name, report->setting, report->sample_period_s,
+               period_s);
+        log->failures++;
+    }
+
+    double walk = expected_random_walk(sweep->sensor, report->setting, period_s);
+    printf("  setting %2u %8.4f s  walk %.4g %.4g %.4g expected %.4g", report->setting, period_s, report->axes[0].random_walk,
+           report->axes[1].random_walk, report->axes[2].random_walk, walk);
+
+    double worst = 0;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        double error = fabs(report->axes[i].random_walk / walk - 1.0);
+        worst = error > worst ? error : worst;
+    }
+    printf("  %4.1f%%\n", worst * 100.0);
+
+    if (worst > WALK_TOLERANCE)
+    {
+        printf("FAIL: %s setting %u random walk off by %.1f%%\n", sweep->name, report->setting, worst * 100.0);
+        log->failures++;
+    }
+    log->worst_error = worst > log->worst_error ? worst : log->worst_error;
+}
+
+static int run_sweep(gy85 *sensor, const sweep_t *sweep, uint32_t samples, bool fail_early)
+{
+    static allan_variance axes[3];
+    gy85_noise_report_t report;
+    sweep_log_t log = {sweep, 0, fail_early, 0, 0};
+    config_t after;
+
+    printf("%s%s\n", sweep->name, fail_early ? ", read failure during the sweep" : "");
+    int res = gy85_noise_sweep(sensor, sweep->sensor, samples, axes, &report, check_report, &log);
+    faults.fail_read = false;
+
+    int failures = log.failures;
+    uint32_t expected_reports = fail_early ? FAILING_REPORTS : sweep->count;
+    if ((res == PICO_OK) == fail_early || log.reports != expected_reports)
+    {
+        printf("FAIL: %s sweep returned %d after %lu reports, expected %lu\n", sweep->name, res, (unsigned long)log.reports,
+               (unsigned long)expected_reports);
+        failures++;
+    }
+
+    if (get_config(sensor, &after) != PICO_OK || memcmp(&after, &sweep_config, sizeof(after)) != 0)
+    {
+        printf("FAIL: %s configuration not restored\n", sweep->name);
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [samples per setting]\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t samples = argc == 2 ? strtoul(argv[1], NULL, 0) : 2000;
+    if (samples == 0)
+    {
+        fprintf(stderr, "%s: invalid sample count\n", argv[1]);
+        return 2;
+    }
+
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.adxl345.error.noise_density = ADXL345_NOISE_DENSITY;
+    emu.itg3205.error.noise_density = ITG3205_NOISE_DENSITY;
+    emu.qmc5883l.error.noise_density = QMC5883L_NOISE_DENSITY;
+    emu.install();
+    faults.target = gy85_get_bus_ops();
+    gy85_set_bus_ops(&fault_ops);
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    // Away from the first setting of every sweep, so a missed restore shows
+    memset(&sweep_config, 0, sizeof(sweep_config));
+    if (sensor.set_adxl345_data_rate(DATARATE_200_HZ) != PICO_OK || sensor.set_itg3205_dlpf(DLPF_42_1) != PICO_OK ||
+        sensor.set_qmc5883l_over_sample(OVER_SAMPLE_128) != PICO_OK || get_config(&sensor, &sweep_config) != PICO_OK)
+    {
+        printf("FAIL: configuration\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (uint8_t s = 0; s < SENSOR_COUNT; s++)
+    {
+        failures += run_sweep(&sensor, &sweeps[s], samples, false);
+        failures += run_sweep(&sensor, &sweeps[s], samples, true);
+    }
+
+    gy85_set_bus_ops(nullptr);
+    emu.uninstall();
+
+    printf("%lu samples per setting, virtual time %.1f s\n", (unsigned long)samples, gy85_emu_time_us() * 1e-6);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// Mounting orientations (see include/gy85/orientation.hpp)
+// At compile time: exactly 24 of the 216 signed axis triples are proper
+// rotations, the other 24 permutations of distinct axes are mirrors, and
+// the matrix of every proper one is detected as the same axis aligned
+// orientation. Non rotation matrices are rejected, a rounded 45 degree
+// rotation is not. That rejected declarations fail to compile is checked
+// by tools/CMakeLists.txt.
+// At run time every proper orientation is applied by read_adxl345() on the
+// emulator and compared with R * the unrotated reading, and the setters
+// reject orientations that were built from run time values.
+//
+// Usage: gy85_orientation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+static constexpr gy85_axis_t axes[6] = {AXIS_PX, AXIS_PY, AXIS_PZ, AXIS_NX, AXIS_NY, AXIS_NZ};
+
+static constexpr int count_axes(bool proper)
+{
+    int count = 0;
+    for (int x = 0; x < 6; x++)
+    {
+        for (int y = 0; y < 6; y++)
+        {
+            for (int z = 0; z < 6; z++)
+            {
+                bool distinct = (axes[x] & 0x03) != (axes[y] & 0x03) && (axes[y] & 0x03) != (axes[z] & 0x03) &&
+                                (axes[x] & 0x03) != (axes[z] & 0x03);
+                bool valid = gy85_orientation_axes_valid(axes[x], axes[y], axes[z]);
+                count += proper ? valid : distinct && !valid;
+            }
+        }
+    }
+    return count;
+}
+
+static constexpr bool matrix_path_agrees()
+{
+    for (int x = 0; x < 6; x++)
+    {
+        for (int y = 0; y < 6; y++)
+        {
+            for (int z = 0; z < 6; z++)
+            {
+                if (!gy85_orientation_axes_valid(axes[x], axes[y], axes[z]))
+                {
+                    continue;
+                }
+
+                gy85_orientation_t from_axes = gy85_orientation_axes(axes[x], axes[y], axes[z]);
+                if (!from_axes.valid || !from_axes.aligned || !gy85_orientation_matrix_valid(from_axes.matrix))
+                {
+                    return false;
+                }
+
+                gy85_orientation_t from_matrix = gy85_orientation_matrix(from_axes.matrix);
+                for (int i = 0; i < 3; i++)
+                {
+                    if (!from_matrix.valid || !from_matrix.aligned || from_matrix.axis[i] != from_axes.axis[i] ||
+                        from_matrix.sign[i] != from_axes.sign[i])
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static constexpr float rotate_z_45[3][3] = {{0.7071f, -0.7071f, 0}, {0.7071f, 0.7071f, 0}, {0, 0, 1}};
+static constexpr float mirror_x[3][3] = {{-1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+static constexpr float scaled[3][3] = {{2, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+static constexpr float sheared[3][3] = {{1, 0.5f, 0}, {0, 1, 0}, {0, 0, 1}};
+static constexpr float duplicate_rows[3][3] = {{1, 0, 0}, {1, 0, 0}, {0, 0, 1}};
+
+static_assert(count_axes(true) == 24, "24 proper axis aligned rotations");
+static_assert(count_axes(false) == 24, "24 mirrored axis permutations");
+static_assert(matrix_path_agrees(), "matrix of an axis aligned orientation detected as the same orientation");
+static_assert(gy85_orientation_matrix_valid(rotate_z_45) && !gy85_orientation_matrix(rotate_z_45).aligned, "rounded 45 degree rotation");
+static_assert(!gy85_orientation_matrix_valid(mirror_x), "mirror");
+static_assert(!gy85_orientation_matrix_valid(scaled), "scaled");
+static_assert(!gy85_orientation_matrix_valid(sheared), "sheared");
+static_assert(!gy85_orientation_matrix_valid(duplicate_rows), "duplicate rows");
+
+static void apply(const gy85_orientation_t &orientation, const vec3f_t &in, vec3f_t *out)
+{
+    const double v[3] = {in.x, in.y, in.z};
+    double r[3];
+    for (int i = 0; i < 3; i++)
+    {
+        r[i] = orientation.matrix[i][0] * v[0] + orientation.matrix[i][1] * v[1] + orientation.matrix[i][2] * v[2];
+    }
+    out->x = r[0];
+    out->y = r[1];
+    out->z = r[2];
+}
+
+static double distance(const vec3f_t &a, const vec3f_t &b)
+{
+    return sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z));
+}
+
+static int check_read(gy85 *sensor, const gy85_orientation_t &orientation, const vec3f_t &reference, double *max_error)
+{
+    vec3f_t accel, expected;
+    if (sensor->set_adxl345_orientation(orientation) != PICO_OK || sensor->read_adxl345(&accel) != PICO_OK)
+    {
+        return 1;
+    }
+
+    apply(orientation, reference, &expected);
+    double error = distance(accel, expected);
+    *max_error = error > *max_error ? error : *max_error;
+
+    // Float matrix entries of the non aligned path
+    return error < 1e-5 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    // A noiseless, still sensor with a reading different on every axis
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.adxl345.error.noise_density = 0;
+    emu.adxl345.error.bias[0] = 2.0;
+    emu.adxl345.error.bias[1] = -4.0;
+    emu.install();
+
+    gy85 sensor;
+    vec3f_t reference;
+    if (sensor.init() != PICO_OK || sensor.read_adxl345(&reference) != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    int failures = 0;
+    int proper = 0;
+    double max_error = 0;
+    for (gy85_axis_t x : axes)
+    {
+        for (gy85_axis_t y : axes)
+        {
+            for (gy85_axis_t z : axes)
+            {
+                // Built at run time, the invalid ones must be rejected
+                gy85_orientation_t orientation = gy85_orientation_axes(x, y, z);
+                bool valid = gy85_orientation_axes_valid(x, y, z);
+
+                if (!valid)
+                {
+                    failures += sensor.set_adxl345_orientation(orientation) != PICO_ERROR_INVALID_ARG;
+                    continue;
+                }
+
+                proper++;
+                failures += check_read(&sensor, orientation, reference, &max_error);
+            }
+        }
+    }
+
+    // The matrix path, and a rejected matrix leaves the last orientation
+    failures += check_read(&sensor, gy85_orientation_matrix(rotate_z_45), reference, &max_error);
+    failures += sensor.set_adxl345_orientation(gy85_orientation_matrix(scaled)) != PICO_ERROR_INVALID_ARG;
+
+    vec3f_t accel, expected;
+    apply(gy85_orientation_matrix(rotate_z_45), reference, &expected);
+    failures += sensor.read_adxl345(&accel) != PICO_OK || distance(accel, expected) >= 1e-5;
+
+    printf("%d proper orientations and a 45 degree rotation read on the emulator, max error %.2e m/s^2\n", proper, max_error);
+    printf("reference %.3f %.3f %.3f m/s^2\n", reference.x, reference.y, reference.z);
+    emu.uninstall();
+
+    printf("%s\n", failures == 0 && proper == 24 ? "PASS" : "FAIL");
+    return failures == 0 && proper == 24 ? 0 : 1;
+}
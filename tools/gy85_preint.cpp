@@ -0,0 +1,242 @@
+// Accuracy and cost of the gyro/accel preintegration (see include/gy85/preint.hpp)
+// Drives gy85_preint with analytic coning and sculling motions, where the
+// exact attitude and velocity are known, and compares the propagated
+// increments against them and against plain summed increments.
+//
+// Usage: gy85_preint [input rate Hz] [decimation]
+//        gy85_preint --bench [samples]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gy85/preint.hpp"
+
+#define RUN_TIME_S (10.0)
+#define MOTION_HZ (5.0)
+#define CONE_HALF_ANGLE (0.05)
+#define SCULL_ANGLE (0.05)
+#define SCULL_ACCEL (2.0)
+
+typedef struct
+{
+    double w, x, y, z;
+} quat_t;
+
+static quat_t quat_mul(const quat_t &p, const quat_t &q)
+{
+    return {p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z,
+            p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+            p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+            p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w};
+}
+
+static quat_t quat_exp(const double v[3])
+{
+    double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (angle == 0)
+    {
+        return {1, 0, 0, 0};
+    }
+
+    double s = sin(angle / 2) / angle;
+    return {cos(angle / 2), v[0] * s, v[1] * s, v[2] * s};
+}
+
+static void quat_rotate(const quat_t &q, const double v[3], double out[3])
+{
+    quat_t p = {0, v[0], v[1], v[2]};
+    quat_t r = quat_mul(quat_mul(q, p), {q.w, -q.x, -q.y, -q.z});
+    out[0] = r.x;
+    out[1] = r.y;
+    out[2] = r.z;
+}
+
+static double quat_angle_error(const quat_t &reference, const quat_t &estimate)
+{
+    quat_t e = quat_mul({reference.w, -reference.x, -reference.y, -reference.z}, estimate);
+    return 2 * asin(fmin(1.0, sqrt(e.x * e.x + e.y * e.y + e.z * e.z)));
+}
+
+/**
+ * Coning: the attitude is q(t) = [cos(a/2), 0, sin(a/2) cos(Wt), sin(a/2) sin(Wt)],
+ * the body rate is [-2W sin^2(a/2), -W sin(a) sin(Wt), W sin(a) cos(Wt)].
+ * Inputs are the exact mean rates over each sample period.
+ */
+static quat_t cone_attitude(double t)
+{
+    double a = CONE_HALF_ANGLE;
+    double w = 2 * M_PI * MOTION_HZ;
+    return {cos(a / 2), 0, sin(a / 2) * cos(w * t), sin(a / 2) * sin(w * t)};
+}
+
+static void run_coning(double rate_hz, uint16_t decimation)
+{
+    double a = CONE_HALF_ANGLE;
+    double w = 2 * M_PI * MOTION_HZ;
+    double period = 1.0 / rate_hz;
+    uint32_t samples = (uint32_t)(RUN_TIME_S * rate_hz);
+
+    gy85_preint preint;
+    preint.configure(rate_hz, decimation);
+
+    quat_t compensated = cone_attitude(0);
+    quat_t summed = compensated;
+    double sum[3] = {0, 0, 0};
+
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        double t0 = n * period;
+        double t1 = t0 + period;
+
+        vec3f_t gyro;
+        gyro.x = -2 * w * sin(a / 2) * sin(a / 2);
+        gyro.y = sin(a) * (cos(w * t1) - cos(w * t0)) / period;
+        gyro.z = sin(a) * (sin(w * t1) - sin(w * t0)) / period;
+        vec3f_t accel = {0, 0, 0};
+
+        sum[0] += gyro.x * period;
+        sum[1] += gyro.y * period;
+        sum[2] += gyro.z * period;
+
+        gy85_preint_t out;
+        if (preint.add(gyro, accel, &out))
+        {
+            double dtheta[3] = {out.dtheta[0], out.dtheta[1], out.dtheta[2]};
+            compensated = quat_mul(compensated, quat_exp(dtheta));
+            summed = quat_mul(summed, quat_exp(sum));
+            sum[0] = sum[1] = sum[2] = 0;
+        }
+    }
+
+    quat_t reference = cone_attitude(samples * period);
+    printf("coning   %.3g rad at %.3g Hz, %.3g s: attitude error %.3e rad compensated, %.3e rad summed\n",
+           a, MOTION_HZ, RUN_TIME_S, quat_angle_error(reference, compensated), quat_angle_error(reference, summed));
+}
+
+/**
+ * Sculling: angle A sin(Wt) about x with a body y acceleration B sin(Wt),
+ * which rectifies into a mean z velocity drift of about A B / 2.
+ * The reference velocity is integrated with a step 1000 times finer.
+ */
+static void run_sculling(double rate_hz, uint16_t decimation)
+{
+    double w = 2 * M_PI * MOTION_HZ;
+    double period = 1.0 / rate_hz;
+    uint32_t samples = (uint32_t)(RUN_TIME_S * rate_hz);
+
+    double reference[3] = {0, 0, 0};
+    double step = period / 1000;
+    for (uint64_t n = 0; n < (uint64_t)samples * 1000; n++)
+    {
+        double t = (n + 0.5) * step;
+        double angle = SCULL_ANGLE * sin(w * t);
+        double accel = SCULL_ACCEL * sin(w * t);
+        reference[1] += accel * cos(angle) * step;
+        reference[2] += accel * sin(angle) * step;
+    }
+
+    gy85_preint preint;
+    preint.configure(rate_hz, decimation);
+
+    quat_t compensated_attitude = {1, 0, 0, 0};
+    quat_t summed_attitude = {1, 0, 0, 0};
+    double compensated[3] = {0, 0, 0};
+    double summed[3] = {0, 0, 0};
+    double sum_angle[3] = {0, 0, 0};
+    double sum_vel[3] = {0, 0, 0};
+
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        double t0 = n * period;
+        double t1 = t0 + period;
+
+        vec3f_t gyro = {SCULL_ANGLE * (sin(w * t1) - sin(w * t0)) / period, 0, 0};
+        vec3f_t accel = {0, SCULL_ACCEL * (cos(w * t0) - cos(w * t1)) / (w * period), 0};
+
+        sum_angle[0] += gyro.x * period;
+        sum_vel[1] += accel.y * period;
+
+        gy85_preint_t out;
+        if (preint.add(gyro, accel, &out))
+        {
+            double dtheta[3] = {out.dtheta[0], out.dtheta[1], out.dtheta[2]};
+            double dvel[3] = {out.dvel[0], out.dvel[1], out.dvel[2]};
+            double rotated[3];
+
+            quat_rotate(compensated_attitude, dvel, rotated);
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                compensated[i] += rotated[i];
+            }
+            compensated_attitude = quat_mul(compensated_attitude, quat_exp(dtheta));
+
+            quat_rotate(summed_attitude, sum_vel, rotated);
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                summed[i] += rotated[i];
+            }
+            summed_attitude = quat_mul(summed_attitude, quat_exp(sum_angle));
+
+            memset(sum_angle, 0, sizeof(sum_angle));
+            memset(sum_vel, 0, sizeof(sum_vel));
+        }
+    }
+
+    double compensated_error = hypot(compensated[1] - reference[1], compensated[2] - reference[2]);
+    double summed_error = hypot(summed[1] - reference[1], summed[2] - reference[2]);
+    printf("sculling %.3g rad x %.3g m/s^2 at %.3g Hz, %.3g s: velocity error %.3e m/s compensated, %.3e m/s summed (drift %.3e m/s)\n",
+           SCULL_ANGLE, SCULL_ACCEL, MOTION_HZ, RUN_TIME_S, compensated_error, summed_error, reference[2]);
+}
+
+static int run_bench(uint32_t samples)
+{
+    gy85_preint preint;
+    preint.configure(1000, 10);
+
+    vec3f_t gyro = {0.01, -0.02, 0.03};
+    vec3f_t accel = {0.1, 0.2, 9.8};
+    gy85_preint_t out;
+    float sink = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        gyro.x = (n & 0xFF) * 1e-4;
+        if (preint.add(gyro, accel, &out))
+        {
+            sink += out.dtheta[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("%lu samples, %.1f ns per sample (decimation 10)\n", (unsigned long)samples, total_ns / samples);
+
+    return sink == 1 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000000);
+    }
+
+    double rate_hz = argc >= 2 ? atof(argv[1]) : 1000;
+    long decimation = argc >= 3 ? atol(argv[2]) : 10;
+    if (rate_hz <= 0 || decimation <= 0 || decimation > UINT16_MAX)
+    {
+        fprintf(stderr, "usage: %s [input rate Hz] [decimation]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [samples]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%.6g Hz in, %.6g Hz out\n", rate_hz, rate_hz / decimation);
+    run_coning(rate_hz, (uint16_t)decimation);
+    run_sculling(rate_hz, (uint16_t)decimation);
+
+    return 0;
+}
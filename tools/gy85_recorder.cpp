@@ -0,0 +1,437 @@
+// Exports a recorder image and checks the recorder on a file-backed store
+// (see include/gy85/recorder.hpp)
+// The image is a dump of the storage region the device records into.
+//
+// Usage: gy85_recorder export <image file>
+//        gy85_recorder --bench [image file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "gy85/recorder.hpp"
+#include "file_storage.hpp"
+
+#define BENCH_REGION_SIZE (256 * 1024)
+#define POWER_LOSS_REGION_SIZE (16 * GY85_FLASH_SECTOR_SIZE)
+#define POWER_LOSS_TRIALS (500)
+
+static uint32_t random_state = 0x9E3779B9;
+
+static uint32_t random_next()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static double elapsed_s(const struct timespec &start, const struct timespec &end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+static int run_export(const char *path)
+{
+    // The dump is left as it is, a dirty slot is not retired
+    gy85_file_storage storage;
+    gy85_recorder recorder(&storage);
+    if (storage.open_read_only(path) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    if (recorder.recover(true) != 0)
+    {
+        fprintf(stderr, "%s: not a usable recorder image\n", path);
+        return 1;
+    }
+
+    gy85_recorder_cursor_t cursor;
+    uint8_t payload[GY85_RECORDER_PAYLOAD_SIZE];
+    uint16_t len;
+    uint32_t sequence;
+    gy85_raw_record_t records[GY85_CODEC_MAX_RECORDS];
+
+    recorder.begin_export(&cursor);
+    while (recorder.read_next(&cursor, payload, &len, &sequence) == 0)
+    {
+        int count = gy85_codec_decode(payload, len, records, GY85_CODEC_MAX_RECORDS);
+        if (count < 0)
+        {
+            fprintf(stderr, "block %lu: not a codec block\n", (unsigned long)sequence);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            const gy85_raw_record_t &record = records[i];
+            printf("%lu %d %d %d %d %d %d %d %d %d\n", (unsigned long)record.timestamp_us,
+                   record.accel[0], record.accel[1], record.accel[2],
+                   record.gyro[0], record.gyro[1], record.gyro[2],
+                   record.mag[0], record.mag[1], record.mag[2]);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Records through the codec until the store wrapped a few times, then
+ * reports the throughput, the erase spread and the cost of a recovery
+ */
+static bool bench_throughput(gy85_file_storage &storage)
+{
+    gy85_recorder recorder(&storage);
+    if (recorder.recover() != 0)
+    {
+        return false;
+    }
+
+    gy85_raw_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    uint32_t blocks_target = 4 * BENCH_REGION_SIZE / GY85_RECORDER_SLOT_SIZE;
+    uint32_t records = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (recorder.get_sequence() < blocks_target)
+    {
+        record.timestamp_us = records * 1000;
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            record.accel[i] = (int16_t)(256 * (i == 2) + (int32_t)(random_next() % 7) - 3);
+            record.gyro[i] = (int16_t)((int32_t)(random_next() % 9) - 4);
+            record.mag[i] = (int16_t)(1000 + (int32_t)(random_next() % 5) - 2);
+        }
+
+        if (recorder.add(record) != 0)
+        {
+            return false;
+        }
+        records++;
+    }
+    recorder.flush();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint32_t min_erases, max_erases;
+    recorder.get_wear(&min_erases, &max_erases);
+
+    printf("throughput: %lu records in %lu blocks, %.0f records/s, %.1f records per block (file backed, not flash timing)\n",
+           (unsigned long)records, (unsigned long)recorder.get_sequence(), records / elapsed_s(start, end),
+           (double)records / recorder.get_sequence());
+    printf("wear: %lu sectors erased %lu..%lu times, %lu erases, %lu page programs\n",
+           (unsigned long)(BENCH_REGION_SIZE / GY85_FLASH_SECTOR_SIZE), (unsigned long)min_erases, (unsigned long)max_erases,
+           (unsigned long)storage.erases, (unsigned long)storage.programs);
+
+    gy85_recorder rebooted(&storage);
+    storage.reset_counters();
+    if (rebooted.recover() != 0 || rebooted.get_sequence() != recorder.get_sequence())
+    {
+        printf("recovery: FAILED\n");
+        return false;
+    }
+    printf("recovery: %lu reads, %lu of %lu bytes\n",
+           (unsigned long)storage.reads, (unsigned long)storage.bytes_read, (unsigned long)BENCH_REGION_SIZE);
+
+    return max_erases - min_erases <= 1;
+}
+
+static void fill_payload(uint32_t sequence, uint8_t *payload, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        payload[i] = (uint8_t)(sequence * 31 + i);
+    }
+}
+
+/**
+ * Appends until a power cut at a random erase/program, reboots and checks
+ * that every acknowledged block still in the log is exported intact, in
+ * order, and that recording continues after it
+ */
+static bool bench_power_loss(gy85_file_storage &storage, uint32_t *torn_blocks)
+{
+    uint8_t payload[GY85_RECORDER_PAYLOAD_SIZE];
+    uint8_t expected[GY85_RECORDER_PAYLOAD_SIZE];
+    std::vector<bool> acked;
+
+    // Start from a log that already wrapped a random amount
+    gy85_recorder recorder(&storage);
+    if (recorder.recover() != 0)
+    {
+        return false;
+    }
+    uint32_t first_sequence = recorder.get_sequence();
+
+    storage.cut_power_after(random_next() % 200);
+    while (true)
+    {
+        uint32_t sequence = recorder.get_sequence();
+        uint16_t len = 1 + random_next() % GY85_RECORDER_PAYLOAD_SIZE;
+        fill_payload(sequence, payload, len);
+
+        if (recorder.append(payload, len) != 0)
+        {
+            break;
+        }
+        acked.resize(sequence - first_sequence + 1);
+        acked[sequence - first_sequence] = true;
+    }
+    storage.power_on();
+
+    gy85_recorder rebooted(&storage);
+    if (rebooted.recover() != 0 || rebooted.get_sequence() < first_sequence + acked.size())
+    {
+        return false;
+    }
+
+    gy85_recorder_cursor_t cursor;
+    uint16_t len;
+    uint32_t sequence;
+    bool has_previous = false;
+    uint32_t previous = 0;
+
+    rebooted.begin_export(&cursor);
+    while (rebooted.read_next(&cursor, payload, &len, &sequence) == 0)
+    {
+        fill_payload(sequence, expected, len);
+        if (memcmp(payload, expected, len) != 0 || (has_previous && sequence <= previous))
+        {
+            return false;
+        }
+
+        if (has_previous)
+        {
+            *torn_blocks += sequence - previous - 1;
+        }
+
+        // Acknowledged blocks newer than the oldest one exported must all be there
+        for (uint32_t s = has_previous ? previous + 1 : sequence; s < sequence; s++)
+        {
+            if (s >= first_sequence && s - first_sequence < acked.size() && acked[s - first_sequence])
+            {
+                return false;
+            }
+        }
+
+        has_previous = true;
+        previous = sequence;
+    }
+
+    // The last acknowledged block is never lost
+    if (!acked.empty() && (!has_previous || (int32_t)(previous - (first_sequence + (uint32_t)acked.size() - 1)) < 0))
+    {
+        return false;
+    }
+
+    // Recording carries on after the reboot
+    fill_payload(rebooted.get_sequence(), payload, 16);
+    return rebooted.append(payload, 16) == 0;
+}
+
+static bool read_image(const char *path, std::vector<uint8_t> *image)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    uint8_t buffer[4096];
+    size_t n;
+    image->clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        image->insert(image->end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * Exports the image the way run_export() does, from a read-only open.
+ * Returns the number of blocks, -1 when the recorder wrote or could append.
+ */
+static int export_read_only(const char *path)
+{
+    gy85_file_storage image;
+    gy85_recorder recorder(&image);
+    if (image.open_read_only(path) != 0 || recorder.recover(true) != 0)
+    {
+        return -1;
+    }
+
+    uint8_t payload[GY85_RECORDER_PAYLOAD_SIZE];
+    uint16_t len;
+    uint32_t sequence;
+    gy85_recorder_cursor_t cursor;
+    int blocks = 0;
+    recorder.begin_export(&cursor);
+    while (recorder.read_next(&cursor, payload, &len, &sequence) == 0)
+    {
+        blocks++;
+    }
+
+    memset(payload, 0, sizeof(payload));
+    if (recorder.append(payload, 1) == 0 || image.erases != 0 || image.programs != 0)
+    {
+        return -1;
+    }
+
+    return blocks;
+}
+
+/**
+ * A slot with a blank header over a dirty payload at the write position,
+ * what a partly landed program can leave. recover() must not resume there,
+ * the next block has to export intact, and a read-only export of the dump
+ * must leave the dirty slot alone.
+ */
+static bool bench_dirty_slot(gy85_file_storage &storage, const char *path)
+{
+    uint8_t payload[GY85_RECORDER_PAYLOAD_SIZE];
+    uint16_t len;
+    uint32_t sequence;
+
+    gy85_recorder recorder(&storage);
+    if (recorder.recover() != 0)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        fill_payload(recorder.get_sequence(), payload, 100);
+        if (recorder.append(payload, 100) != 0)
+        {
+            return false;
+        }
+    }
+
+    // Clear one payload byte of the next slot, its header stays blank
+    uint32_t dirty = sizeof(gy85_recorder_sector_header_t) + 3 * GY85_RECORDER_SLOT_SIZE +
+                     sizeof(gy85_recorder_block_header_t) + 40;
+    uint8_t page[GY85_FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    page[dirty % GY85_FLASH_PAGE_SIZE] = 0x00;
+    if (storage.program(dirty - dirty % GY85_FLASH_PAGE_SIZE, page, sizeof(page)) != 0)
+    {
+        return false;
+    }
+
+    // Exporting the dump leaves it byte for byte as it is
+    std::vector<uint8_t> before, after;
+    if (!read_image(path, &before))
+    {
+        return false;
+    }
+    int exported = export_read_only(path);
+    if (!read_image(path, &after))
+    {
+        return false;
+    }
+    bool untouched = before == after;
+
+    gy85_recorder rebooted(&storage);
+    if (rebooted.recover() != 0)
+    {
+        return false;
+    }
+    uint32_t appended = rebooted.get_sequence();
+    fill_payload(appended, payload, GY85_RECORDER_PAYLOAD_SIZE);
+    if (rebooted.append(payload, GY85_RECORDER_PAYLOAD_SIZE) != 0)
+    {
+        return false;
+    }
+
+    uint8_t expected[GY85_RECORDER_PAYLOAD_SIZE];
+    gy85_recorder_cursor_t cursor;
+    uint32_t blocks = 0;
+    bool found = false;
+    rebooted.begin_export(&cursor);
+    while (rebooted.read_next(&cursor, payload, &len, &sequence) == 0)
+    {
+        fill_payload(sequence, expected, len);
+        if (memcmp(payload, expected, len) != 0)
+        {
+            return false;
+        }
+        found |= sequence == appended;
+        blocks++;
+    }
+
+    printf("dirty slot: read-only export %d blocks, image %s, resumed at sequence %lu, %lu blocks exported, appended block %s\n",
+           exported, untouched ? "unchanged" : "changed", (unsigned long)appended, (unsigned long)blocks,
+           found ? "intact" : "lost");
+
+    return exported == 3 && untouched && found && blocks == 4;
+}
+
+static int run_bench(const char *path)
+{
+    gy85_file_storage storage;
+
+    if (storage.open(path, BENCH_REGION_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    bool throughput_ok = bench_throughput(storage);
+
+    if (storage.open(path, POWER_LOSS_REGION_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t failures = 0;
+    uint32_t torn_blocks = 0;
+    for (uint32_t trial = 0; trial < POWER_LOSS_TRIALS; trial++)
+    {
+        if (!bench_power_loss(storage, &torn_blocks))
+        {
+            failures++;
+        }
+    }
+
+    uint32_t min_erases, max_erases;
+    gy85_recorder recorder(&storage);
+    recorder.recover();
+    recorder.get_wear(&min_erases, &max_erases);
+
+    printf("power loss: %lu trials, %lu failed, %lu torn or dropped blocks skipped, erases %lu..%lu\n",
+           (unsigned long)POWER_LOSS_TRIALS, (unsigned long)failures, (unsigned long)torn_blocks,
+           (unsigned long)min_erases, (unsigned long)max_erases);
+
+    if (storage.open(path, POWER_LOSS_REGION_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    bool dirty_slot_ok = bench_dirty_slot(storage, path);
+
+    storage.close();
+    remove(path);
+
+    return throughput_ok && failures == 0 && dirty_slot_ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_bench(argc >= 3 ? argv[2] : "gy85_recorder.img");
+    }
+
+    if (argc == 3 && strcmp(argv[1], "export") == 0)
+    {
+        return run_export(argv[2]);
+    }
+
+    fprintf(stderr, "usage: %s export <image file>\n", argv[0]);
+    fprintf(stderr, "       %s --bench [image file]\n", argv[0]);
+    return 2;
+}
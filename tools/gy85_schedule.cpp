@@ -0,0 +1,288 @@
+// Periodic schedule on a simulated clock (see gy85_schedule in
+// include/gy85/sampler.hpp)
+// The alarm is modelled the way gy85_sampler uses it: it fires at the
+// target plus an interrupt latency, the reads keep the interrupt busy, and
+// the next alarm is the target fire() returns, or right away when the
+// reads ran past it. Checks that the targets stay on the start + n * period
+// grid, across 2^32 us too, that overruns skip whole periods and count them
+// as missed, and the period error statistics. The last case reads the
+// three sensors on the emulators at the output data rate and reports how
+// long the reads keep the alarm interrupt busy.
+//
+// Usage: gy85_schedule
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gy85/gy85.hpp"
+#include "gy85/sampler.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#define PERIOD_US (1000)
+#define PERIODS (100000)
+#define JITTER_US (40)
+#define START_US (0xFFFF0000ull) ///< Crosses 2^32 us after about 65 periods
+#define EMU_SECONDS (10)
+
+static uint32_t random_state = 0x9E3779B9;
+
+static uint32_t random_next()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+typedef struct
+{
+    uint32_t latency_us; ///< Alarm to interrupt entry
+    uint32_t busy_us;    ///< Reads in the interrupt
+} period_load_t;
+
+/**
+ * Runs the schedule for periods alarms, load() gives the latency and busy
+ * time of every one. Returns the failures of the grid checks.
+ */
+static int simulate(gy85_schedule *schedule, uint64_t start_us, uint32_t periods, period_load_t (*load)(uint32_t n),
+                    uint32_t *index_gaps)
+{
+    int failures = 0;
+    uint64_t alarm_us = schedule->get_target_us();
+    bool has_index = false;
+    uint32_t last_index = 0;
+    *index_gaps = 0;
+
+    for (uint32_t n = 0; n < periods; n++)
+    {
+        period_load_t l = load(n);
+        uint64_t now = alarm_us + l.latency_us;
+        uint64_t next = schedule->fire(now);
+
+        if (next <= now || next - now > PERIOD_US || (next - start_us) % PERIOD_US != 0)
+        {
+            if (failures++ < 5)
+            {
+                printf("  FAIL: period %lu fired at %llu, next target %llu off the grid\n", (unsigned long)n,
+                       (unsigned long long)now, (unsigned long long)next);
+            }
+        }
+
+        uint32_t index = schedule->get_index();
+        if (has_index)
+        {
+            *index_gaps += index - last_index - 1;
+        }
+        has_index = true;
+        last_index = index;
+
+        // A negative alarm return value reschedules from the previous
+        // target, an alarm already in the past fires right away
+        uint64_t done = now + l.busy_us;
+        alarm_us = next > done ? next : done;
+    }
+
+    return failures;
+}
+
+static period_load_t jitter_load(uint32_t n)
+{
+    (void)n;
+    return {random_next() % (JITTER_US + 1), 200};
+}
+
+static period_load_t overrun_load(uint32_t n)
+{
+    // Every 100th period the reads take 2.5 periods
+    return {random_next() % (JITTER_US + 1), n % 100 == 0 ? (uint32_t)(PERIOD_US * 5 / 2) : 200u};
+}
+
+static uint32_t late_every;
+
+static period_load_t late_load(uint32_t n)
+{
+    // 50us late on a few periods, on time otherwise
+    return {late_every > 0 && n % late_every == late_every / 2 ? 50u : 0u, 0};
+}
+
+static int check_on_time()
+{
+    gy85_schedule schedule;
+    gy85_sampler_stats_t stats;
+    uint32_t gaps;
+
+    schedule.start(START_US, PERIOD_US);
+    int failures = simulate(&schedule, START_US, PERIODS, jitter_load, &gaps);
+    schedule.get_stats(&stats);
+
+    uint64_t expected_target = START_US + (uint64_t)(PERIODS + 1) * PERIOD_US;
+    printf("on time: %lu periods, %lu missed, latency max %lu us, period error %ld..%ld us, p99 %lu us\n",
+           (unsigned long)stats.periods, (unsigned long)stats.missed, (unsigned long)stats.latency_max_us,
+           (long)stats.period_error_min_us, (long)stats.period_error_max_us, (unsigned long)stats.period_error_p99_us);
+
+    if (stats.periods != PERIODS || stats.missed != 0 || gaps != 0 || schedule.get_index() != PERIODS - 1 ||
+        schedule.get_target_us() != expected_target)
+    {
+        printf("  FAIL: expected no miss and target %llu, got %llu\n", (unsigned long long)expected_target,
+               (unsigned long long)schedule.get_target_us());
+        failures++;
+    }
+    if (stats.latency_max_us > JITTER_US || stats.period_error_min_us < -JITTER_US ||
+        stats.period_error_max_us > JITTER_US)
+    {
+        printf("  FAIL: latency or period error beyond the %d us jitter\n", JITTER_US);
+        failures++;
+    }
+
+    return failures;
+}
+
+static int check_overrun()
+{
+    gy85_schedule schedule;
+    gy85_sampler_stats_t stats;
+    uint32_t gaps;
+
+    schedule.start(START_US, PERIOD_US);
+    int failures = simulate(&schedule, START_US, PERIODS, overrun_load, &gaps);
+    schedule.get_stats(&stats);
+
+    // A 2.5 period overrun skips the next target and fires half way into
+    // the one after it, its latency and the late alarm's add up
+    uint32_t overruns = PERIODS / 100;
+    printf("overrun: %lu overruns, %lu missed, index gaps %lu, latency max %lu us\n", (unsigned long)overruns,
+           (unsigned long)stats.missed, (unsigned long)gaps, (unsigned long)stats.latency_max_us);
+
+    if (stats.missed != overruns || gaps != stats.missed ||
+        schedule.get_index() != PERIODS - 1 + stats.missed)
+    {
+        printf("  FAIL: expected %lu missed periods, matching the index gaps\n", (unsigned long)overruns);
+        failures++;
+    }
+    if (stats.latency_max_us < PERIOD_US / 2 || stats.latency_max_us > PERIOD_US / 2 + 2 * JITTER_US)
+    {
+        printf("  FAIL: the late period should be %d us late\n", PERIOD_US / 2);
+        failures++;
+    }
+
+    return failures;
+}
+
+static int check_p99(uint32_t every, uint32_t expected_p99)
+{
+    gy85_schedule schedule;
+    gy85_sampler_stats_t stats;
+    uint32_t gaps;
+
+    late_every = every;
+    schedule.start(START_US, PERIOD_US);
+    int failures = simulate(&schedule, START_US, 1001, late_load, &gaps);
+    schedule.get_stats(&stats);
+
+    // Every late period is two intervals off by 50us
+    printf("p99: 1000 intervals, %lu of them 50 us off, p99 %lu us (expected %lu)\n", (unsigned long)(2000 / every),
+           (unsigned long)stats.period_error_p99_us, (unsigned long)expected_p99);
+
+    if (stats.period_error_p99_us != expected_p99 || stats.period_error_min_us != -50 || stats.period_error_max_us != 50)
+    {
+        printf("  FAIL\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+/**
+ * The reads gy85_sampler does in the alarm interrupt, on the emulated bus
+ * and virtual clock
+ */
+static int check_emulated_reads()
+{
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.install();
+
+    gy85 sensor;
+    uint32_t period_us;
+    if (sensor.init() != PICO_OK || sensor.get_odr_period_us(&period_us) != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    gy85_schedule schedule;
+    gy85_sampler_stats_t stats;
+    uint64_t start_us = time_us_64();
+    uint64_t busy_max_us = 0;
+    uint64_t busy_total_us = 0;
+    uint32_t periods = EMU_SECONDS * 1000000 / period_us;
+    int failures = 0;
+
+    schedule.start(start_us, period_us);
+    for (uint32_t n = 0; n < periods; n++)
+    {
+        uint64_t now = time_us_64();
+        if (schedule.get_target_us() > now)
+        {
+            sleep_us(schedule.get_target_us() - now);
+        }
+
+        uint64_t fired_us = time_us_64();
+        uint64_t next = schedule.fire(fired_us);
+
+        vec3f_t accel, gyro, mag;
+        int res_accel = sensor.read_adxl345(&accel);
+        int res_gyro = sensor.read_itg3205(&gyro);
+        int res_mag = sensor.read_qmc5883l(&mag);
+        if ((res_accel != PICO_OK && res_accel != PICO_ERROR_NO_DATA) ||
+            (res_gyro != PICO_OK && res_gyro != PICO_ERROR_NO_DATA) ||
+            (res_mag != PICO_OK && res_mag != PICO_ERROR_NO_DATA))
+        {
+            schedule.record_error();
+        }
+
+        uint64_t busy_us = time_us_64() - fired_us;
+        busy_max_us = busy_us > busy_max_us ? busy_us : busy_max_us;
+        busy_total_us += busy_us;
+
+        if ((next - start_us) % period_us != 0)
+        {
+            failures++;
+        }
+    }
+    schedule.get_stats(&stats);
+    emu.uninstall();
+
+    printf("emulated reads: %lu periods of %lu us, %lu missed, %lu errors, interrupt busy %.1f us mean, %llu us max (%.1f%% of the period)\n",
+           (unsigned long)stats.periods, (unsigned long)period_us, (unsigned long)stats.missed,
+           (unsigned long)stats.errors, (double)busy_total_us / periods, (unsigned long long)busy_max_us,
+           100.0 * busy_max_us / period_us);
+
+    if (failures > 0 || stats.missed != 0 || stats.errors != 0 || busy_max_us >= period_us)
+    {
+        printf("  FAIL\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    failures += check_on_time();
+    failures += check_overrun();
+    failures += check_p99(200, GY85_SAMPLER_JITTER_BIN_US);          // 1% of the intervals
+    failures += check_p99(100, 13 * GY85_SAMPLER_JITTER_BIN_US);     // 2%, the 48..52us bin
+    failures += check_emulated_reads();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
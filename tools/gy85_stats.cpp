@@ -0,0 +1,458 @@
+// Driver instrumentation (see include/gy85/stats.hpp), built with
+// GY85_STATS=1 on the register emulators (tools/emu)
+// Every transfer is counted below the bus ops as the reference: known
+// reads and writes must give the same transactions and bytes per sensor,
+// an injected failure of each kind must land in its error cause, and the
+// latency histogram of every operation must match the durations measured
+// on the virtual clock. Also checks the bucket edges, that a snapshot is a
+// copy, that reset keeps the header, and that the text and binary dumps
+// hold the same numbers.
+//
+// Usage: gy85_stats
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "pico/stdlib.h"
+
+#if !GY85_STATS
+#error "gy85_stats must be built with GY85_STATS=1"
+#endif
+
+#define ROUNDS (50)
+
+/**
+ * Counts the transfers on their way to the emulators and fails the next
+ * read of one address on request
+ */
+static struct
+{
+    const gy85_bus_ops_t *target;
+    gy85_bus_stats_t bus[SENSOR_COUNT];
+    uint8_t fail_addr;
+    int fail_result; ///< Returned instead of the read, PICO_OK when nothing is armed
+    bool fail_short; ///< Return one byte less instead
+    size_t pointer_bytes; ///< Register pointer written ahead of the next read
+} reference;
+
+static int sensor_index(uint8_t addr)
+{
+    return addr == ADXL345_ADDR ? SENSOR_ADXL345 : addr == ITG3205_ADDR ? SENSOR_ITG3205 : SENSOR_QMC5883L;
+}
+
+static int reference_write(void *context, uint8_t port, uint8_t addr, const uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    int res = reference.target->write(reference.target->context, port, addr, data, len, nostop);
+
+    // The register pointer of a read only counts once the read succeeded
+    if (nostop)
+    {
+        reference.pointer_bytes = len;
+        return res;
+    }
+
+    gy85_bus_stats_t *bus = &reference.bus[sensor_index(addr)];
+    bus->transactions++;
+    bus->bytes_written += len;
+
+    return res;
+}
+
+static int reference_read(void *context, uint8_t port, uint8_t addr, uint8_t *data, size_t len, bool nostop)
+{
+    (void)context;
+    int res = reference.target->read(reference.target->context, port, addr, data, len, nostop);
+    gy85_bus_stats_t *bus = &reference.bus[sensor_index(addr)];
+    bus->transactions++;
+
+    if (addr == reference.fail_addr && (reference.fail_result != PICO_OK || reference.fail_short))
+    {
+        res = reference.fail_short ? (int)len - 1 : reference.fail_result;
+        reference.fail_result = PICO_OK;
+        reference.fail_short = false;
+        return res;
+    }
+
+    bus->bytes_read += len;
+    bus->bytes_written += reference.pointer_bytes;
+    return res;
+}
+
+static const gy85_bus_ops_t reference_ops = {reference_write, reference_read, nullptr};
+
+/**
+ * Runs one driver call and records its duration on the virtual clock in
+ * the expected histogram of op
+ */
+#define TIMED(expected, op, call)                                                   \
+    {                                                                               \
+        uint32_t start_us = time_us_32();                                           \
+        call;                                                                       \
+        gy85_latency_record(&(expected)->ops[op], time_us_32() - start_us);         \
+    }
+
+static int check_bucket_edges()
+{
+    // Bucket i holds [2^(i-1), 2^i) us, 0 only holds 0, the last one is open
+    static const uint32_t values[] = {0, 1, 2, 3, 4, 7, 8, 255, 256, 16383, 16384, 1000000, UINT32_MAX};
+    static const uint8_t buckets[] = {0, 1, 2, 2, 3, 3, 4, 8, 9, 14, 15, 15, 15};
+    int failures = 0;
+
+    for (uint32_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        gy85_latency_stats_t latency;
+        memset(&latency, 0, sizeof(latency));
+        gy85_latency_record(&latency, values[i]);
+
+        if (latency.count != 1 || latency.max_us != values[i] || latency.buckets[buckets[i]] != 1)
+        {
+            printf("FAIL: %lu us not in bucket %u\n", (unsigned long)values[i], buckets[i]);
+            failures++;
+        }
+    }
+
+    printf("bucket edges: %lu values\n", (unsigned long)(sizeof(values) / sizeof(values[0])));
+    return failures;
+}
+
+static int compare_bus(const gy85_stats_t *stats, const char *phase)
+{
+    static const char *names[SENSOR_COUNT] = {"adxl345", "itg3205", "qmc5883l"};
+    int failures = 0;
+
+    for (uint8_t s = 0; s < SENSOR_COUNT; s++)
+    {
+        const gy85_bus_stats_t *got = &stats->bus[s];
+        const gy85_bus_stats_t *want = &reference.bus[s];
+        printf("  %-8s tx %lu/%lu rd %lu/%lu wr %lu/%lu errors %lu %lu %lu %lu %lu\n", names[s],
+               (unsigned long)got->transactions, (unsigned long)want->transactions, (unsigned long)got->bytes_read,
+               (unsigned long)want->bytes_read, (unsigned long)got->bytes_written, (unsigned long)want->bytes_written,
+               (unsigned long)got->errors[BUS_ERROR_NACK], (unsigned long)got->errors[BUS_ERROR_TIMEOUT],
+               (unsigned long)got->errors[BUS_ERROR_SHORT], (unsigned long)got->errors[BUS_ERROR_INVALID],
+               (unsigned long)got->errors[BUS_ERROR_OTHER]);
+
+        if (got->transactions != want->transactions || got->bytes_read != want->bytes_read ||
+            got->bytes_written != want->bytes_written || memcmp(got->errors, want->errors, sizeof(got->errors)) != 0)
+        {
+            printf("FAIL: %s, %s counters differ from the bus\n", phase, names[s]);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static int compare_ops(const gy85_stats_t *stats, const gy85_stats_t *expected)
+{
+    int failures = 0;
+
+    for (uint8_t op = 0; op < OP_COUNT; op++)
+    {
+        if (memcmp(&stats->ops[op], &expected->ops[op], sizeof(gy85_latency_stats_t)) != 0)
+        {
+            printf("FAIL: op %u histogram, %lu calls max %lu us, expected %lu calls max %lu us\n", op,
+                   (unsigned long)stats->ops[op].count, (unsigned long)stats->ops[op].max_us,
+                   (unsigned long)expected->ops[op].count, (unsigned long)expected->ops[op].max_us);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+/**
+ * An operation made by another one cannot be timed from here, it is
+ * taken from the driver once it is checked to be counted and to fit in
+ * the outer one
+ */
+static int adopt_nested(const gy85_stats_t *stats, gy85_stats_t *expected, gy85_op_t inner, gy85_op_t outer)
+{
+    int failures = 0;
+
+    if (stats->ops[inner].count != expected->ops[inner].count + 1 || stats->ops[inner].max_us > stats->ops[outer].max_us)
+    {
+        printf("FAIL: op %u nested in op %u\n", inner, outer);
+        failures++;
+    }
+    expected->ops[inner] = stats->ops[inner];
+
+    return failures;
+}
+
+/**
+ * Reads of every sensor and one setter each
+ */
+static int check_counts(gy85 *sensor, gy85_stats_t *expected)
+{
+    vec3f_t v;
+    int failures = 0;
+
+    for (uint32_t i = 0; i < ROUNDS; i++)
+    {
+        sleep_ms(10);
+        TIMED(expected, OP_READ_ADXL345, failures += sensor->read_adxl345(&v) != PICO_OK);
+        TIMED(expected, OP_READ_ITG3205, failures += sensor->read_itg3205(&v) != PICO_OK);
+        TIMED(expected, OP_READ_QMC5883L, failures += sensor->read_qmc5883l(&v) != PICO_OK);
+    }
+
+    TIMED(expected, OP_SET_ADXL345_RANGE, failures += sensor->set_adxl345_range(RANGE_4_G) != PICO_OK);
+    TIMED(expected, OP_SET_ITG3205_DLPF, failures += sensor->set_itg3205_dlpf(DLPF_20_1) != PICO_OK);
+    TIMED(expected, OP_SET_QMC5883L_SCALE, failures += sensor->set_qmc5883l_scale(SCALE_8_GA) != PICO_OK);
+
+    if (failures > 0)
+    {
+        printf("FAIL: %d driver calls failed\n", failures);
+    }
+
+    gy85_stats_t stats;
+    sensor->get_stats(&stats);
+    printf("known reads and writes, %d rounds\n", ROUNDS);
+    failures += compare_bus(&stats, "known transfers");
+    failures += adopt_nested(&stats, expected, OP_SET_ITG3205_DLPF_FS, OP_SET_ITG3205_DLPF);
+    failures += adopt_nested(&stats, expected, OP_SET_QMC5883L_CTRL, OP_SET_QMC5883L_SCALE);
+    return failures;
+}
+
+static int check_errors(gy85 *sensor, gy85_stats_t *expected)
+{
+    static const struct
+    {
+        int result;
+        bool short_read;
+        gy85_bus_error_t cause;
+    } injected[] = {
+        {PICO_ERROR_GENERIC, false, BUS_ERROR_NACK},
+        {PICO_ERROR_TIMEOUT, false, BUS_ERROR_TIMEOUT},
+        {PICO_OK, true, BUS_ERROR_SHORT},
+        {PICO_ERROR_INVALID_ARG, false, BUS_ERROR_INVALID},
+        {PICO_ERROR_NOT_PERMITTED, false, BUS_ERROR_OTHER},
+    };
+    static const uint8_t addrs[SENSOR_COUNT] = {ADXL345_ADDR, ITG3205_ADDR, QMC5883L_ADDR};
+    static const gy85_op_t ops[SENSOR_COUNT] = {OP_READ_ADXL345, OP_READ_ITG3205, OP_READ_QMC5883L};
+    int failures = 0;
+
+    for (uint32_t k = 0; k < sizeof(injected) / sizeof(injected[0]); k++)
+    {
+        for (uint8_t s = 0; s < SENSOR_COUNT; s++)
+        {
+            reference.fail_addr = addrs[s];
+            reference.fail_result = injected[k].result;
+            reference.fail_short = injected[k].short_read;
+            reference.bus[s].errors[injected[k].cause]++;
+
+            vec3f_t v;
+            int res = PICO_OK;
+            sleep_ms(10);
+            TIMED(expected, ops[s], res = s == SENSOR_ADXL345 ? sensor->read_adxl345(&v) :
+                                          s == SENSOR_ITG3205 ? sensor->read_itg3205(&v) : sensor->read_qmc5883l(&v));
+            if (res == PICO_OK)
+            {
+                printf("FAIL: read of sensor %u succeeded with error %u injected\n", s, injected[k].cause);
+                failures++;
+            }
+        }
+    }
+
+    gy85_stats_t stats;
+    sensor->get_stats(&stats);
+    printf("one injected failure of each cause per sensor\n");
+    failures += compare_bus(&stats, "injected failures");
+    failures += compare_ops(&stats, expected);
+
+    return failures;
+}
+
+/**
+ * read() is timed around the three reads it makes, each of them is also
+ * counted on its own
+ */
+static int check_read(gy85 *sensor, gy85_stats_t *expected)
+{
+    gy85_stats_t before, after;
+    int failures = 0;
+
+    sensor->get_stats(&before);
+    sleep_ms(10);
+    TIMED(expected, OP_READ, failures += sensor->read() != PICO_OK);
+    sensor->get_stats(&after);
+
+    uint32_t read_us = after.ops[OP_READ].max_us;
+    failures += adopt_nested(&after, expected, OP_READ_ADXL345, OP_READ);
+    failures += adopt_nested(&after, expected, OP_READ_ITG3205, OP_READ);
+    failures += adopt_nested(&after, expected, OP_READ_QMC5883L, OP_READ);
+
+    if (memcmp(&after.ops[OP_READ], &expected->ops[OP_READ], sizeof(gy85_latency_stats_t)) != 0)
+    {
+        printf("FAIL: read() histogram\n");
+        failures++;
+    }
+
+    printf("read(): %lu us\n", (unsigned long)read_us);
+    failures += compare_bus(&after, "read()");
+    failures += compare_ops(&after, expected);
+    return failures;
+}
+
+/**
+ * The text dump parsed back, the binary one copied back
+ */
+static int check_dumps(gy85 *sensor)
+{
+    gy85_stats_t stats;
+    sensor->get_stats(&stats);
+    int failures = 0;
+
+    static char text[4096];
+    int len = gy85_stats_format(&stats, text, sizeof(text));
+    char tiny[16];
+    if (len <= 0 || gy85_stats_format(&stats, tiny, sizeof(tiny)) != PICO_ERROR_INSUFFICIENT_RESOURCES)
+    {
+        printf("FAIL: text dump %d bytes\n", len);
+        return 1;
+    }
+
+    static const char *names[SENSOR_COUNT] = {"adxl345", "itg3205", "qmc5883l"};
+    uint32_t lines = 0;
+    for (char *line = strtok(text, "\n"); line != nullptr; line = strtok(nullptr, "\n"))
+    {
+        char name[32];
+        unsigned long tx, rd, wr, errors[BUS_ERROR_COUNT];
+        if (sscanf(line, "%31s tx=%lu rd=%lu wr=%lu nack=%lu timeout=%lu short=%lu invalid=%lu other=%lu", name, &tx, &rd,
+                   &wr, &errors[0], &errors[1], &errors[2], &errors[3], &errors[4]) == 9)
+        {
+            for (uint8_t s = 0; s < SENSOR_COUNT; s++)
+            {
+                const gy85_bus_stats_t *bus = &stats.bus[s];
+                if (strcmp(name, names[s]) != 0)
+                {
+                    continue;
+                }
+                lines++;
+                bool same = tx == bus->transactions && rd == bus->bytes_read && wr == bus->bytes_written;
+                for (uint8_t e = 0; e < BUS_ERROR_COUNT; e++)
+                {
+                    same &= errors[e] == bus->errors[e];
+                }
+                failures += !same;
+            }
+            continue;
+        }
+
+        unsigned long n, max_us;
+        if (sscanf(line, "%31s n=%lu max=%luus", name, &n, &max_us) == 3)
+        {
+            lines++;
+            bool found = false;
+            for (uint8_t op = 0; op < OP_COUNT; op++)
+            {
+                found |= stats.ops[op].count == n && stats.ops[op].max_us == max_us;
+            }
+            failures += !found;
+        }
+    }
+
+    uint32_t used_ops = 0;
+    for (uint8_t op = 0; op < OP_COUNT; op++)
+    {
+        used_ops += stats.ops[op].count > 0;
+    }
+    if (lines != SENSOR_COUNT + used_ops)
+    {
+        printf("FAIL: %lu text lines, expected %lu\n", (unsigned long)lines, (unsigned long)(SENSOR_COUNT + used_ops));
+        failures++;
+    }
+
+    uint8_t binary[sizeof(gy85_stats_t)];
+    gy85_stats_t copy;
+    int size = gy85_stats_serialize(&stats, binary, sizeof(binary));
+    memcpy(&copy, binary, sizeof(copy));
+    if (size != (int)sizeof(gy85_stats_t) || gy85_stats_serialize(&stats, binary, sizeof(binary) - 1) != PICO_ERROR_INSUFFICIENT_RESOURCES ||
+        memcmp(&copy, &stats, sizeof(copy)) != 0 || copy.magic != GY85_STATS_MAGIC || copy.version != GY85_STATS_VERSION ||
+        copy.sensor_count != SENSOR_COUNT || copy.bus_error_count != BUS_ERROR_COUNT || copy.op_count != OP_COUNT ||
+        copy.bucket_count != GY85_STATS_BUCKETS)
+    {
+        printf("FAIL: binary dump does not round trip\n");
+        failures++;
+    }
+
+    printf("dumps: %d text bytes in %lu lines, %d binary bytes\n", len, (unsigned long)lines, size);
+    return failures;
+}
+
+static int check_snapshot_reset(gy85 *sensor)
+{
+    gy85_stats_t before, after;
+    vec3f_t v;
+    int failures = 0;
+
+    sensor->get_stats(&before);
+    gy85_stats_t kept = before;
+    sleep_ms(10);
+    sensor->read_adxl345(&v);
+    sensor->get_stats(&after);
+
+    if (memcmp(&before, &kept, sizeof(before)) != 0 ||
+        after.bus[SENSOR_ADXL345].transactions != before.bus[SENSOR_ADXL345].transactions + 1 ||
+        after.ops[OP_READ_ADXL345].count != before.ops[OP_READ_ADXL345].count + 1)
+    {
+        printf("FAIL: snapshot\n");
+        failures++;
+    }
+
+    gy85_stats_t cleared;
+    gy85_stats_reset(&cleared);
+    sensor->reset_stats();
+    sensor->get_stats(&after);
+    if (memcmp(&after, &cleared, sizeof(after)) != 0 || after.magic != GY85_STATS_MAGIC)
+    {
+        printf("FAIL: reset\n");
+        failures++;
+    }
+
+    printf("snapshot and reset\n");
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    int failures = check_bucket_edges();
+
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.install();
+    reference.target = gy85_get_bus_ops();
+    gy85_set_bus_ops(&reference_ops);
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    gy85_stats_t expected;
+    gy85_stats_reset(&expected);
+    sensor.reset_stats();
+    memset(reference.bus, 0, sizeof(reference.bus));
+
+    failures += check_counts(&sensor, &expected);
+    failures += check_errors(&sensor, &expected);
+    failures += check_read(&sensor, &expected);
+    failures += check_dumps(&sensor);
+    failures += check_snapshot_reset(&sensor);
+
+    gy85_set_bus_ops(nullptr);
+    emu.uninstall();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
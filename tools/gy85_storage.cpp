@@ -0,0 +1,349 @@
+// Persistent calibration on a file-backed store (see gy85::save_calibration())
+// The driver runs on the register emulators (tools/emu), every save stores
+// a different ITG3205 sample rate divider so a load tells which record won.
+// Checks that a region of one sector is rejected without touching it, that
+// the erases spread evenly over the sectors with one erase per sector worth
+// of saves, and that a power cut at any erase or program of a save falls
+// back to the previous record or keeps the new one, never loses both.
+//
+// Usage: gy85_storage [image file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gy85/gy85.hpp"
+#include "gy85_emu.hpp"
+#include "file_storage.hpp"
+#include "pico/stdlib.h"
+
+#define MAX_SECTORS (16)
+#define WEAR_SECTORS (4)
+#define WEAR_SAVES (1000)
+#define POWER_LOSS_SAVES (300)
+
+/**
+ * Counts the erases of every sector on their way to the file.
+ * tear_next_program() makes the next program land only its first bytes
+ * and fail, finer than the half page torn by gy85_file_storage.
+ */
+class test_storage : public gy85_storage
+{
+private:
+    gy85_file_storage *target;
+    bool tear_armed;
+    uint32_t tear_landed;
+    bool powered;
+
+public:
+    uint32_t erases[MAX_SECTORS];
+
+    test_storage(gy85_file_storage *target)
+    {
+        this->target = target;
+        this->tear_armed = false;
+        this->tear_landed = 0;
+        this->powered = true;
+        memset(this->erases, 0, sizeof(this->erases));
+    }
+
+    void tear_next_program(uint32_t landed)
+    {
+        this->tear_armed = true;
+        this->tear_landed = landed;
+    }
+
+    void power_on()
+    {
+        this->tear_armed = false;
+        this->powered = true;
+        this->target->power_on();
+    }
+
+    uint32_t size() override
+    {
+        return this->target->size();
+    }
+
+    uint32_t sector_size() override
+    {
+        return this->target->sector_size();
+    }
+
+    uint32_t page_size() override
+    {
+        return this->target->page_size();
+    }
+
+    int read(uint32_t offset, uint8_t *buffer, uint32_t len) override
+    {
+        if (!this->powered)
+        {
+            return PICO_ERROR_IO;
+        }
+        return this->target->read(offset, buffer, len);
+    }
+
+    int erase(uint32_t offset) override
+    {
+        if (!this->powered)
+        {
+            return PICO_ERROR_IO;
+        }
+
+        uint32_t sector = offset / this->target->sector_size();
+        if (sector < MAX_SECTORS)
+        {
+            this->erases[sector]++;
+        }
+        return this->target->erase(offset);
+    }
+
+    int program(uint32_t offset, const uint8_t *data, uint32_t len) override
+    {
+        if (!this->powered)
+        {
+            return PICO_ERROR_IO;
+        }
+        if (!this->tear_armed)
+        {
+            return this->target->program(offset, data, len);
+        }
+
+        // 0xFF leaves NOR flash unchanged
+        uint8_t page[GY85_FLASH_PAGE_SIZE];
+        uint32_t landed = this->tear_landed < len ? this->tear_landed : len;
+        memset(page, 0xFF, len);
+        memcpy(page, data, landed);
+        this->target->program(offset, page, len);
+
+        // Nothing else lands until power_on()
+        this->powered = false;
+        return PICO_ERROR_IO;
+    }
+};
+
+/**
+ * Loads the stored record into the sensor and reads back its divider,
+ * the sensor is set to another value first
+ */
+static int load_div(gy85 *sensor, gy85_storage *storage, uint8_t not_div, uint8_t *div)
+{
+    if (sensor->set_itg3205_sample_rate_div(not_div) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    int res = sensor->load_calibration(storage);
+    if (res != PICO_OK)
+    {
+        return res;
+    }
+
+    return sensor->get_itg3205_sample_rate_div(div);
+}
+
+static int save_div(gy85 *sensor, gy85_storage *storage, uint8_t div)
+{
+    if (sensor->set_itg3205_sample_rate_div(div) != PICO_OK)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return sensor->save_calibration(storage);
+}
+
+static int check_single_sector(gy85 *sensor, gy85_file_storage *file)
+{
+    int save_res = sensor->save_calibration(file);
+    int load_res = sensor->load_calibration(file);
+    int init_res = sensor->init(file, 4);
+
+    printf("single sector: save %d, load %d, init %d, %lu erases, %lu programs\n", save_res, load_res, init_res,
+           (unsigned long)file->erases, (unsigned long)file->programs);
+
+    if (save_res != PICO_ERROR_INVALID_ARG || load_res != PICO_ERROR_INVALID_ARG || init_res == PICO_OK ||
+        file->erases != 0 || file->programs != 0)
+    {
+        printf("FAIL: a region of one sector must be rejected untouched\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_wear(gy85 *sensor, gy85_file_storage *file)
+{
+    test_storage storage(file);
+    uint32_t slots_per_sector = file->sector_size() / file->page_size();
+    int failures = 0;
+
+    for (uint32_t i = 0; i < WEAR_SAVES; i++)
+    {
+        uint32_t erases = file->erases;
+        uint32_t programs = file->programs;
+        uint8_t div = (uint8_t)i;
+        uint8_t loaded;
+
+        if (save_div(sensor, &storage, div) != PICO_OK ||
+            load_div(sensor, &storage, div ^ 0x80, &loaded) != PICO_OK || loaded != div)
+        {
+            printf("FAIL: save %lu not loaded back\n", (unsigned long)i);
+            return failures + 1;
+        }
+
+        if (file->erases - erases > 1 || file->programs - programs != 1)
+        {
+            printf("FAIL: save %lu took %lu erases, %lu programs\n", (unsigned long)i,
+                   (unsigned long)(file->erases - erases), (unsigned long)(file->programs - programs));
+            failures++;
+        }
+    }
+
+    uint32_t min_erases = storage.erases[0];
+    uint32_t max_erases = storage.erases[0];
+    for (uint32_t s = 1; s < WEAR_SECTORS; s++)
+    {
+        min_erases = storage.erases[s] < min_erases ? storage.erases[s] : min_erases;
+        max_erases = storage.erases[s] > max_erases ? storage.erases[s] : max_erases;
+    }
+
+    // The first save erases sector 0, then one erase every slots_per_sector saves
+    uint32_t expected = (WEAR_SAVES + slots_per_sector - 1) / slots_per_sector;
+    printf("wear: %d saves on %d sectors of %lu slots, %lu erases (expected %lu), %lu..%lu per sector\n",
+           WEAR_SAVES, WEAR_SECTORS, (unsigned long)slots_per_sector, (unsigned long)file->erases,
+           (unsigned long)expected, (unsigned long)min_erases, (unsigned long)max_erases);
+
+    if (file->erases != expected || max_erases - min_erases > 1)
+    {
+        printf("FAIL: uneven or extra erases\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+static int check_power_loss(gy85 *sensor, gy85_file_storage *file)
+{
+    test_storage storage(file);
+    uint32_t fell_back = 0;
+    uint32_t kept = 0;
+    uint8_t acked = 0;
+    bool has_acked = false;
+    int failures = 0;
+
+    for (uint32_t i = 0; i < POWER_LOSS_SAVES; i++)
+    {
+        uint8_t div = (uint8_t)(i + 1);
+
+        // A save is at most an erase and a program, tear either one, or the
+        // program after any number of record bytes
+        if (i % 3 == 2)
+        {
+            storage.tear_next_program((i / 3) % sizeof(gy85_calib_record_t));
+        }
+        else
+        {
+            file->cut_power_after(i % 3);
+        }
+        int res = save_div(sensor, &storage, div);
+        storage.power_on();
+
+        uint8_t loaded;
+        int load_res = load_div(sensor, &storage, div ^ 0x80, &loaded);
+
+        if (res == PICO_OK)
+        {
+            // The cut was armed past the last operation of the save
+            if (load_res != PICO_OK || loaded != div)
+            {
+                printf("FAIL: save %lu acknowledged but not loaded back\n", (unsigned long)i);
+                failures++;
+            }
+        }
+        else if (load_res == PICO_OK && loaded == div)
+        {
+            kept++;
+        }
+        else if (has_acked && load_res == PICO_OK && loaded == acked)
+        {
+            fell_back++;
+        }
+        else if (has_acked || load_res != PICO_ERROR_NO_DATA)
+        {
+            printf("FAIL: save %lu torn, load %d, divider %u (previous %u, new %u)\n", (unsigned long)i, load_res,
+                   load_res == PICO_OK ? loaded : 0, acked, div);
+            failures++;
+        }
+
+        if (load_res == PICO_OK)
+        {
+            acked = loaded;
+            has_acked = true;
+        }
+    }
+
+    printf("power loss: %d saves with a cut armed, %lu torn ones fell back to the previous record, %lu kept the new one\n",
+           POWER_LOSS_SAVES, (unsigned long)fell_back, (unsigned long)kept);
+
+    // Saving carries on after the cuts
+    uint8_t loaded;
+    if (save_div(sensor, &storage, 0x5A) != PICO_OK || load_div(sensor, &storage, 0xA5, &loaded) != PICO_OK || loaded != 0x5A)
+    {
+        printf("FAIL: saving after the power cuts\n");
+        failures++;
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [image file]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argc == 2 ? argv[1] : "gy85_storage.img";
+
+    gy85_emu_script still;
+    gy85_emu emu(&still);
+    emu.install();
+
+    gy85 sensor;
+    if (sensor.init() != PICO_OK)
+    {
+        printf("FAIL: init\n");
+        return 1;
+    }
+
+    gy85_file_storage file;
+    int failures = 0;
+
+    if (file.open(path, GY85_FLASH_SECTOR_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    failures += check_single_sector(&sensor, &file);
+
+    if (file.open(path, WEAR_SECTORS * GY85_FLASH_SECTOR_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    failures += check_wear(&sensor, &file);
+
+    if (file.open(path, 2 * GY85_FLASH_SECTOR_SIZE, true) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    failures += check_power_loss(&sensor, &file);
+
+    file.close();
+    remove(path);
+    emu.uninstall();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+// Decodes a gy85 I2C trace dump (see include/gy85/trace.hpp)
+// The dump can be the raw binary image or the same bytes as hex text.
+// --self-test records past the ring capacity through the device side and
+// checks the decoded order, also on a ring whose head wrapped past 2^32.
+//
+// Usage: gy85_trace <dump file>
+//        gy85_trace --self-test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include "gy85/trace.hpp"
+#include "gy85/gy85.hpp"
+#include "pico/stdlib.h"
+
+static const char *device_name(uint8_t addr)
+{
+    switch (addr)
+    {
+    case ADXL345_ADDR:
+        return "adxl345";
+    case ITG3205_ADDR:
+        return "itg3205";
+    case QMC5883L_ADDR:
+        return "qmc5883l";
+    default:
+        return "?";
+    }
+}
+
+static const char *result_name(int8_t result)
+{
+    // Values of the SDK pico_error_codes
+    switch (result)
+    {
+    case 0:
+        return "ok";
+    case -1:
+        return "timeout";
+    case -2:
+        return "nack";
+    case -5:
+        return "invalid";
+    case -6:
+        return "short";
+    default:
+        return "error";
+    }
+}
+
+static bool load_dump(const char *path, std::vector<uint8_t> &dump)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        dump.push_back((uint8_t)c);
+    }
+    fclose(file);
+
+    // Binary dumps start with the magic, anything else is parsed as hex
+    if (dump.size() >= 4 && dump[0] == (GY85_TRACE_MAGIC & 0xFF) && dump[1] == ((GY85_TRACE_MAGIC >> 8) & 0xFF))
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> bytes;
+    int nibbles = 0;
+    uint8_t value = 0;
+    for (uint8_t ch : dump)
+    {
+        if (!isxdigit(ch))
+        {
+            continue;
+        }
+        value = (value << 4) | (uint8_t)(isdigit(ch) ? ch - '0' : tolower(ch) - 'a' + 10);
+        if (++nibbles == 2)
+        {
+            bytes.push_back(value);
+            nibbles = 0;
+            value = 0;
+        }
+    }
+    dump.swap(bytes);
+
+    return true;
+}
+
+/**
+ * Decodes the dump and checks the count, the first sequence and that the
+ * register of every entry is the low byte of its sequence
+ */
+static int check_decode(const char *name, const gy85_trace_t *ring, int expected_count, uint32_t expected_first)
+{
+    gy85_trace_entry_t entries[GY85_TRACE_ENTRIES];
+    uint32_t first = 0;
+    int count = gy85_trace_decode((const uint8_t *)ring, sizeof(*ring), entries, GY85_TRACE_ENTRIES, &first);
+    bool ok = count == expected_count && (count <= 0 || first == expected_first);
+
+    for (int i = 0; ok && i < count; i++)
+    {
+        ok = entries[i].reg == (uint8_t)(first + i) && entries[i].reserved == 0 &&
+             (i == 0 || entries[i].timestamp_us >= entries[i - 1].timestamp_us);
+    }
+
+    printf("%s: %d entries from %lu (expected %d from %lu): %s\n", name, count, (unsigned long)first,
+           expected_count, (unsigned long)expected_first, ok ? "PASS" : "FAIL");
+
+    return ok ? 0 : 1;
+}
+
+static int run_self_test()
+{
+    gy85_trace_t ring;
+    uint32_t recorded = 0;
+    int failures = 0;
+
+    // Device side, the host ring starts zeroed like a cold boot
+    gy85_trace_init();
+    for (uint32_t target : {5u, (uint32_t)GY85_TRACE_ENTRIES, 3u * GY85_TRACE_ENTRIES + 5})
+    {
+        for (; recorded < target; recorded++)
+        {
+            uint32_t start = time_us_32();
+            sleep_us(10);
+            gy85_trace_record(ADXL345_ADDR, (uint8_t)recorded, 1, recorded & 1 ? GY85_TRACE_WRITE : 0, PICO_OK, start);
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%lu recorded", (unsigned long)recorded);
+        gy85_trace_dump((uint8_t *)&ring, sizeof(ring));
+        int count = recorded < GY85_TRACE_ENTRIES ? recorded : GY85_TRACE_ENTRIES;
+        failures += check_decode(name, &ring, count, recorded - count);
+    }
+
+    // Same ring after 2^32 + 20 transactions
+    ring.head = 20;
+    ring.first = ring.head - GY85_TRACE_ENTRIES;
+    for (uint32_t sequence = ring.first; sequence != ring.head; sequence++)
+    {
+        ring.entries[sequence & (GY85_TRACE_ENTRIES - 1)].reg = (uint8_t)sequence;
+        ring.entries[sequence & (GY85_TRACE_ENTRIES - 1)].timestamp_us = sequence - ring.first;
+    }
+    failures += check_decode("head wrapped", &ring, GY85_TRACE_ENTRIES, ring.first);
+
+    // More valid entries than the ring holds
+    ring.first--;
+    failures += check_decode("corrupted", &ring, -1, 0);
+
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--self-test") == 0)
+    {
+        return run_self_test();
+    }
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <dump file>\n", argv[0]);
+        fprintf(stderr, "       %s --self-test\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> dump;
+    if (!load_dump(argv[1], dump))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    gy85_trace_entry_t entries[GY85_TRACE_ENTRIES];
+    uint32_t sequence;
+    int count = gy85_trace_decode(dump.data(), dump.size(), entries, GY85_TRACE_ENTRIES, &sequence);
+    if (count < 0)
+    {
+        fprintf(stderr, "%s: not a valid gy85 trace dump\n", argv[1]);
+        return 1;
+    }
+
+    printf("%10s %12s %8s %-9s %-2s %4s %3s %s\n", "seq", "time_us", "dur_us", "device", "rw", "reg", "len", "result");
+    for (int i = 0; i < count; i++, sequence++)
+    {
+        const gy85_trace_entry_t *entry = &entries[i];
+
+        if (entry->flags & GY85_TRACE_BOOT)
+        {
+            printf("%10lu %12lu ---- reset ----\n", (unsigned long)sequence, (unsigned long)entry->timestamp_us);
+            continue;
+        }
+
+        printf("%10lu %12lu %8u %-9s %-2s 0x%02X %3u %s\n",
+               (unsigned long)sequence,
+               (unsigned long)entry->timestamp_us,
+               entry->duration_us,
+               device_name(entry->addr),
+               entry->flags & GY85_TRACE_WRITE ? "W" : "R",
+               entry->reg,
+               entry->len,
+               result_name(entry->result));
+    }
+
+    return 0;
+}
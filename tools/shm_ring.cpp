@@ -0,0 +1,276 @@
+#include "shm_ring.hpp"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t ring_size(uint32_t slots)
+{
+    return sizeof(gy85_shm_header_t) + (size_t)slots * sizeof(gy85_shm_slot_t);
+}
+
+gy85_shm_writer::gy85_shm_writer()
+{
+    this->name[0] = 0;
+    this->size = 0;
+    this->header = NULL;
+    this->slots = NULL;
+    this->head = 0;
+}
+
+gy85_shm_writer::~gy85_shm_writer()
+{
+    this->close();
+}
+
+/**
+ * Creates the shared memory object, replacing a stale one left by a
+ * writer that did not exit cleanly. Readers still mapping the old one
+ * keep it until they detach.
+ */
+int gy85_shm_writer::create(const char *name, uint32_t slots)
+{
+    if (slots == 0 || (slots & (slots - 1)) != 0 || strlen(name) >= sizeof(this->name))
+    {
+        return SHM_ERROR_INVALID_ARG;
+    }
+
+    this->close();
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        return SHM_ERROR_IO;
+    }
+
+    // ftruncate() zero fills, every slot starts with sequence 0
+    size_t size = ring_size(slots);
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return SHM_ERROR_IO;
+    }
+
+    strcpy(this->name, name);
+    this->size = size;
+    this->header = (gy85_shm_header_t *)map;
+    this->slots = (gy85_shm_slot_t *)((uint8_t *)map + sizeof(gy85_shm_header_t));
+    this->head = 0;
+
+    this->header->version = GY85_SHM_VERSION;
+    this->header->record_size = sizeof(gy85_shm_record_t);
+    this->header->slots = slots;
+    this->header->writer_pid = getpid();
+
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    this->header->magic = GY85_SHM_MAGIC;
+
+    return SHM_OK;
+}
+
+void gy85_shm_writer::close()
+{
+    if (this->header != NULL)
+    {
+        this->set_closed();
+        munmap(this->header, this->size);
+        shm_unlink(this->name);
+        this->header = NULL;
+        this->slots = NULL;
+    }
+}
+
+/**
+ * Copies the record into the next slot and publishes it, the index is
+ * filled in here.
+ */
+void gy85_shm_writer::publish(const gy85_shm_record_t *record)
+{
+    gy85_shm_slot_t *slot = &this->slots[this->head & (this->header->slots - 1)];
+
+    slot->seq.store(2 * this->head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->record = *record;
+    slot->record.index = this->head;
+
+    slot->seq.store(2 * this->head + 2, std::memory_order_release);
+    this->head++;
+    this->header->head.store(this->head, std::memory_order_release);
+}
+
+void gy85_shm_writer::count_parse_error()
+{
+    this->header->parse_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void gy85_shm_writer::set_closed()
+{
+    this->header->closed.store(1, std::memory_order_release);
+}
+
+uint64_t gy85_shm_writer::get_head()
+{
+    return this->head;
+}
+
+uint64_t gy85_shm_writer::get_parse_errors()
+{
+    return this->header->parse_errors.load(std::memory_order_relaxed);
+}
+
+gy85_shm_reader::gy85_shm_reader()
+{
+    this->size = 0;
+    this->header = NULL;
+    this->slots = NULL;
+    this->mask = 0;
+    this->next = 0;
+    this->seq = 0;
+    this->lost = 0;
+    this->torn = 0;
+}
+
+gy85_shm_reader::~gy85_shm_reader()
+{
+    this->detach();
+}
+
+/**
+ * Maps the ring read only. SHM_ERROR_NO_DATA while the writer has not
+ * created it yet.
+ */
+int gy85_shm_reader::attach(const char *name)
+{
+    this->detach();
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return SHM_ERROR_NO_DATA;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(gy85_shm_header_t))
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return SHM_ERROR_NO_DATA;
+    }
+
+    const gy85_shm_header_t *header = (const gy85_shm_header_t *)map;
+    bool ready = header->magic == GY85_SHM_MAGIC;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (!ready || header->version != GY85_SHM_VERSION || header->record_size != sizeof(gy85_shm_record_t) ||
+        (size_t)st.st_size < ring_size(header->slots))
+    {
+        munmap(map, st.st_size);
+        return ready ? SHM_ERROR_IO : SHM_ERROR_NO_DATA;
+    }
+
+    this->size = st.st_size;
+    this->header = header;
+    this->slots = (const gy85_shm_slot_t *)((const uint8_t *)map + sizeof(gy85_shm_header_t));
+    this->mask = header->slots - 1;
+    this->next = header->head.load(std::memory_order_acquire);
+    this->lost = 0;
+    this->torn = 0;
+
+    return SHM_OK;
+}
+
+void gy85_shm_reader::detach()
+{
+    if (this->header != NULL)
+    {
+        munmap((void *)this->header, this->size);
+        this->header = NULL;
+        this->slots = NULL;
+    }
+}
+
+/**
+ * Points record at the oldest record not read yet, in place in the ring.
+ * It stays valid until end(). SHM_ERROR_NO_DATA when there is nothing new.
+ */
+int gy85_shm_reader::begin(const gy85_shm_record_t **record)
+{
+    while (true)
+    {
+        uint64_t head = this->header->head.load(std::memory_order_acquire);
+        if (this->next == head)
+        {
+            return SHM_ERROR_NO_DATA;
+        }
+
+        // The slot after the newest record is the one the writer fills next
+        if (head - this->next > this->mask)
+        {
+            this->lost += head - this->next - this->mask;
+            this->next = head - this->mask;
+        }
+
+        const gy85_shm_slot_t *slot = &this->slots[this->next & this->mask];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == 2 * this->next + 2)
+        {
+            this->seq = seq;
+            *record = &slot->record;
+            return SHM_OK;
+        }
+
+        // Overwritten since head was loaded
+        this->lost++;
+        this->next++;
+    }
+}
+
+/**
+ * Releases the record of begin(), false if the writer got to its slot in
+ * the meantime and what was read from it is not consistent.
+ */
+bool gy85_shm_reader::end()
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool intact = this->slots[this->next & this->mask].seq.load(std::memory_order_relaxed) == this->seq;
+    if (!intact)
+    {
+        this->lost++;
+        this->torn++;
+    }
+
+    this->next++;
+    return intact;
+}
+
+uint64_t gy85_shm_reader::available()
+{
+    uint64_t pending = this->header->head.load(std::memory_order_acquire) - this->next;
+    return pending > this->mask ? this->mask : pending;
+}
+
+bool gy85_shm_reader::is_closed()
+{
+    return this->header->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t gy85_shm_reader::get_parse_errors()
+{
+    return this->header->parse_errors.load(std::memory_order_relaxed);
+}
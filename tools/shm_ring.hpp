@@ -0,0 +1,119 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Shared Memory Ring
+#define GY85_SHM_MAGIC (0x4D485347) ///< "GSHM" in little endian
+#define GY85_SHM_VERSION (1)
+#define GY85_SHM_NAME "/gy85"       ///< Default shm_open() name
+#define GY85_SHM_SLOTS (4096)       ///< Default ring size, a power of two
+
+// Same values as the SDK pico_error_codes
+#define SHM_OK (0)
+#define SHM_ERROR_NO_DATA (-3)
+#define SHM_ERROR_INVALID_ARG (-5)
+#define SHM_ERROR_IO (-6)
+
+/**
+ * One decoded sample, fixed layout shared by every reader.
+ */
+typedef struct
+{
+    uint64_t index;   ///< Position in the stream, consecutive
+    uint64_t time_ns; ///< CLOCK_MONOTONIC when the sample was decoded
+    float accel[3];   ///< As printed by gy85_example, m/s^2
+    float gyro[3];    ///< rad/s
+    float mag[3];     ///< Counts
+    uint32_t reserved;
+} gy85_shm_record_t;
+
+/**
+ * A record and its sequence number on one cache line. The sequence is
+ * 2 * index + 1 while the writer fills the slot and 2 * index + 2 once the
+ * record is complete.
+ */
+typedef struct alignas(64)
+{
+    std::atomic<uint64_t> seq;
+    gy85_shm_record_t record;
+} gy85_shm_slot_t;
+
+typedef struct alignas(64)
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t slots;
+    int32_t writer_pid;
+    std::atomic<uint64_t> parse_errors; ///< Lines that could not be decoded
+    std::atomic<uint32_t> closed;       ///< Set once the writer stops publishing
+    alignas(64) std::atomic<uint64_t> head; ///< Records published so far, on its own cache line
+} gy85_shm_header_t;
+
+static_assert(sizeof(gy85_shm_slot_t) == 64, "one slot per cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomics must work across processes");
+
+/**
+ * Single writer side of the ring, creates the shared memory object.
+ * publish() never waits for the readers, a slow reader gets overrun
+ * instead of holding back the stream.
+ */
+class gy85_shm_writer
+{
+private:
+    char name[64];
+    size_t size;
+    gy85_shm_header_t *header;
+    gy85_shm_slot_t *slots;
+    uint64_t head;
+
+public:
+    gy85_shm_writer();
+    ~gy85_shm_writer();
+
+    int create(const char *name, uint32_t slots = GY85_SHM_SLOTS);
+    void close();
+
+    void publish(const gy85_shm_record_t *record);
+    void count_parse_error();
+    void set_closed();
+
+    uint64_t get_head();
+    uint64_t get_parse_errors();
+};
+
+/**
+ * Read only view of the ring, any number of them in any process.
+ * begin() hands out a pointer into the shared slot, no copy and no
+ * system call; end() tells whether the writer overwrote the slot while it
+ * was in use, in which case whatever was read from it must be dropped.
+ * Readers start at the newest record and count what they miss in lost.
+ */
+class gy85_shm_reader
+{
+private:
+    size_t size;
+    const gy85_shm_header_t *header;
+    const gy85_shm_slot_t *slots;
+    uint64_t mask;
+    uint64_t next;
+    uint64_t seq;
+
+public:
+    uint64_t lost;  ///< Records overwritten before this reader got to them
+    uint64_t torn;  ///< Records overwritten while being read, included in lost
+
+    gy85_shm_reader();
+    ~gy85_shm_reader();
+
+    int attach(const char *name);
+    void detach();
+
+    int begin(const gy85_shm_record_t **record);
+    bool end();
+
+    uint64_t available();
+    bool is_closed();
+    uint64_t get_parse_errors();
+};